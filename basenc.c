@@ -0,0 +1,763 @@
+#include "basenc.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+struct codec;
+
+/* The kernels work on whole groups: 4 chars and 3 bytes for base64, 8
+ * chars and 5 bytes for base32. Decoders return the number of groups
+ * decoded before the first one with an invalid char, like the
+ * decode_pairs kernels in hexcodec.c. None of them reads or writes
+ * outside the n groups.
+ */
+typedef size_t (*decode_fn)(const char *in, char *out, size_t n,
+			    const struct codec *c);
+typedef void (*encode_fn)(const char *in, char *out, size_t n,
+			  const struct codec *c);
+
+struct codec {
+	const char *name;
+	const char *alphabet;
+	int chars; /* per group */
+	int bytes;
+	int bits; /* per char */
+	signed char value[256]; /* of every char, -1 if not in the alphabet */
+	decode_fn decode;
+	encode_fn encode;
+};
+
+static struct codec codecs[] = {
+	[BASE64] = { "base64",
+		     "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+		     "0123456789+/",
+		     4, 3, 6 },
+	[BASE64URL] = { "base64url",
+			"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+			"0123456789-_",
+			4, 3, 6 },
+	[BASE32] = { "base32", "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567", 8, 5, 5 },
+};
+
+static size_t decode64_scalar(const char *in, char *out, size_t n,
+			      const struct codec *c)
+{
+	const signed char *v = c->value;
+
+	for (size_t j = 0; j < n; j++, in += 4, out += 3) {
+		int a = v[(unsigned char)in[0]], b = v[(unsigned char)in[1]];
+		int d = v[(unsigned char)in[2]], e = v[(unsigned char)in[3]];
+
+		if ((a | b | d | e) < 0)
+			return j;
+		uint32_t x = (uint32_t)a << 18 | b << 12 | d << 6 | e;
+		out[0] = x >> 16;
+		out[1] = x >> 8;
+		out[2] = x;
+	}
+	return n;
+}
+
+static void encode64_scalar(const char *in, char *out, size_t n,
+			    const struct codec *c)
+{
+	const char *a = c->alphabet;
+
+	for (size_t j = 0; j < n; j++, in += 3, out += 4) {
+		const unsigned char *p = (const unsigned char *)in;
+		uint32_t x = (uint32_t)p[0] << 16 | p[1] << 8 | p[2];
+
+		out[0] = a[x >> 18];
+		out[1] = a[x >> 12 & 63];
+		out[2] = a[x >> 6 & 63];
+		out[3] = a[x & 63];
+	}
+}
+
+static size_t decode32_scalar(const char *in, char *out, size_t n,
+			      const struct codec *c)
+{
+	for (size_t j = 0; j < n; j++, in += 8, out += 5) {
+		uint64_t x = 0;
+		int bad = 0;
+
+		for (int i = 0; i < 8; i++) {
+			int v = c->value[(unsigned char)in[i]];
+
+			bad |= v;
+			x = x << 5 | (v & 31);
+		}
+		if (bad < 0)
+			return j;
+		for (int i = 0; i < 5; i++)
+			out[i] = x >> (32 - 8 * i);
+	}
+	return n;
+}
+
+static void encode32_scalar(const char *in, char *out, size_t n,
+			    const struct codec *c)
+{
+	for (size_t j = 0; j < n; j++, in += 5, out += 8) {
+		uint64_t x = 0;
+
+		for (int i = 0; i < 5; i++)
+			x = x << 8 | (unsigned char)in[i];
+		for (int i = 0; i < 8; i++)
+			out[i] = c->alphabet[x >> (35 - 5 * i) & 31];
+	}
+}
+
+#ifdef HAVE_X86_SIMD
+/* The decoders check the ranges of the alphabet the same way as
+ * nibbles_ssse3() in hexcodec.c, with an unsigned min and a compare
+ * each, and the two chars that differ between the base64 alphabets with
+ * plain compares.
+ *
+ * Packing follows Muła and Lemire: maddubs joins pairs of 6 bit values
+ * into 12 bits, madd pairs of those into 24 bits per dword, and a shuffle
+ * puts the 3 bytes of each dword in big endian order. Base32 joins 5 bit
+ * values into 10 and 20 bits the same way, and two 20 bit halves with a
+ * 64 bit shift.
+ *
+ * The 128 bit loops are always inlined, so that the AVX2 versions get a
+ * VEX encoded copy for their tails.
+ */
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+__attribute__((target("ssse3"))) static ALWAYS_INLINE bool
+sextets_ssse3(__m128i c, __m128i c62, __m128i c63, __m128i *val)
+{
+	__m128i u = _mm_sub_epi8(c, _mm_set1_epi8('A'));
+	__m128i l = _mm_sub_epi8(c, _mm_set1_epi8('a'));
+	__m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	__m128i is_u = _mm_cmpeq_epi8(_mm_min_epu8(u, _mm_set1_epi8(25)), u);
+	__m128i is_l = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(25)), l);
+	__m128i is_d = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+	__m128i is_62 = _mm_cmpeq_epi8(c, c62);
+	__m128i is_63 = _mm_cmpeq_epi8(c, c63);
+	__m128i ok = _mm_or_si128(_mm_or_si128(is_u, is_l),
+				  _mm_or_si128(is_d, _mm_or_si128(is_62, is_63)));
+
+	l = _mm_add_epi8(l, _mm_set1_epi8(26));
+	d = _mm_add_epi8(d, _mm_set1_epi8(52));
+	*val = _mm_or_si128(
+		_mm_or_si128(_mm_and_si128(is_u, u), _mm_and_si128(is_l, l)),
+		_mm_or_si128(_mm_and_si128(is_d, d),
+			     _mm_or_si128(_mm_and_si128(is_62, _mm_set1_epi8(62)),
+					  _mm_and_si128(is_63, _mm_set1_epi8(63)))));
+	return _mm_movemask_epi8(ok) == 0xffff;
+}
+
+__attribute__((target("ssse3"))) static ALWAYS_INLINE __m128i
+pack64_ssse3(__m128i v)
+{
+	v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+	v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+	return _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14,
+						 13, 12, -1, -1, -1, -1));
+}
+
+/* Each 16 byte store has 12 bytes of output, so it stops 2 groups short
+ * of the end.
+ */
+__attribute__((target("ssse3"))) static ALWAYS_INLINE size_t
+decode64_128(const char *in, char *out, size_t n, const struct codec *c)
+{
+	const __m128i c62 = _mm_set1_epi8(c->alphabet[62]);
+	const __m128i c63 = _mm_set1_epi8(c->alphabet[63]);
+	size_t j = 0;
+
+	for (; j + 6 <= n; j += 4) {
+		__m128i v;
+
+		if (!sextets_ssse3(_mm_loadu_si128((const __m128i *)(in + 4 * j)),
+				   c62, c63, &v))
+			break;
+		_mm_storeu_si128((__m128i *)(out + 3 * j), pack64_ssse3(v));
+	}
+	return j + decode64_scalar(in + 4 * j, out + 3 * j, n - j, c);
+}
+
+/* Muła's encoder: a shuffle lays out the 3 bytes of each group as
+ * [b1 b0 b2 b1], and the four 6 bit indices are moved into bytes of their
+ * own with a multiply high and a multiply low. A saturated subtract and a
+ * compare reduce the index to a slot of a table with the offset from the
+ * index to its char.
+ */
+__attribute__((target("ssse3"))) static ALWAYS_INLINE __m128i
+sextet_indices_ssse3(__m128i in)
+{
+	__m128i t0, t1;
+
+	in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6,
+						8, 7, 10, 9, 11, 10));
+	t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	t0 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	t1 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	t1 = _mm_mullo_epi16(t1, _mm_set1_epi32(0x01000010));
+	return _mm_or_si128(t0, t1);
+}
+
+__attribute__((target("ssse3"))) static ALWAYS_INLINE __m128i
+ascii64_ssse3(__m128i idx, __m128i offsets)
+{
+	__m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+	__m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+
+	r = _mm_or_si128(r, _mm_and_si128(less, _mm_set1_epi8(13)));
+	return _mm_add_epi8(_mm_shuffle_epi8(offsets, r), idx);
+}
+
+__attribute__((target("ssse3"))) static ALWAYS_INLINE __m128i
+offsets64_ssse3(const struct codec *c)
+{
+	const char d = '0' - 52;
+
+	return _mm_setr_epi8('a' - 26, d, d, d, d, d, d, d, d, d, d,
+			     c->alphabet[62] - 62, c->alphabet[63] - 63, 'A', 0,
+			     0);
+}
+
+/* 16 byte loads for 12 bytes of input */
+__attribute__((target("ssse3"))) static ALWAYS_INLINE void
+encode64_128(const char *in, char *out, size_t n, const struct codec *c)
+{
+	const __m128i offsets = offsets64_ssse3(c);
+	size_t j = 0;
+
+	for (; j + 6 <= n; j += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(in + 3 * j));
+
+		x = ascii64_ssse3(sextet_indices_ssse3(x), offsets);
+		_mm_storeu_si128((__m128i *)(out + 4 * j), x);
+	}
+	encode64_scalar(in + 3 * j, out + 4 * j, n - j, c);
+}
+
+__attribute__((target("ssse3"))) static ALWAYS_INLINE bool
+quintets_ssse3(__m128i c, __m128i *val)
+{
+	__m128i u = _mm_sub_epi8(c, _mm_set1_epi8('A'));
+	__m128i d = _mm_sub_epi8(c, _mm_set1_epi8('2'));
+	__m128i is_u = _mm_cmpeq_epi8(_mm_min_epu8(u, _mm_set1_epi8(25)), u);
+	__m128i is_d = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(5)), d);
+
+	d = _mm_add_epi8(d, _mm_set1_epi8(26));
+	*val = _mm_or_si128(_mm_and_si128(is_u, u), _mm_and_si128(is_d, d));
+	return _mm_movemask_epi8(_mm_or_si128(is_u, is_d)) == 0xffff;
+}
+
+__attribute__((target("ssse3"))) static ALWAYS_INLINE __m128i
+pack32_ssse3(__m128i v)
+{
+	v = _mm_maddubs_epi16(v, _mm_set1_epi16(0x0120));
+	v = _mm_madd_epi16(v, _mm_set1_epi32(0x00010400));
+	v = _mm_or_si128(_mm_slli_epi64(v, 20), _mm_srli_epi64(v, 32));
+	return _mm_shuffle_epi8(v, _mm_setr_epi8(4, 3, 2, 1, 0, 12, 11, 10, 9,
+						 8, -1, -1, -1, -1, -1, -1));
+}
+
+/* Two groups per 16 byte store of 10 bytes */
+__attribute__((target("ssse3"))) static ALWAYS_INLINE size_t
+decode32_128(const char *in, char *out, size_t n, const struct codec *c)
+{
+	size_t j = 0;
+
+	for (; j + 4 <= n; j += 2) {
+		__m128i v;
+
+		if (!quintets_ssse3(_mm_loadu_si128((const __m128i *)(in + 8 * j)),
+				    &v))
+			break;
+		_mm_storeu_si128((__m128i *)(out + 5 * j), pack32_ssse3(v));
+	}
+	return j + decode32_scalar(in + 8 * j, out + 5 * j, n - j, c);
+}
+
+/* Every 16 bit lane gets the two bytes its 5 bits are in, big endian,
+ * and a multiply high shifts them down by a different amount per lane.
+ */
+__attribute__((target("ssse3"))) static ALWAYS_INLINE __m128i
+quintet_indices_ssse3(__m128i in)
+{
+	const __m128i spread0 = _mm_setr_epi8(1, 0, 1, 0, 2, 1, 2, 1, 3, 2, 4,
+					      3, 4, 3, -1, 4);
+	const __m128i spread1 = _mm_setr_epi8(6, 5, 6, 5, 7, 6, 7, 6, 8, 7, 9,
+					      8, 9, 8, -1, 9);
+	const __m128i shift = _mm_setr_epi16(1 << 5, 1 << 10, 1 << 7, 1 << 12,
+					     1 << 9, 1 << 6, 1 << 11, 1 << 8);
+	const __m128i mask = _mm_set1_epi16(31);
+	__m128i a = _mm_mulhi_epu16(_mm_shuffle_epi8(in, spread0), shift);
+	__m128i b = _mm_mulhi_epu16(_mm_shuffle_epi8(in, spread1), shift);
+
+	return _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+}
+
+__attribute__((target("ssse3"))) static ALWAYS_INLINE __m128i
+ascii32_ssse3(__m128i idx)
+{
+	__m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+	__m128i off = _mm_or_si128(_mm_and_si128(less, _mm_set1_epi8('A')),
+				   _mm_andnot_si128(less, _mm_set1_epi8('2' - 26)));
+
+	return _mm_add_epi8(idx, off);
+}
+
+__attribute__((target("ssse3"))) static ALWAYS_INLINE void
+encode32_128(const char *in, char *out, size_t n, const struct codec *c)
+{
+	size_t j = 0;
+
+	for (; j + 4 <= n; j += 2) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(in + 5 * j));
+
+		x = ascii32_ssse3(quintet_indices_ssse3(x));
+		_mm_storeu_si128((__m128i *)(out + 8 * j), x);
+	}
+	encode32_scalar(in + 5 * j, out + 8 * j, n - j, c);
+}
+
+__attribute__((target("ssse3"))) static size_t
+decode64_ssse3(const char *in, char *out, size_t n, const struct codec *c)
+{
+	return decode64_128(in, out, n, c);
+}
+
+__attribute__((target("ssse3"))) static void
+encode64_ssse3(const char *in, char *out, size_t n, const struct codec *c)
+{
+	encode64_128(in, out, n, c);
+}
+
+__attribute__((target("ssse3"))) static size_t
+decode32_ssse3(const char *in, char *out, size_t n, const struct codec *c)
+{
+	return decode32_128(in, out, n, c);
+}
+
+__attribute__((target("ssse3"))) static void
+encode32_ssse3(const char *in, char *out, size_t n, const struct codec *c)
+{
+	encode32_128(in, out, n, c);
+}
+
+/* The AVX2 versions do the same in both 128 bit lanes */
+__attribute__((target("avx2"))) static inline bool
+sextets_avx2(__m256i c, __m256i c62, __m256i c63, __m256i *val)
+{
+	__m256i u = _mm256_sub_epi8(c, _mm256_set1_epi8('A'));
+	__m256i l = _mm256_sub_epi8(c, _mm256_set1_epi8('a'));
+	__m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+	__m256i is_u =
+		_mm256_cmpeq_epi8(_mm256_min_epu8(u, _mm256_set1_epi8(25)), u);
+	__m256i is_l =
+		_mm256_cmpeq_epi8(_mm256_min_epu8(l, _mm256_set1_epi8(25)), l);
+	__m256i is_d =
+		_mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+	__m256i is_62 = _mm256_cmpeq_epi8(c, c62);
+	__m256i is_63 = _mm256_cmpeq_epi8(c, c63);
+	__m256i ok = _mm256_or_si256(
+		_mm256_or_si256(is_u, is_l),
+		_mm256_or_si256(is_d, _mm256_or_si256(is_62, is_63)));
+
+	l = _mm256_add_epi8(l, _mm256_set1_epi8(26));
+	d = _mm256_add_epi8(d, _mm256_set1_epi8(52));
+	*val = _mm256_or_si256(
+		_mm256_or_si256(_mm256_and_si256(is_u, u),
+				_mm256_and_si256(is_l, l)),
+		_mm256_or_si256(
+			_mm256_and_si256(is_d, d),
+			_mm256_or_si256(
+				_mm256_and_si256(is_62, _mm256_set1_epi8(62)),
+				_mm256_and_si256(is_63, _mm256_set1_epi8(63)))));
+	return _mm256_movemask_epi8(ok) == -1;
+}
+
+/* 24 bytes per 32 byte store: the permute moves the 12 bytes of the high
+ * lane next to those of the low one.
+ */
+__attribute__((target("avx2"))) static size_t
+decode64_avx2(const char *in, char *out, size_t n, const struct codec *c)
+{
+	const __m256i c62 = _mm256_set1_epi8(c->alphabet[62]);
+	const __m256i c63 = _mm256_set1_epi8(c->alphabet[63]);
+	const __m256i shuffle = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0,
+		6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	size_t j = 0;
+
+	for (; j + 11 <= n; j += 8) {
+		__m256i v;
+
+		if (!sextets_avx2(
+			    _mm256_loadu_si256((const __m256i *)(in + 4 * j)),
+			    c62, c63, &v))
+			break;
+		v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+		v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+		v = _mm256_shuffle_epi8(v, shuffle);
+		v = _mm256_permutevar8x32_epi32(
+			v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+		_mm256_storeu_si256((__m256i *)(out + 3 * j), v);
+	}
+	return j + decode64_128(in + 4 * j, out + 3 * j, n - j, c);
+}
+
+/* Two 12 byte groups of input, one per lane */
+__attribute__((target("avx2"))) static void
+encode64_avx2(const char *in, char *out, size_t n, const struct codec *c)
+{
+	const __m256i offsets =
+		_mm256_broadcastsi128_si256(offsets64_ssse3(c));
+	size_t j = 0;
+
+	for (; j + 10 <= n; j += 8) {
+		const char *p = in + 3 * j;
+		__m256i x = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(
+				_mm_loadu_si128((const __m128i *)p)),
+			_mm_loadu_si128((const __m128i *)(p + 12)), 1);
+		__m256i t0, t1, r, less;
+
+		x = _mm256_shuffle_epi8(
+			x, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7,
+					    10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5,
+					    4, 7, 6, 8, 7, 10, 9, 11, 10));
+		t0 = _mm256_and_si256(x, _mm256_set1_epi32(0x0fc0fc00));
+		t0 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+		t1 = _mm256_and_si256(x, _mm256_set1_epi32(0x003f03f0));
+		t1 = _mm256_mullo_epi16(t1, _mm256_set1_epi32(0x01000010));
+		x = _mm256_or_si256(t0, t1);
+
+		r = _mm256_subs_epu8(x, _mm256_set1_epi8(51));
+		less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), x);
+		r = _mm256_or_si256(r,
+				    _mm256_and_si256(less, _mm256_set1_epi8(13)));
+		x = _mm256_add_epi8(_mm256_shuffle_epi8(offsets, r), x);
+		_mm256_storeu_si256((__m256i *)(out + 4 * j), x);
+	}
+	encode64_128(in + 3 * j, out + 4 * j, n - j, c);
+}
+
+/* Four groups in 32 chars, 10 bytes out of each lane */
+__attribute__((target("avx2"))) static size_t
+decode32_avx2(const char *in, char *out, size_t n, const struct codec *c)
+{
+	const __m256i shuffle = _mm256_setr_epi8(
+		4, 3, 2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1, 4, 3,
+		2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1);
+	size_t j = 0;
+
+	for (; j + 6 <= n; j += 4) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(in + 8 * j));
+		__m256i u = _mm256_sub_epi8(x, _mm256_set1_epi8('A'));
+		__m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8('2'));
+		__m256i is_u = _mm256_cmpeq_epi8(
+			_mm256_min_epu8(u, _mm256_set1_epi8(25)), u);
+		__m256i is_d = _mm256_cmpeq_epi8(
+			_mm256_min_epu8(d, _mm256_set1_epi8(5)), d);
+		char *o = out + 5 * j;
+
+		if (_mm256_movemask_epi8(_mm256_or_si256(is_u, is_d)) != -1)
+			break;
+		d = _mm256_add_epi8(d, _mm256_set1_epi8(26));
+		x = _mm256_or_si256(_mm256_and_si256(is_u, u),
+				    _mm256_and_si256(is_d, d));
+		x = _mm256_maddubs_epi16(x, _mm256_set1_epi16(0x0120));
+		x = _mm256_madd_epi16(x, _mm256_set1_epi32(0x00010400));
+		x = _mm256_or_si256(_mm256_slli_epi64(x, 20),
+				    _mm256_srli_epi64(x, 32));
+		x = _mm256_shuffle_epi8(x, shuffle);
+		_mm_storeu_si128((__m128i *)o, _mm256_castsi256_si128(x));
+		_mm_storeu_si128((__m128i *)(o + 10),
+				 _mm256_extracti128_si256(x, 1));
+	}
+	return j + decode32_128(in + 8 * j, out + 5 * j, n - j, c);
+}
+
+__attribute__((target("avx2"))) static void
+encode32_avx2(const char *in, char *out, size_t n, const struct codec *c)
+{
+	const __m256i spread0 = _mm256_setr_epi8(
+		1, 0, 1, 0, 2, 1, 2, 1, 3, 2, 4, 3, 4, 3, -1, 4, 1, 0, 1, 0, 2,
+		1, 2, 1, 3, 2, 4, 3, 4, 3, -1, 4);
+	const __m256i spread1 = _mm256_add_epi8(spread0, _mm256_set1_epi8(5));
+	const __m256i shift = _mm256_setr_epi16(
+		1 << 5, 1 << 10, 1 << 7, 1 << 12, 1 << 9, 1 << 6, 1 << 11,
+		1 << 8, 1 << 5, 1 << 10, 1 << 7, 1 << 12, 1 << 9, 1 << 6,
+		1 << 11, 1 << 8);
+	const __m256i mask = _mm256_set1_epi16(31);
+	size_t j = 0;
+
+	for (; j + 6 <= n; j += 4) {
+		const char *p = in + 5 * j;
+		__m256i x = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(
+				_mm_loadu_si128((const __m128i *)p)),
+			_mm_loadu_si128((const __m128i *)(p + 10)), 1);
+		__m256i a = _mm256_mulhi_epu16(_mm256_shuffle_epi8(x, spread0),
+					       shift);
+		__m256i b = _mm256_mulhi_epu16(_mm256_shuffle_epi8(x, spread1),
+					       shift);
+		__m256i less, off;
+
+		x = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+					_mm256_and_si256(b, mask));
+		less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), x);
+		off = _mm256_or_si256(
+			_mm256_and_si256(less, _mm256_set1_epi8('A')),
+			_mm256_andnot_si256(less, _mm256_set1_epi8('2' - 26)));
+		_mm256_storeu_si256((__m256i *)(out + 8 * j),
+				    _mm256_add_epi8(x, off));
+	}
+	encode32_128(in + 5 * j, out + 8 * j, n - j, c);
+}
+#endif
+
+static void select_kernels(struct codec *c)
+{
+	bool b64 = c->chars == 4;
+
+	c->decode = b64 ? decode64_scalar : decode32_scalar;
+	c->encode = b64 ? encode64_scalar : encode32_scalar;
+#ifdef HAVE_X86_SIMD
+	if (__builtin_cpu_supports("avx2")) {
+		c->decode = b64 ? decode64_avx2 : decode32_avx2;
+		c->encode = b64 ? encode64_avx2 : encode32_avx2;
+	} else if (__builtin_cpu_supports("ssse3")) {
+		c->decode = b64 ? decode64_ssse3 : decode32_ssse3;
+		c->encode = b64 ? encode64_ssse3 : encode32_ssse3;
+	}
+#endif
+}
+
+/* Before main(), as the hex codec's kernels, so that threads using a
+ * codec for the first time don't race to set it up
+ */
+__attribute__((constructor)) static void init_codecs(void)
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+#endif
+	for (size_t k = 0; k < sizeof(codecs) / sizeof(codecs[0]); k++) {
+		struct codec *c = &codecs[k];
+
+		memset(c->value, -1, sizeof(c->value));
+		for (int i = 0; c->alphabet[i]; i++)
+			c->value[(unsigned char)c->alphabet[i]] = i;
+		select_kernels(c);
+	}
+}
+
+static const struct codec *get_codec(int codec)
+{
+	if (codec < 0 || codec >= (int)(sizeof(codecs) / sizeof(codecs[0])))
+		return NULL;
+	return &codecs[codec];
+}
+
+size_t basenc_encoded_len(int codec, size_t len)
+{
+	const struct codec *c = get_codec(codec);
+
+	return c ? (len + c->bytes - 1) / c->bytes * c->chars : 0;
+}
+
+size_t basenc_decoded_max(int codec, size_t len)
+{
+	const struct codec *c = get_codec(codec);
+
+	return c ? (len + c->chars - 1) / c->chars * c->bytes : 0;
+}
+
+/* Bytes in a last group of m chars, -1 if no group can end there */
+static int partial_bytes(const struct codec *c, int m)
+{
+	int n = m * c->bits / 8;
+
+	return (n * 8 + c->bits - 1) / c->bits == m ? n : -1;
+}
+
+/* Decodes the m < chars chars of an unpadded last group */
+static int decode_partial(const struct codec *c, const char *in, int m,
+			  char *out)
+{
+	char group[8], bytes[5];
+	int n = partial_bytes(c, m);
+
+	if (n <= 0)
+		return -1;
+	memcpy(group, in, m);
+	memset(group + m, c->alphabet[0], c->chars - m);
+	if (c->decode(group, bytes, 1, c) != 1)
+		return -1;
+	memcpy(out, bytes, n);
+	return n;
+}
+
+size_t encode_basenc(int codec, const char *bin, size_t len, char *out)
+{
+	const struct codec *c = get_codec(codec);
+	size_t n, rest;
+
+	if (!c)
+		return 0;
+	n = len / c->bytes;
+	rest = len % c->bytes;
+	c->encode(bin, out, n, c);
+	out += n * c->chars;
+	if (rest) {
+		char group[5] = { 0 };
+		int m = (rest * 8 + c->bits - 1) / c->bits;
+
+		memcpy(group, bin + n * c->bytes, rest);
+		c->encode(group, out, 1, c);
+		memset(out + m, '=', c->chars - m);
+		n++;
+	}
+	return n * c->chars;
+}
+
+size_t decode_basenc_to_binary(int codec, const char *text, size_t len,
+			       char *bin, size_t binlen, int *error)
+{
+	const struct codec *c = get_codec(codec);
+	size_t n, k, out, rest;
+
+	*error = -1;
+	if (!c)
+		return 0;
+	while (len > 0 && text[len - 1] == '=')
+		len--;
+	n = len / c->chars;
+	if (n > binlen / c->bytes)
+		n = binlen / c->bytes;
+	k = c->decode(text, bin, n, c);
+	out = k * c->bytes;
+	rest = len - k * c->chars;
+	if (k == n && rest > 0 && out < binlen) {
+		/* A last group, or one that fits only in part */
+		char bytes[5];
+		int m = rest < (size_t)c->chars ? rest : (size_t)c->chars;
+		int b = m == c->chars ?
+				(c->decode(text + k * c->chars, bytes, 1, c) ?
+					 c->bytes :
+					 -1) :
+				decode_partial(c, text + k * c->chars, m, bytes);
+
+		if (b < 0)
+			goto invalid;
+		if ((size_t)b > binlen - out)
+			b = binlen - out;
+		memcpy(bin + out, bytes, b);
+		out += b;
+	} else if (k < n) {
+		goto invalid;
+	}
+	*error = 0;
+	return out;
+
+invalid:
+	for (size_t i = k * c->chars; i < len; i++) {
+		if (c->value[(unsigned char)text[i]] < 0) {
+			fprintf(stderr,
+				"Invalid %s string. offending char = '%c'\n",
+				c->name, text[i]);
+			return out;
+		}
+	}
+	fprintf(stderr, "Invalid %s string. truncated at %zu chars\n",
+		c->name, len);
+	return out;
+}
+
+void basenc_stream_init(struct basenc_stream *s, int codec)
+{
+	memset(s, 0, sizeof(*s));
+	s->codec = codec;
+}
+
+static inline bool is_space(char c)
+{
+	return c == '\n' || c == '\r' || c == ' ' || c == '\t';
+}
+
+/* Like hex_stream_decode(): the whole groups of each line go to the
+ * kernel, which stops at the first group with anything but the alphabet
+ * in it. The chars from there on are taken one at a time.
+ */
+size_t basenc_stream_decode(struct basenc_stream *s, const char *text,
+			    size_t len, char *bin, int *error)
+{
+	const struct codec *c = get_codec(s->codec);
+	const char *p = text, *end = text + len;
+	char *out = bin;
+
+	*error = 0;
+	if (!c) {
+		*error = -1;
+		return 0;
+	}
+	while (p < end) {
+		if (s->npending == 0 && !s->padded && end - p >= c->chars) {
+			const char *eol = memchr(p, '\n', end - p);
+			size_t n = ((eol ? eol : end) - p) / c->chars;
+			size_t k = c->decode(p, out, n, c);
+
+			p += k * c->chars;
+			out += k * c->bytes;
+			if (p == end)
+				break;
+		}
+		if (is_space(*p)) {
+			p++;
+			continue;
+		}
+		if (*p == '=' && !s->padded) {
+			int n = decode_partial(c, s->pending, s->npending, out);
+
+			if (n < 0) {
+				*error = -1;
+				break;
+			}
+			out += n;
+			s->npending = 0;
+			s->padded = 1;
+		} else if (*p != '=' &&
+			   (s->padded || c->value[(unsigned char)*p] < 0)) {
+			*error = -1;
+			break;
+		} else if (*p != '=') {
+			s->pending[s->npending++] = *p;
+			if (s->npending == c->chars) {
+				c->decode(s->pending, out, 1, c);
+				out += c->bytes;
+				s->npending = 0;
+			}
+		}
+		p++;
+	}
+	s->offset += p - text;
+	return out - bin;
+}
+
+int basenc_stream_finish(struct basenc_stream *s, char *bin)
+{
+	const struct codec *c = get_codec(s->codec);
+	int n;
+
+	if (!c)
+		return -1;
+	if (s->npending == 0)
+		return 0;
+	n = decode_partial(c, s->pending, s->npending, bin);
+	s->npending = 0;
+	return n;
+}
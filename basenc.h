@@ -0,0 +1,57 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Base64 (RFC 4648 section 4), its URL and file name safe variant
+ * (section 5) and base32 (section 6). Encoding always pads with '='.
+ * Decoding takes input with or without the padding.
+ */
+enum basenc {
+	BASE64,
+	BASE64URL,
+	BASE32,
+};
+
+/* Chars that encode_basenc() writes for `len` bytes */
+size_t basenc_encoded_len(int codec, size_t len);
+/* Most bytes that `len` chars can decode to */
+size_t basenc_decoded_max(int codec, size_t len);
+
+size_t encode_basenc(int codec, const char *bin, size_t len, char *out);
+/* Same contract as decode_hex_to_binary(): decodes at most `binlen`
+ * bytes and returns how many, *error is -1 on an invalid char.
+ */
+size_t decode_basenc_to_binary(int codec, const char *text, size_t len,
+			       char *bin, size_t binlen, int *error);
+
+/* Decoder for text fed in pieces of any size, like struct hex_stream.
+ * Whitespace is skipped. Once the padding has started only more '=' and
+ * whitespace may follow.
+ */
+struct basenc_stream {
+	uint64_t offset; /* chars consumed so far */
+	int codec;
+	int npending; /* chars of an unfinished group */
+	char pending[8];
+	int padded;
+};
+
+void basenc_stream_init(struct basenc_stream *s, int codec);
+/* Decodes `len` chars into `bin`, which must have room for
+ * basenc_decoded_max(codec, len) bytes. Returns the number of bytes
+ * written. On an invalid char *error is -1 and s->offset is its offset.
+ */
+size_t basenc_stream_decode(struct basenc_stream *s, const char *text,
+			    size_t len, char *bin, int *error);
+/* Decodes an unpadded last group into `bin`, which must have room for 4
+ * bytes. Returns the number of bytes written, or -1 if the stream ended
+ * in a place where no group can end.
+ */
+int basenc_stream_finish(struct basenc_stream *s, char *bin);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,73 @@
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+#include "heap.hh"
+
+static std::vector<int> random_ints(size_t n) {
+  std::mt19937 gen(42);
+  std::vector<int> v(n);
+  for (auto& x : v) x = gen();
+  return v;
+}
+
+static void BM_HeapPushN(benchmark::State& state) {
+  auto v = random_ints(state.range(0));
+  for (auto _ : state) {
+    heap::MinHeap<int> h;
+    for (int x : v) h.push(x);
+    benchmark::DoNotOptimize(h.top());
+  }
+  state.SetItemsProcessed(state.iterations() * v.size());
+}
+BENCHMARK(BM_HeapPushN)->Range(1 << 10, 1 << 22);
+
+static void BM_HeapRangeCtor(benchmark::State& state) {
+  auto v = random_ints(state.range(0));
+  for (auto _ : state) {
+    heap::MinHeap<int> h(v.begin(), v.end());
+    benchmark::DoNotOptimize(h.top());
+  }
+  state.SetItemsProcessed(state.iterations() * v.size());
+}
+BENCHMARK(BM_HeapRangeCtor)->Range(1 << 10, 1 << 22);
+
+static void BM_HeapMeld(benchmark::State& state) {
+  auto a = random_ints(state.range(0));
+  auto b = random_ints(state.range(1));
+  for (auto _ : state) {
+    state.PauseTiming();
+    heap::MinHeap<int> ha(a.begin(), a.end());
+    heap::MinHeap<int> hb(b.begin(), b.end());
+    state.ResumeTiming();
+    ha.meld(hb);
+    benchmark::DoNotOptimize(ha.top());
+  }
+}
+BENCHMARK(BM_HeapMeld)->Args({1 << 20, 16})->Args({1 << 20, 1 << 20});
+
+static void BM_HeapTopK(benchmark::State& state) {
+  auto v = random_ints(1 << 20);
+  heap::MaxHeap<int> h(v.begin(), v.end());
+  for (auto _ : state) benchmark::DoNotOptimize(h.top_k(state.range(0)));
+}
+BENCHMARK(BM_HeapTopK)->Range(16, 4096);
+
+// Baseline for top_k: copy the heap and pop k times.
+static void BM_HeapCopyPopK(benchmark::State& state) {
+  auto v = random_ints(1 << 20);
+  heap::MaxHeap<int> h(v.begin(), v.end());
+  for (auto _ : state) {
+    heap::MaxHeap<int> c = h;
+    std::vector<int> out;
+    for (int i = 0; i < state.range(0); i++) {
+      out.push_back(c.top());
+      c.pop();
+    }
+    benchmark::DoNotOptimize(out);
+  }
+}
+BENCHMARK(BM_HeapCopyPopK)->Range(16, 4096);
+
+BENCHMARK_MAIN();
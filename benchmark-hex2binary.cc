@@ -0,0 +1,166 @@
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "basenc.h"
+#include "hex2binary.h"
+#include "hexcodec.h"
+
+static std::string random_hex(size_t len) {
+  static const char digits[] = "0123456789abcdefABCDEF";
+  std::mt19937 rng(42);
+  std::string s(len, '0');
+  for (auto &c : s) c = digits[rng() % 22];
+  return s;
+}
+
+// The byte at a time loop decode_hex_to_binary used before the vector
+// kernels, as a baseline
+static inline unsigned char int_val(char hex) {
+  if ('0' <= hex && hex <= '9') return hex - '0';
+  if ('a' <= hex && hex <= 'f') return hex - 'a' + 10;
+  if ('A' <= hex && hex <= 'F') return hex - 'A' + 10;
+  return 0xff;
+}
+
+static size_t scalar_decode(const char *hex, size_t hexlen, char *bin) {
+  size_t j = 0;
+  for (size_t i = 0; i + 1 < hexlen; i += 2) {
+    unsigned char b1 = int_val(hex[i]);
+    unsigned char b2 = int_val(hex[i + 1]);
+    if (b1 == 0xff || b2 == 0xff) break;
+    bin[j++] = (b1 << 4) | b2;
+  }
+  return j;
+}
+
+static void BM_DecodeHex(benchmark::State &state) {
+  std::string hex = random_hex(state.range(0));
+  std::vector<char> bin(hex.size() / 2);
+  int error;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(decode_hex_to_binary(
+        hex.data(), hex.size(), bin.data(), bin.size(), &error));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * hex.size());
+}
+BENCHMARK(BM_DecodeHex)->Arg(64)->Arg(4 << 10)->Arg(1 << 20);
+
+static void BM_DecodeHexScalar(benchmark::State &state) {
+  std::string hex = random_hex(state.range(0));
+  std::vector<char> bin(hex.size() / 2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        scalar_decode(hex.data(), hex.size(), bin.data()));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * hex.size());
+}
+BENCHMARK(BM_DecodeHexScalar)->Arg(64)->Arg(4 << 10)->Arg(1 << 20);
+
+// "de:ad:be:ef" lines of 16 bytes through the tolerant stream, which
+// strips the separators before decoding. Bytes are counted as the digits
+// alone, to compare with BM_DecodeHex.
+static void BM_DecodeHexTolerant(benchmark::State &state) {
+  std::string digits = random_hex(state.range(0));
+  std::string text;
+  for (size_t i = 0; i < digits.size(); i += 2) {
+    text += digits.substr(i, 2);
+    text += i % 32 == 30 ? '\n' : ':';
+  }
+  std::vector<char> bin(text.size() / 2 + 1);
+  int error;
+  for (auto _ : state) {
+    struct hex_stream hs;
+    hex_stream_init(&hs);
+    hs.mode = HEX_TOLERANT;
+    benchmark::DoNotOptimize(hex_stream_decode(&hs, text.data(), text.size(),
+                                               bin.data(), &error));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * digits.size());
+}
+BENCHMARK(BM_DecodeHexTolerant)->Arg(64)->Arg(4 << 10)->Arg(1 << 20);
+
+// "de ad be ef" on one line with no newline, as some tools print a whole
+// file. The strict decoder looks for the end of the line once, not once
+// per pair.
+static void BM_DecodeHexSeparated(benchmark::State &state) {
+  std::string digits = random_hex(state.range(0));
+  std::string text;
+  for (size_t i = 0; i < digits.size(); i += 2) {
+    text += digits.substr(i, 2);
+    text += ' ';
+  }
+  std::vector<char> bin(text.size() / 2 + 1);
+  int error;
+  for (auto _ : state) {
+    struct hex_stream hs;
+    hex_stream_init(&hs);
+    benchmark::DoNotOptimize(hex_stream_decode(&hs, text.data(), text.size(),
+                                               bin.data(), &error));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * digits.size());
+}
+BENCHMARK(BM_DecodeHexSeparated)->Arg(64)->Arg(4 << 10)->Arg(1 << 20);
+
+// Bytes are counted on the text side for both directions
+static void BM_DecodeBasenc(benchmark::State &state, int codec) {
+  std::string bin = random_hex(state.range(0));
+  std::string text(basenc_encoded_len(codec, bin.size()), '\0');
+  encode_basenc(codec, bin.data(), bin.size(), text.data());
+  int error;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(decode_basenc_to_binary(
+        codec, text.data(), text.size(), bin.data(), bin.size(), &error));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK_CAPTURE(BM_DecodeBasenc, base64, BASE64)->Arg(48)->Arg(3 << 10)
+    ->Arg(3 << 18);
+BENCHMARK_CAPTURE(BM_DecodeBasenc, base32, BASE32)->Arg(48)->Arg(3 << 10)
+    ->Arg(3 << 18);
+
+static void BM_EncodeBasenc(benchmark::State &state, int codec) {
+  std::string bin = random_hex(state.range(0));
+  std::string text(basenc_encoded_len(codec, bin.size()), '\0');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        encode_basenc(codec, bin.data(), bin.size(), text.data()));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK_CAPTURE(BM_EncodeBasenc, base64, BASE64)->Arg(48)->Arg(3 << 10)
+    ->Arg(3 << 18);
+BENCHMARK_CAPTURE(BM_EncodeBasenc, base32, BASE32)->Arg(48)->Arg(3 << 10)
+    ->Arg(3 << 18);
+
+// Plain digits, "de:ad:be:ef" and "dead beef" (the hex-dump and xxd
+// columns), counted on the text side too
+static void BM_EncodeHex(benchmark::State &state, char sep, size_t group) {
+  std::string bin = random_hex(state.range(0));
+  std::string text(hex_encoded_len(bin.size(), sep, group), '\0');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(hex_encode(text.data(), bin.data(), bin.size(),
+                                        HEX_LOWER, sep, group));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+  state.SetLabel(hexcodec_isa());
+}
+BENCHMARK_CAPTURE(BM_EncodeHex, plain, 0, 1)->Arg(16)->Arg(4 << 10)
+    ->Arg(1 << 20);
+BENCHMARK_CAPTURE(BM_EncodeHex, colons, ':', 1)->Arg(16)->Arg(4 << 10)
+    ->Arg(1 << 20);
+BENCHMARK_CAPTURE(BM_EncodeHex, pairs, ' ', 2)->Arg(16)->Arg(4 << 10)
+    ->Arg(1 << 20);
+BENCHMARK_CAPTURE(BM_EncodeHex, groups4, ' ', 4)->Arg(16)->Arg(4 << 10)
+    ->Arg(1 << 20);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,258 @@
+#include <benchmark/benchmark.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "properties-image.h"
+#include "properties-parser.h"
+#include "properties-reload.h"
+
+// A file of `lines` properties of about 60 bytes each, and the 300 keys a
+// service looks up at startup, spread evenly over it
+struct Fixture {
+  std::string path = "/tmp/benchmark-properties.properties";
+  std::vector<std::string> keys;
+  std::vector<const char *> key_ptrs;
+  struct parse_ctx pctx;
+
+  explicit Fixture(int lines) {
+    std::ofstream out(path);
+    for (int i = 0; i < lines; i++) {
+      if (i % 50 == 0) out << "## section " << i / 50 << '\n';
+      out << "service.component" << i % 97 << ".setting." << i << " = '"
+          << "value-" << i * 7919 << "'\n";
+    }
+    for (int i = 0; i < 300; i++) {
+      int line = (long)i * lines / 300;
+      keys.push_back("service.component" + std::to_string(line % 97) +
+                     ".setting." + std::to_string(line));
+    }
+    for (const auto &k : keys) key_ptrs.push_back(k.c_str());
+    init_parse_ctx(&pctx);
+  }
+  ~Fixture() { unlink(path.c_str()); }
+};
+
+// What startup does today: one scan of the file per key
+static void BM_ScanPerKey(benchmark::State &state) {
+  Fixture f(state.range(0));
+  char value[MAX_VALUE_SIZE];
+  for (auto _ : state) {
+    for (const auto &k : f.keys)
+      parse_key_value_from_file(f.path.c_str(), k.c_str(), value, &f.pctx);
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_ScanPerKey)->Arg(1000)->Arg(50000)->Unit(benchmark::kMillisecond);
+
+// One parse of the file, then all keys in a batch
+static void BM_StoreLoadGetMany(benchmark::State &state) {
+  Fixture f(state.range(0));
+  std::vector<const char *> values(f.keys.size());
+  for (auto _ : state) {
+    struct props_store s;
+    props_store_load(&s, f.path.c_str(), &f.pctx);
+    benchmark::DoNotOptimize(props_store_get_many(
+        &s, f.key_ptrs.data(), f.key_ptrs.size(), values.data()));
+    props_store_free(&s);
+  }
+}
+BENCHMARK(BM_StoreLoadGetMany)->Arg(1000)->Arg(50000)
+    ->Unit(benchmark::kMillisecond);
+
+// The same with the file mapped and indexed in place
+static void BM_StoreMapViewMany(benchmark::State &state) {
+  Fixture f(state.range(0));
+  std::vector<struct props_view> values(f.keys.size());
+  for (auto _ : state) {
+    struct props_store s;
+    props_store_map(&s, f.path.c_str(), &f.pctx);
+    benchmark::DoNotOptimize(props_store_view_many(
+        &s, f.key_ptrs.data(), f.key_ptrs.size(), values.data()));
+    props_store_free(&s);
+  }
+}
+BENCHMARK(BM_StoreMapViewMany)->Arg(1000)->Arg(50000)
+    ->Unit(benchmark::kMillisecond);
+
+// The lookups alone, one at a time and batched
+static void BM_StoreGet(benchmark::State &state) {
+  Fixture f(state.range(0));
+  struct props_store s;
+  props_store_load(&s, f.path.c_str(), &f.pctx);
+  for (auto _ : state)
+    for (const char *k : f.key_ptrs)
+      benchmark::DoNotOptimize(props_store_get(&s, k));
+  state.SetItemsProcessed(state.iterations() * f.keys.size());
+  props_store_free(&s);
+}
+BENCHMARK(BM_StoreGet)->Arg(1000)->Arg(50000);
+
+static void BM_StoreGetMany(benchmark::State &state) {
+  Fixture f(state.range(0));
+  std::vector<const char *> values(f.keys.size());
+  struct props_store s;
+  props_store_load(&s, f.path.c_str(), &f.pctx);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(props_store_get_many(
+        &s, f.key_ptrs.data(), f.key_ptrs.size(), values.data()));
+  state.SetItemsProcessed(state.iterations() * f.keys.size());
+  props_store_free(&s);
+}
+BENCHMARK(BM_StoreGetMany)->Arg(1000)->Arg(50000);
+
+// The file compiled ahead of time, see properties-compile
+static std::string compile(const Fixture &f) {
+  std::string image = f.path + ".img";
+  struct props_store s;
+  props_store_map(&s, f.path.c_str(), &f.pctx);
+  props_image_write(&s, image.c_str());
+  props_store_free(&s);
+  return image;
+}
+
+static void BM_ImageCompile(benchmark::State &state) {
+  Fixture f(state.range(0));
+  for (auto _ : state) unlink(compile(f).c_str());
+}
+BENCHMARK(BM_ImageCompile)->Arg(1000)->Arg(50000)
+    ->Unit(benchmark::kMillisecond);
+
+// Startup from the image: map it and look up every key, against
+// BM_ScanPerKey and BM_StoreLoadGetMany
+static void BM_ImageOpenGet(benchmark::State &state) {
+  Fixture f(state.range(0));
+  std::string image = compile(f);
+  for (auto _ : state) {
+    struct props_image img;
+    props_image_open(&img, image.c_str());
+    for (const char *k : f.key_ptrs)
+      benchmark::DoNotOptimize(props_image_get(&img, k));
+    props_image_close(&img);
+  }
+  unlink(image.c_str());
+}
+BENCHMARK(BM_ImageOpenGet)->Arg(1000)->Arg(50000)
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_ImageGet(benchmark::State &state) {
+  Fixture f(state.range(0));
+  std::string image = compile(f);
+  struct props_image img;
+  props_image_open(&img, image.c_str());
+  for (auto _ : state)
+    for (const char *k : f.key_ptrs)
+      benchmark::DoNotOptimize(props_image_get(&img, k));
+  state.SetItemsProcessed(state.iterations() * f.keys.size());
+  props_image_close(&img);
+  unlink(image.c_str());
+}
+BENCHMARK(BM_ImageGet)->Arg(1000)->Arg(50000);
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Percentiles of the lookups of one run, clock overhead included
+static void report_latency(benchmark::State &state,
+                           std::vector<uint64_t> &ns) {
+  if (ns.empty()) return;
+  std::sort(ns.begin(), ns.end());
+  state.counters["p50_ns"] = ns[ns.size() / 2];
+  state.counters["p99_ns"] = ns[ns.size() * 99 / 100];
+  state.counters["p999_ns"] = ns[ns.size() * 999 / 1000];
+  state.counters["max_ns"] = ns.back();
+}
+
+// One lookup per read of the current snapshot, with the file reloaded in
+// a loop by another thread (Arg 1) or never (Arg 0)
+static void BM_ReloadLookup(benchmark::State &state) {
+  Fixture f(1000);
+  struct props_reloader *r = props_reloader_open(f.path.c_str(), &f.pctx);
+  struct props_reader rd;
+  props_reader_register(r, &rd);
+  std::atomic<bool> stop{false};
+  std::thread writer;
+  if (state.range(0))
+    writer = std::thread([&] {
+      while (!stop) props_reload(r);
+    });
+
+  std::vector<uint64_t> ns;
+  ns.reserve(1 << 20);
+  size_t i = 0;
+  for (auto _ : state) {
+    uint64_t start = now_ns();
+    const struct props_snapshot *snap = props_read_begin(&rd);
+    benchmark::DoNotOptimize(
+        props_store_get(&snap->store, f.key_ptrs[i++ % f.key_ptrs.size()]));
+    props_read_end(&rd);
+    if (ns.size() < ns.capacity()) ns.push_back(now_ns() - start);
+  }
+
+  stop = true;
+  if (writer.joinable()) writer.join();
+  uint64_t reloads, errors;
+  props_reload_stats(r, &reloads, &errors);
+  state.counters["reloads"] = reloads;
+  report_latency(state, ns);
+  props_reader_unregister(&rd);
+  props_reloader_close(r);
+}
+BENCHMARK(BM_ReloadLookup)->Arg(0)->Arg(1)->UseRealTime();
+
+// The same with a read-write lock around the store instead. The reload
+// parses outside the lock and only swaps and frees under it.
+static void BM_RwlockLookup(benchmark::State &state) {
+  Fixture f(1000);
+  pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+  struct props_store *store = new struct props_store;
+  props_store_load(store, f.path.c_str(), &f.pctx);
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> reloads{0};
+  std::thread writer;
+  if (state.range(0))
+    writer = std::thread([&] {
+      while (!stop) {
+        struct props_store *fresh = new struct props_store;
+        props_store_load(fresh, f.path.c_str(), &f.pctx);
+        pthread_rwlock_wrlock(&lock);
+        std::swap(store, fresh);
+        props_store_free(fresh);
+        pthread_rwlock_unlock(&lock);
+        delete fresh;
+        reloads++;
+      }
+    });
+
+  std::vector<uint64_t> ns;
+  ns.reserve(1 << 20);
+  size_t i = 0;
+  for (auto _ : state) {
+    uint64_t start = now_ns();
+    pthread_rwlock_rdlock(&lock);
+    benchmark::DoNotOptimize(
+        props_store_get(store, f.key_ptrs[i++ % f.key_ptrs.size()]));
+    pthread_rwlock_unlock(&lock);
+    if (ns.size() < ns.capacity()) ns.push_back(now_ns() - start);
+  }
+
+  stop = true;
+  if (writer.joinable()) writer.join();
+  state.counters["reloads"] = reloads.load();
+  report_latency(state, ns);
+  props_store_free(store);
+  delete store;
+}
+BENCHMARK(BM_RwlockLookup)->Arg(0)->Arg(1)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,60 @@
+#include <benchmark/benchmark.h>
+
+#include <deque>
+#include <random>
+#include <utility>
+
+#include "heap.hh"
+#include "timing-wheel.hh"
+
+// Connection churn: every tick a connection opens with a timeout of
+// 4 * live ticks. Once `live` connections are open, the oldest one closes
+// each tick; 95% of them cancel their timeout, the rest are left to expire.
+
+static void BM_ChurnTimingWheel(benchmark::State& state) {
+  const size_t live = state.range(0);
+  timing::TimingWheel<uint64_t> w;
+  std::deque<timing::TimingWheel<uint64_t>::handle> open;
+  std::mt19937 gen(1);
+  uint64_t id = 0;
+  size_t expired = 0;
+  for (auto _ : state) {
+    open.push_back(w.insert(w.now() + 4 * live, id++));
+    if (open.size() > live) {
+      if (gen() % 100 < 95)
+        w.cancel(open.front());
+      open.pop_front();
+    }
+    expired += w.advance(w.now() + 1, [](uint64_t, uint64_t) {});
+  }
+  state.counters["expired"] = expired;
+}
+BENCHMARK(BM_ChurnTimingWheel)->Range(1 << 10, 1 << 18);
+
+static void BM_ChurnMinHeap(benchmark::State& state) {
+  const size_t live = state.range(0);
+  heap::MinHeap<std::pair<uint64_t, uint64_t>> h;
+  std::deque<std::pair<uint64_t, uint64_t>> open;
+  std::mt19937 gen(1);
+  uint64_t id = 0, now = 0;
+  size_t expired = 0;
+  for (auto _ : state) {
+    auto timer = std::make_pair(now + 4 * live, id++);
+    h.push(timer);
+    open.push_back(timer);
+    if (open.size() > live) {
+      if (gen() % 100 < 95)
+        h.remove(open.front());
+      open.pop_front();
+    }
+    now++;
+    while (!h.empty() && h.top().first <= now) {
+      h.pop();
+      expired++;
+    }
+  }
+  state.counters["expired"] = expired;
+}
+BENCHMARK(BM_ChurnMinHeap)->Range(1 << 10, 1 << 14);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+// Growable byte buffer for streaming: data is appended at the back (either
+// copied in with append() or written in place after reserve() and then
+// commit()ed) and consumed from the front.
+//
+//   [0, begin)      consumed
+//   [begin, end)    data(), size()
+//   [end, capacity) room for writing, write_ptr(), writable()
+//
+// Capacity grows geometrically with realloc(), which can often extend the
+// block in place. Buffers of at least kHugeSize can be backed by
+// transparent huge pages instead, grown with mremap(). reset() forgets the
+// contents but keeps the memory, so a buffer reused for every block or
+// line stops allocating once it has grown to fit the largest one.
+
+namespace bytes {
+class ByteBuffer {
+ public:
+  static constexpr size_t kHugeSize = 2 << 20;
+
+  ByteBuffer() = default;
+  explicit ByteBuffer(size_t capacity, bool huge_pages = false)
+      : huge_ok(huge_pages) {
+    grow(capacity);
+  }
+  ~ByteBuffer() { release(); }
+
+  ByteBuffer(const ByteBuffer &b) : huge_ok(b.huge_ok) {
+    if (!b.empty()) append(b.data(), b.size());
+  }
+  ByteBuffer(ByteBuffer &&b) noexcept { swap(b); }
+  ByteBuffer &operator=(ByteBuffer b) noexcept {
+    swap(b);
+    return *this;
+  }
+
+  void swap(ByteBuffer &b) noexcept {
+    std::swap(buf, b.buf);
+    std::swap(cap, b.cap);
+    std::swap(begin, b.begin);
+    std::swap(end, b.end);
+    std::swap(huge, b.huge);
+    std::swap(huge_ok, b.huge_ok);
+  }
+
+  char *data() { return buf + begin; }
+  const char *data() const { return buf + begin; }
+  size_t size() const { return end - begin; }
+  bool empty() const { return begin == end; }
+  size_t capacity() const { return cap; }
+
+  char *write_ptr() { return buf + end; }
+  size_t writable() const { return cap - end; }
+
+  // Makes room for writing at least n more bytes. Consumed bytes are
+  // reclaimed first if that is enough and cheaper than growing.
+  void reserve(size_t n) {
+    if (writable() >= n) return;
+    if (begin > 0 && cap - size() >= n && size() <= begin) {
+      compact();
+      return;
+    }
+    compact();
+    size_t want = size() + n;
+    grow(want > 2 * cap ? want : 2 * cap);
+  }
+
+  // Marks n bytes written at write_ptr() as data
+  void commit(size_t n) { end += n; }
+
+  void append(const void *p, size_t n) {
+    reserve(n);
+    memcpy(write_ptr(), p, n);
+    commit(n);
+  }
+
+  void consume(size_t n) {
+    begin += n;
+    if (begin == end) begin = end = 0;
+  }
+
+  void reset() { begin = end = 0; }
+
+  // Moves the data to the front of the buffer
+  void compact() {
+    if (begin == 0) return;
+    memmove(buf, buf + begin, size());
+    end -= begin;
+    begin = 0;
+  }
+
+ private:
+  char *buf = nullptr;
+  size_t cap = 0;
+  size_t begin = 0;
+  size_t end = 0;
+  bool huge = false;     // buf is an mmap()ed region
+  bool huge_ok = false;  // big buffers may use huge pages
+
+  void grow(size_t n) {
+    if (n <= cap) return;
+    if (huge_ok && n >= kHugeSize) {
+      grow_huge(n);
+      return;
+    }
+    void *p = realloc(buf, n);
+    if (p == nullptr) throw std::bad_alloc();
+    buf = static_cast<char *>(p);
+    cap = n;
+  }
+
+  void grow_huge(size_t n) {
+    n = (n + kHugeSize - 1) & ~(kHugeSize - 1);
+    void *p;
+    if (huge) {
+      p = mremap(buf, cap, n, MREMAP_MAYMOVE);
+    } else {
+      p = mmap(nullptr, n, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p != MAP_FAILED && end > 0) memcpy(p, buf, end);
+    }
+    if (p == MAP_FAILED) throw std::bad_alloc();
+    madvise(p, n, MADV_HUGEPAGE);
+    if (!huge) free(buf);
+    buf = static_cast<char *>(p);
+    cap = n;
+    huge = true;
+  }
+
+  void release() {
+    if (huge)
+      munmap(buf, cap);
+    else
+      free(buf);
+    buf = nullptr;
+    cap = begin = end = 0;
+    huge = false;
+  }
+};
+}  // namespace bytes
@@ -0,0 +1,253 @@
+#include "byte-search.h"
+#include "hex2binary.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+/* Parses a pattern like "de ad ?? ef" or "7f454c46". Every '?' is a
+ * wildcard nibble, whitespace is ignored. The value and the mask are
+ * both decoded as plain hex strings.
+ */
+int byte_pattern_parse(struct byte_pattern *p, const char *hex)
+{
+	size_t n = strlen(hex);
+	char *vhex = malloc(n + 1);
+	char *mhex = malloc(n + 1);
+	size_t len = 0;
+	int error = -1;
+
+	memset(p, 0, sizeof(*p));
+	if (!vhex || !mhex)
+		goto out;
+	if (hex[0] == '0' && (hex[1] == 'x' || hex[1] == 'X'))
+		hex += 2;
+	for (; *hex; hex++) {
+		if (*hex == ' ' || *hex == '\t')
+			continue;
+		vhex[len] = *hex == '?' ? '0' : *hex;
+		mhex[len] = *hex == '?' ? '0' : 'f';
+		len++;
+	}
+	if (len == 0 || len % 2 != 0)
+		goto out;
+
+	p->len = len / 2;
+	p->val = malloc(p->len);
+	p->mask = malloc(p->len);
+	if (!p->val || !p->mask)
+		goto out;
+	decode_hex_to_binary(vhex, len, (char *)p->val, p->len, &error);
+	if (error == 0)
+		decode_hex_to_binary(mhex, len, (char *)p->mask, p->len,
+				     &error);
+	if (error != 0)
+		goto out;
+
+	p->exact = 1;
+	p->first = p->len;
+	for (size_t i = 0; i < p->len; i++) {
+		if (p->mask[i] != 0xff)
+			p->exact = 0;
+		if (p->mask[i] == 0)
+			continue;
+		if (p->first == p->len)
+			p->first = i;
+		p->last = i;
+	}
+	if (p->first == p->len)
+		p->first = 0; /* nothing but wildcards */
+out:
+	free(vhex);
+	free(mhex);
+	if (error != 0)
+		byte_pattern_free(p);
+	return error;
+}
+
+void byte_pattern_free(struct byte_pattern *p)
+{
+	free(p->val);
+	free(p->mask);
+	memset(p, 0, sizeof(*p));
+}
+
+static inline bool match_at(const struct byte_pattern *p, const uint8_t *s)
+{
+	if (p->exact)
+		return memcmp(s, p->val, p->len) == 0;
+	for (size_t i = 0; i < p->len; i++)
+		if ((s[i] & p->mask[i]) != p->val[i])
+			return false;
+	return true;
+}
+
+/* The searches look for a match starting at one of the first `n`
+ * positions of `buf`. Each of them has the whole pattern in the buffer.
+ */
+static const uint8_t *search_scalar(const struct byte_pattern *p,
+				    const uint8_t *buf, size_t n)
+{
+	uint8_t v0 = p->val[p->first], m0 = p->mask[p->first];
+	uint8_t v1 = p->val[p->last], m1 = p->mask[p->last];
+
+	for (size_t i = 0; i < n; i++)
+		if ((buf[i + p->first] & m0) == v0 &&
+		    (buf[i + p->last] & m1) == v1 && match_at(p, buf + i))
+			return buf + i;
+	return NULL;
+}
+
+#ifdef HAVE_X86_SIMD
+/* Candidates are the positions where both the first and the last
+ * significant byte of the pattern match, 16 or 32 of them at a time.
+ * Only those are compared in full.
+ */
+#define DEFINE_SEARCH_FN(name, isa, vec, width, set1, loadu, and, cmpeq,     \
+			 movemask)                                            \
+	__attribute__((target(isa))) static const uint8_t *name(              \
+		const struct byte_pattern *p, const uint8_t *buf, size_t n)   \
+	{                                                                     \
+		const vec v0 = set1(p->val[p->first]);                        \
+		const vec m0 = set1(p->mask[p->first]);                       \
+		const vec v1 = set1(p->val[p->last]);                         \
+		const vec m1 = set1(p->mask[p->last]);                        \
+		const uint8_t *a = buf + p->first, *b = buf + p->last;       \
+		size_t i = 0;                                                 \
+                                                                              \
+		for (; i + width <= n; i += width) {                          \
+			vec x = and(loadu((const vec *)(a + i)), m0);         \
+			vec y = and(loadu((const vec *)(b + i)), m1);         \
+			uint32_t bits = movemask(                             \
+				and(cmpeq(x, v0), cmpeq(y, v1)));             \
+                                                                              \
+			for (; bits; bits &= bits - 1) {                      \
+				const uint8_t *s = buf + i +                  \
+						   __builtin_ctz(bits);       \
+				if (match_at(p, s))                           \
+					return s;                             \
+			}                                                     \
+		}                                                             \
+		return search_scalar(p, buf + i, n - i);                      \
+	}
+
+DEFINE_SEARCH_FN(search_sse2, "sse2", __m128i, 16, _mm_set1_epi8,
+		 _mm_loadu_si128, _mm_and_si128, _mm_cmpeq_epi8,
+		 _mm_movemask_epi8)
+DEFINE_SEARCH_FN(search_avx2, "avx2", __m256i, 32, _mm256_set1_epi8,
+		 _mm256_loadu_si256, _mm256_and_si256, _mm256_cmpeq_epi8,
+		 _mm256_movemask_epi8)
+#endif
+
+typedef const uint8_t *(*search_fn)(const struct byte_pattern *p,
+				    const uint8_t *buf, size_t n);
+
+/* Picked before main(), so that the -j workers only ever read it */
+static search_fn search = search_scalar;
+
+__attribute__((constructor)) static void select_search(void)
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		search = search_avx2;
+	else
+		search = search_sse2;
+#endif
+}
+
+/* First match that lies entirely in [buf, buf + len), or NULL */
+const uint8_t *byte_search(const struct byte_pattern *p, const uint8_t *buf,
+			   size_t len)
+{
+	if (len < p->len)
+		return NULL;
+	return search(p, buf, len - p->len + 1);
+}
+
+static size_t mismatch_scalar(const uint8_t *a, const uint8_t *b, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		uint64_t x, y;
+
+		memcpy(&x, a + i, 8);
+		memcpy(&y, b + i, 8);
+		if (x != y)
+			break;
+	}
+	while (i < n && a[i] == b[i])
+		i++;
+	return i;
+}
+
+#ifdef HAVE_X86_SIMD
+/* Compares 4 vectors per iteration and only looks at the movemask once
+ * they are known to differ.
+ */
+#define DEFINE_MISMATCH_FN(name, isa, vec, width, loadu, and, cmpeq,         \
+			   movemask, all)                                     \
+	__attribute__((target(isa))) static size_t name(const uint8_t *a,     \
+							const uint8_t *b,     \
+							size_t n)             \
+	{                                                                     \
+		size_t i = 0;                                                 \
+                                                                              \
+		for (; i + 4 * width <= n; i += 4 * width) {                  \
+			vec e0 = cmpeq(loadu((const vec *)(a + i)),           \
+				       loadu((const vec *)(b + i)));          \
+			vec e1 = cmpeq(loadu((const vec *)(a + i + width)),   \
+				       loadu((const vec *)(b + i + width)));  \
+			vec e2 = cmpeq(                                       \
+				loadu((const vec *)(a + i + 2 * width)),      \
+				loadu((const vec *)(b + i + 2 * width)));     \
+			vec e3 = cmpeq(                                       \
+				loadu((const vec *)(a + i + 3 * width)),      \
+				loadu((const vec *)(b + i + 3 * width)));     \
+			if ((uint32_t)movemask(and(and(e0, e1), and(e2, e3))) \
+			    != all)                                           \
+				break;                                        \
+		}                                                             \
+		for (; i + width <= n; i += width) {                          \
+			vec x = loadu((const vec *)(a + i));                  \
+			vec y = loadu((const vec *)(b + i));                  \
+			uint32_t eq = movemask(cmpeq(x, y));                  \
+			if (eq != all)                                        \
+				return i + __builtin_ctz(~eq);                \
+		}                                                             \
+		return i + mismatch_scalar(a + i, b + i, n - i);              \
+	}
+
+DEFINE_MISMATCH_FN(mismatch_sse2, "sse2", __m128i, 16, _mm_loadu_si128,
+		   _mm_and_si128, _mm_cmpeq_epi8, _mm_movemask_epi8, 0xffffu)
+DEFINE_MISMATCH_FN(mismatch_avx2, "avx2", __m256i, 32, _mm256_loadu_si256,
+		   _mm256_and_si256, _mm256_cmpeq_epi8, _mm256_movemask_epi8,
+		   0xffffffffu)
+#endif
+
+typedef size_t (*mismatch_fn)(const uint8_t *a, const uint8_t *b, size_t n);
+
+static mismatch_fn mismatch = mismatch_scalar;
+
+__attribute__((constructor)) static void select_mismatch(void)
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		mismatch = mismatch_avx2;
+	else
+		mismatch = mismatch_sse2;
+#endif
+}
+
+/* Index of the first byte where `a` and `b` differ, or `n` */
+size_t byte_mismatch(const uint8_t *a, const uint8_t *b, size_t n)
+{
+	return mismatch(a, b, n);
+}
@@ -0,0 +1,28 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A byte pattern where any nibble may be a wildcard: input byte b at
+ * position i matches if (b & mask[i]) == val[i].
+ */
+struct byte_pattern {
+	uint8_t *val;
+	uint8_t *mask;
+	size_t len;
+	size_t first; /* first and last byte that isn't all wildcard */
+	size_t last;
+	int exact; /* no wildcards at all */
+};
+
+int byte_pattern_parse(struct byte_pattern *p, const char *hex);
+void byte_pattern_free(struct byte_pattern *p);
+const uint8_t *byte_search(const struct byte_pattern *p, const uint8_t *buf,
+			   size_t len);
+size_t byte_mismatch(const uint8_t *a, const uint8_t *b, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,326 @@
+#include "byte-stats.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+void byte_stats_init(struct byte_stats *s, uint64_t block_size)
+{
+	memset(s, 0, sizeof(*s));
+	s->block_size = block_size;
+}
+
+void byte_stats_free(struct byte_stats *s)
+{
+	free(s->entropy);
+	s->entropy = NULL;
+	s->nentropy = s->entropy_cap = 0;
+}
+
+double byte_entropy(const uint64_t hist[256], uint64_t total)
+{
+	double h = 0;
+
+	if (total == 0)
+		return 0;
+	for (int i = 0; i < 256; i++) {
+		if (hist[i]) {
+			double p = (double)hist[i] / total;
+			h -= p * log2(p);
+		}
+	}
+	return h;
+}
+
+static int push_entropy(struct byte_stats *s, double h)
+{
+	if (s->nentropy == s->entropy_cap) {
+		size_t cap = s->entropy_cap ? 2 * s->entropy_cap : 64;
+		double *p = realloc(s->entropy, cap * sizeof(*p));
+
+		if (!p)
+			return -1;
+		s->entropy = p;
+		s->entropy_cap = cap;
+	}
+	s->entropy[s->nentropy++] = h;
+	return 0;
+}
+
+/* Adds the counters of the current block to the histogram. Without
+ * blocks this only keeps the 32 bit counters from overflowing.
+ */
+static int flush_block(struct byte_stats *s)
+{
+	uint64_t hist[256];
+
+	for (int i = 0; i < 256; i++) {
+		hist[i] = (uint64_t)s->sub[0][i] + s->sub[1][i] + s->sub[2][i] +
+			  s->sub[3][i];
+		s->hist[i] += hist[i];
+	}
+	memset(s->sub, 0, sizeof(s->sub));
+	if (s->block_size && push_entropy(s, byte_entropy(hist, s->block_fill)))
+		return -1;
+	s->block_fill = 0;
+	return 0;
+}
+
+static inline uint64_t block_limit(const struct byte_stats *s)
+{
+	return s->block_size ? s->block_size : BYTE_STATS_MAX_BLOCK;
+}
+
+static inline void end_run(struct byte_stats *s)
+{
+	if (!s->seen_nonzero) {
+		s->lead = s->run;
+		s->seen_nonzero = true;
+	}
+	if (s->run > s->longest_run)
+		s->longest_run = s->run;
+	s->run = 0;
+}
+
+static void scan_zeros(struct byte_stats *s, const uint8_t *p, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		if (p[i] == 0) {
+			if (s->run++ == 0)
+				s->zero_runs++;
+		} else if (s->run || !s->seen_nonzero) {
+			end_run(s);
+		}
+	}
+}
+
+/* Zero runs of 64 bytes, with bit i of `m` set if byte i is zero. Only the
+ * runs that start or end inside them cost anything.
+ */
+static inline void scan_mask(struct byte_stats *s, uint64_t m)
+{
+	int pos, len;
+
+	if (m == ~0ull) {
+		if (s->run == 0)
+			s->zero_runs++;
+		s->run += 64;
+		return;
+	}
+	/* Zeroes at the start go on with the current run */
+	pos = __builtin_ctzll(~m);
+	if (pos > 0) {
+		if (s->run == 0)
+			s->zero_runs++;
+		s->run += pos;
+	}
+	if (s->run || !s->seen_nonzero)
+		end_run(s);
+	for (m >>= pos; m; m >>= len, pos += len) {
+		int skip = __builtin_ctzll(m);
+
+		m >>= skip;
+		pos += skip;
+		len = __builtin_ctzll(~m);
+		s->zero_runs++;
+		s->run = len;
+		if (pos + len < 64)
+			end_run(s);
+	}
+}
+
+#ifdef HAVE_X86_SIMD
+static inline uint64_t zero_mask(const uint8_t *p)
+{
+	const __m128i z = _mm_setzero_si128();
+	uint64_t m0 = _mm_movemask_epi8(
+		_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), z));
+	uint64_t m1 = _mm_movemask_epi8(
+		_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 16)), z));
+	uint64_t m2 = _mm_movemask_epi8(
+		_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 32)), z));
+	uint64_t m3 = _mm_movemask_epi8(
+		_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 48)), z));
+
+	return m0 | m1 << 16 | m2 << 32 | m3 << 48;
+}
+#else
+static inline uint64_t zero_mask(const uint8_t *p)
+{
+	uint64_t m = 0;
+
+	for (int i = 0; i < 64; i++)
+		m |= (uint64_t)(p[i] == 0) << i;
+	return m;
+}
+#endif
+
+#define COUNT8(sub, v)                                                        \
+	do {                                                                  \
+		sub[0][(v) & 0xff]++;                                         \
+		sub[1][((v) >> 8) & 0xff]++;                                  \
+		sub[2][((v) >> 16) & 0xff]++;                                 \
+		sub[3][((v) >> 24) & 0xff]++;                                 \
+		sub[0][((v) >> 32) & 0xff]++;                                 \
+		sub[1][((v) >> 40) & 0xff]++;                                 \
+		sub[2][((v) >> 48) & 0xff]++;                                 \
+		sub[3][(v) >> 56]++;                                          \
+	} while (0)
+
+/* One pass over the bytes for both the histogram and the zero runs */
+static void count_bytes(struct byte_stats *s, const uint8_t *p, size_t n)
+{
+	uint32_t(*sub)[256] = s->sub;
+
+	for (; n >= 64; n -= 64, p += 64) {
+		for (int i = 0; i < 64; i += 8) {
+			uint64_t v;
+
+			memcpy(&v, p + i, 8);
+			COUNT8(sub, v);
+		}
+		scan_mask(s, zero_mask(p));
+	}
+	for (size_t i = 0; i < n; i++)
+		sub[i & 3][p[i]]++;
+	scan_zeros(s, p, n);
+}
+
+int byte_stats_update(struct byte_stats *s, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint64_t limit = block_limit(s);
+
+	while (len > 0) {
+		uint64_t n = limit - s->block_fill;
+
+		if (n > len)
+			n = len;
+		count_bytes(s, p, n);
+		s->block_fill += n;
+		s->total += n;
+		p += n;
+		len -= n;
+		if (s->block_fill == limit && flush_block(s) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+/* `len` zero bytes, e.g. a hole of a sparse file that was never read */
+int byte_stats_zeros(struct byte_stats *s, uint64_t len)
+{
+	uint64_t limit = block_limit(s);
+
+	if (len == 0)
+		return 0;
+	if (s->run == 0)
+		s->zero_runs++;
+	s->run += len;
+	s->total += len;
+	while (len > 0) {
+		uint64_t n = limit - s->block_fill;
+
+		if (n > len)
+			n = len;
+		if (n == limit) {
+			/* A whole block of zeroes */
+			s->hist[0] += n;
+			if (s->block_size && push_entropy(s, 0) != 0)
+				return -1;
+		} else {
+			s->sub[0][0] += n;
+			s->block_fill += n;
+			if (s->block_fill == limit && flush_block(s) != 0)
+				return -1;
+		}
+		len -= n;
+	}
+	return 0;
+}
+
+/* Accounts for the last, partial block. Call before merging or printing,
+ * and not update afterwards.
+ */
+int byte_stats_finish(struct byte_stats *s)
+{
+	if (s->block_fill > 0 && flush_block(s) != 0)
+		return -1;
+	if (s->run > s->longest_run)
+		s->longest_run = s->run;
+	return 0;
+}
+
+/* Appends the statistics of the input that follows `s` right after it.
+ * Both must be finished, and the blocks of `s` must all be whole.
+ */
+int byte_stats_merge(struct byte_stats *s, const struct byte_stats *t)
+{
+	uint64_t t_lead = t->seen_nonzero ? t->lead : t->run;
+
+	for (int i = 0; i < 256; i++)
+		s->hist[i] += t->hist[i];
+	s->zero_runs += t->zero_runs;
+	if (t->longest_run > s->longest_run)
+		s->longest_run = t->longest_run;
+	if (s->run > 0 && t_lead > 0) {
+		/* The run at the end of `s` goes on into `t` */
+		s->zero_runs--;
+		if (s->run + t_lead > s->longest_run)
+			s->longest_run = s->run + t_lead;
+	}
+	if (!s->seen_nonzero && t->seen_nonzero)
+		s->lead = s->total + t->lead;
+	s->seen_nonzero |= t->seen_nonzero;
+	s->run = t->seen_nonzero ? t->run : s->run + t->run;
+	s->total += t->total;
+
+	for (size_t i = 0; i < t->nentropy; i++)
+		if (push_entropy(s, t->entropy[i]) != 0)
+			return -1;
+	return 0;
+}
+
+/* Bytes shown as themselves in the ascii column of a dump */
+uint64_t byte_stats_printable(const struct byte_stats *s)
+{
+	uint64_t n = 0;
+
+	for (int i = 0x20; i < 0x7f; i++)
+		n += s->hist[i];
+	return n;
+}
+
+static double percent(uint64_t n, uint64_t total)
+{
+	return total ? 100.0 * n / total : 0;
+}
+
+void byte_stats_print(FILE *f, const struct byte_stats *s, uint64_t start,
+		      bool histogram)
+{
+	uint64_t printable = byte_stats_printable(s);
+
+	for (size_t i = 0; i < s->nentropy; i++)
+		fprintf(f, "0x%.8" PRIx64 " %.4f\n", start + i * s->block_size,
+			s->entropy[i]);
+	if (histogram)
+		for (int i = 0; i < 256; i++)
+			if (s->hist[i])
+				fprintf(f, "%02x %" PRIu64 "\n", i, s->hist[i]);
+	fprintf(f, "bytes:      %" PRIu64 "\n", s->total);
+	fprintf(f, "entropy:    %.4f bits/byte\n",
+		byte_entropy(s->hist, s->total));
+	fprintf(f, "printable:  %" PRIu64 " (%.2f%%)\n", printable,
+		percent(printable, s->total));
+	fprintf(f, "zero bytes: %" PRIu64 " (%.2f%%)\n", s->hist[0],
+		percent(s->hist[0], s->total));
+	fprintf(f, "zero runs:  %" PRIu64 ", longest %" PRIu64 "\n",
+		s->zero_runs, s->longest_run);
+}
@@ -0,0 +1,52 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Statistics of a byte stream: histogram of the byte values, Shannon
+ * entropy (overall and per block), printable bytes and runs of zero bytes.
+ * Input can be fed in pieces of any size. The statistics of consecutive
+ * parts of a file can be computed independently and merged afterwards.
+ */
+struct byte_stats {
+	uint64_t hist[256];
+	uint64_t total;
+	uint64_t zero_runs;
+	uint64_t longest_run;
+	uint64_t lead; /* zero bytes before the first non zero byte */
+	uint64_t run; /* zero bytes at the end of the input so far */
+	bool seen_nonzero;
+
+	/* Entropy of every block_size bytes, if block_size != 0 */
+	uint64_t block_size;
+	uint64_t block_fill;
+	double *entropy;
+	size_t nentropy;
+	size_t entropy_cap;
+
+	/* Interleaved counters for the current block, so that consecutive
+	 * equal bytes don't wait on each other's increment.
+	 */
+	uint32_t sub[4][256];
+};
+
+#define BYTE_STATS_MAX_BLOCK (1u << 30)
+
+void byte_stats_init(struct byte_stats *s, uint64_t block_size);
+void byte_stats_free(struct byte_stats *s);
+int byte_stats_update(struct byte_stats *s, const void *buf, size_t len);
+int byte_stats_zeros(struct byte_stats *s, uint64_t len);
+int byte_stats_finish(struct byte_stats *s);
+int byte_stats_merge(struct byte_stats *s, const struct byte_stats *t);
+double byte_entropy(const uint64_t hist[256], uint64_t total);
+uint64_t byte_stats_printable(const struct byte_stats *s);
+void byte_stats_print(FILE *f, const struct byte_stats *s, uint64_t start,
+		      bool histogram);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <vector>
 #include <algorithm>
 #include <functional>
@@ -17,10 +19,27 @@ class Heap {
   Heap() : v() {
   }
 
+  // Builds the heap from [first, last) in O(n) instead of n pushes.
+  template <typename It>
+  Heap(It first, It last) : v(first, last) {
+    heapify();
+  }
+
+  // Replaces the contents with [first, last), heapified in O(n).
+  template <typename It>
+  void assign(It first, It last) {
+    v.assign(first, last);
+    heapify();
+  }
+
   ssize_t size() const {
     return v.size();
   }
 
+  bool empty() const {
+    return v.empty();
+  }
+
   void pop_back() {
     v.pop_back();
   }
@@ -83,6 +102,72 @@ class Heap {
     v.pop_back();
   }
 
+  // Restores the heap property over the whole vector. make_heap sinks every
+  // internal node bottom-up (Floyd's method), which is O(n).
+  void heapify() {
+    if (U)
+      make_heap(v.begin(), v.end(), std::less<T>());
+    else
+      make_heap(v.begin(), v.end(), std::greater<T>());
+  }
+
+  // Moves all the elements of `other` into this heap and leaves `other`
+  // empty. The larger storage is kept. When the smaller side is tiny it is
+  // pushed one by one, otherwise both are concatenated and re-heapified.
+  void meld(Heap& other) {
+    if (v.size() < other.v.size())
+      std::swap(v, other.v);
+    size_t m = other.v.size();
+    size_t n = v.size() + m;
+    size_t log_n = 0;
+    while ((size_t(1) << log_n) < n)
+      log_n++;
+    if (m * log_n < n) {
+      for (const T& elem : other.v)
+        push(elem);
+    } else {
+      v.insert(v.end(), other.v.begin(), other.v.end());
+      heapify();
+    }
+    other.v.clear();
+  }
+
+  void meld(Heap&& other) {
+    meld(other);
+  }
+
+  // Returns the k best elements, best first, without modifying the heap.
+  // The next best element is always a child of one already taken, so the
+  // candidates are kept in an auxiliary heap of indices which never holds
+  // more than k + 1 entries: O(k log k) regardless of size().
+  std::vector<T> top_k(size_t k) const {
+    std::vector<T> out;
+    size_t n = v.size();
+    if (k > n)
+      k = n;
+    if (k == 0)
+      return out;
+    out.reserve(k);
+
+    auto worse = [this](size_t a, size_t b) {
+      return U ? v[a] < v[b] : v[a] > v[b];
+    };
+    std::vector<size_t> cand;
+    cand.reserve(k + 1);
+    cand.push_back(0);
+    while (out.size() < k) {
+      std::pop_heap(cand.begin(), cand.end(), worse);
+      size_t index = cand.back();
+      cand.pop_back();
+      out.push_back(v[index]);
+      for (size_t ch = 2 * index + 1; ch <= 2 * index + 2 && ch < n; ch++) {
+        cand.push_back(ch);
+        std::push_heap(cand.begin(), cand.end(), worse);
+      }
+    }
+    return out;
+  }
+
   void remove2(const T& elem) {
     // This will remove the given element and then brought its parent element
     // down to occupy the position of the removed element and do the same
@@ -93,10 +178,7 @@ class Heap {
     if (it == v.end())
       assert(0);
 
-    int n = v.size();
-    int index, ch1, ch2;
-
-    int parent;
+    int index, parent;
     index = it - v.begin();
     while (index != 0) {
       parent = (index - 1) / 2;
@@ -126,4 +208,130 @@ using MinHeap = Heap<T, false>;
 template <typename T>
 using MaxHeap = Heap<T, true>;
 
+// A binary heap over dense ids [0, capacity) with a position table, so the
+// key of any id can be changed or removed in O(log n) without a search.
+template <typename T, bool U = true>
+class IndexedHeap {
+ private:
+  std::vector<size_t> ids;   // the heap, by position
+  std::vector<ssize_t> pos;  // id -> position in `ids`, -1 if absent
+  std::vector<T> keys;       // id -> key
+
+  bool better(size_t a, size_t b) const {
+    return U ? keys[a] > keys[b] : keys[a] < keys[b];
+  }
+
+  void place(size_t index, size_t id) {
+    ids[index] = id;
+    pos[id] = index;
+  }
+
+  void sift_up(size_t index) {
+    size_t id = ids[index];
+    while (index > 0) {
+      size_t parent = (index - 1) / 2;
+      if (!better(id, ids[parent]))
+        break;
+      place(index, ids[parent]);
+      index = parent;
+    }
+    place(index, id);
+  }
+
+  void sift_down(size_t index) {
+    size_t id = ids[index];
+    size_t n = ids.size();
+    for (;;) {
+      size_t ch = 2 * index + 1;
+      if (ch >= n)
+        break;
+      if (ch + 1 < n && better(ids[ch + 1], ids[ch]))
+        ch++;
+      if (!better(ids[ch], id))
+        break;
+      place(index, ids[ch]);
+      index = ch;
+    }
+    place(index, id);
+  }
+
+ public:
+  explicit IndexedHeap(size_t capacity = 0)
+      : pos(capacity, -1), keys(capacity) {
+  }
+
+  // Grows the id space; existing entries are kept.
+  void resize(size_t capacity) {
+    pos.resize(capacity, -1);
+    keys.resize(capacity);
+  }
+
+  ssize_t size() const {
+    return ids.size();
+  }
+
+  bool empty() const {
+    return ids.empty();
+  }
+
+  bool contains(size_t id) const {
+    return pos[id] >= 0;
+  }
+
+  const T& key(size_t id) const {
+    return keys[id];
+  }
+
+  size_t top_id() const {
+    return ids.front();
+  }
+
+  const T& top() const {
+    return keys[ids.front()];
+  }
+
+  void push(size_t id, const T& key) {
+    assert(!contains(id));
+    keys[id] = key;
+    ids.push_back(id);
+    sift_up(ids.size() - 1);
+  }
+
+  void pop() {
+    remove(ids.front());
+  }
+
+  // Sets a new key for `id` (inserting it if absent) and moves it up or
+  // down as needed.
+  void update(size_t id, const T& key) {
+    if (!contains(id)) {
+      push(id, key);
+      return;
+    }
+    bool up = U ? key > keys[id] : key < keys[id];
+    keys[id] = key;
+    if (up)
+      sift_up(pos[id]);
+    else
+      sift_down(pos[id]);
+  }
+
+  void remove(size_t id) {
+    size_t index = pos[id];
+    size_t last = ids.back();
+    ids.pop_back();
+    pos[id] = -1;
+    if (last == id)
+      return;
+    place(index, last);
+    sift_down(index);
+    sift_up(pos[last]);
+  }
+};
+
+template <typename T>
+using IndexedMinHeap = IndexedHeap<T, false>;
+template <typename T>
+using IndexedMaxHeap = IndexedHeap<T, true>;
+
 }  // namespace heap
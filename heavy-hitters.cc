@@ -0,0 +1,216 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "heavy-hitters.hh"
+#include "ip-parser.h"
+
+/**
+ * Prints the most frequent source addresses of a log, one IPv4 or IPv6
+ * address at the start of each line, with a fixed size Space-Saving sketch.
+ * With -j, the file is split at line boundaries, every thread fills its own
+ * sketch and the sketches are merged. With -e, the exact counts are also
+ * computed with a hash map to report memory use and accuracy.
+ */
+
+using sketch::Addr;
+using sketch::AddrHash;
+using sketch::SpaceSaving;
+
+// Parses the address at the start of a line into the IPv4-mapped form.
+static bool parse_addr(const char *line, size_t len, Addr *a) {
+  char buf[64];
+  if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+  memcpy(buf, line, len);
+  buf[len] = '\0';
+  const char *s = buf;
+  while (*s == ' ' || *s == '\t') s++;
+
+  int64_t ip4;
+  const char *end = parse_ipv4(s, &ip4);
+  if (ip4 >= 0 && (*end == '\0' || strchr(" \t\r,", *end))) {
+    memset(a->bytes, 0, 10);
+    a->bytes[10] = a->bytes[11] = 0xff;
+    for (int i = 0; i < 4; i++) a->bytes[12 + i] = (ip4 >> (24 - 8 * i)) & 0xff;
+    return true;
+  }
+  uint16_t hextet[8];
+  bool valid;
+  end = parse_ipv6(s, hextet, &valid);
+  if (!valid || !(*end == '\0' || strchr(" \t\r,", *end))) return false;
+  for (int i = 0; i < 8; i++) {
+    a->bytes[2 * i] = hextet[i] >> 8;
+    a->bytes[2 * i + 1] = hextet[i] & 0xff;
+  }
+  return true;
+}
+
+static void format_addr(const Addr &a, char *out, size_t len) {
+  static const uint8_t mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+  if (memcmp(a.bytes, mapped, 12) == 0) {
+    snprintf(out, len, "%u.%u.%u.%u", a.bytes[12], a.bytes[13], a.bytes[14],
+             a.bytes[15]);
+    return;
+  }
+  int n = 0;
+  for (int i = 0; i < 8; i++)
+    n += snprintf(out + n, len - n, i ? ":%x" : "%x",
+                  (a.bytes[2 * i] << 8) | a.bytes[2 * i + 1]);
+}
+
+template <typename F>
+static size_t for_each_addr(const char *p, const char *end, F &&f) {
+  size_t bad = 0;
+  while (p < end) {
+    const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (!nl) nl = end;
+    Addr a;
+    if (nl > p) {
+      if (parse_addr(p, nl - p, &a))
+        f(a);
+      else
+        bad++;
+    }
+    p = nl + 1;
+  }
+  return bad;
+}
+
+static void usage(const char *prog) {
+  std::cerr << "Usage: " << prog << " [-k counters] [-n top] [-j threads] "
+            << "[-e] file\n"
+            << "  -e  also count exactly and report accuracy\n";
+}
+
+int main(int argc, char *argv[]) {
+  size_t capacity = 1000, ntop = 100;
+  unsigned threads = 1;
+  bool exact = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "k:n:j:eh")) != -1) {
+    switch (opt) {
+      case 'k':
+        capacity = strtoul(optarg, nullptr, 0);
+        break;
+      case 'n':
+        ntop = strtoul(optarg, nullptr, 0);
+        break;
+      case 'j':
+        threads = strtoul(optarg, nullptr, 0);
+        break;
+      case 'e':
+        exact = true;
+        break;
+      default:
+        usage(argv[0]);
+        return EINVAL;
+    }
+  }
+  if (optind + 1 != argc || capacity == 0 || threads == 0) {
+    usage(argv[0]);
+    return EINVAL;
+  }
+
+  int fd = open(argv[optind], O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    std::cerr << "Error opening file " << argv[optind] << '\n';
+    return EINVAL;
+  }
+  if (st.st_size == 0) {
+    fprintf(stderr, "addresses: 0, invalid lines: 0\n");
+    return 0;
+  }
+  void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (m == MAP_FAILED) {
+    perror("mmap");
+    return EIO;
+  }
+  madvise(m, st.st_size, MADV_SEQUENTIAL);
+  const char *data = static_cast<const char *>(m);
+  const char *end = data + st.st_size;
+
+  // Split into `threads` chunks at line boundaries.
+  std::vector<const char *> bounds{data};
+  for (unsigned t = 1; t < threads; t++) {
+    const char *p = data + st.st_size / threads * t;
+    if (p < bounds.back()) p = bounds.back();
+    const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+    bounds.push_back(nl ? nl + 1 : end);
+  }
+  bounds.push_back(end);
+
+  std::vector<SpaceSaving> sketches(threads, SpaceSaving(capacity));
+  std::vector<size_t> bad(threads);
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++)
+    workers.emplace_back([&, t] {
+      bad[t] = for_each_addr(bounds[t], bounds[t + 1],
+                             [&](const Addr &a) { sketches[t].add(a); });
+    });
+  size_t invalid = 0;
+  for (unsigned t = 0; t < threads; t++) {
+    workers[t].join();
+    invalid += bad[t];
+    if (t > 0) sketches[0].merge(sketches[t]);
+  }
+  const SpaceSaving &ss = sketches[0];
+
+  std::unordered_map<Addr, uint64_t, AddrHash> counts;
+  if (exact)
+    for_each_addr(data, end, [&](const Addr &a) { counts[a]++; });
+
+  char str[64];
+  auto top = ss.top(ntop);
+  for (const auto &c : top) {
+    format_addr(c.addr, str, sizeof(str));
+    printf("%-40s %12lu  (+/- %lu)", str, (unsigned long)c.count,
+           (unsigned long)c.error);
+    if (exact) printf("  exact %lu", (unsigned long)counts[c.addr]);
+    printf("\n");
+  }
+  fprintf(stderr, "addresses: %lu, invalid lines: %zu\n",
+          (unsigned long)ss.total(), invalid);
+  fprintf(stderr, "sketch: %zu counters, %zu bytes\n", ss.capacity(),
+          ss.memory_bytes());
+  if (exact) {
+    // Node size estimate for libstdc++: next pointer, value, cached hash.
+    size_t node = sizeof(void *) + sizeof(std::pair<const Addr, uint64_t>) +
+                  sizeof(size_t);
+    size_t mem = counts.size() * node + counts.bucket_count() * sizeof(void *);
+    fprintf(stderr, "exact: %zu distinct addresses, ~%zu bytes\n",
+            counts.size(), mem);
+
+    // How many of the true top-n did the sketch report, and how far off
+    // were the counts.
+    std::vector<std::pair<uint64_t, Addr>> truth;
+    for (const auto &kv : counts) truth.push_back({kv.second, kv.first});
+    size_t k = std::min(ntop, truth.size());
+    std::partial_sort(truth.begin(), truth.begin() + k, truth.end(),
+                      [](const auto &a, const auto &b) {
+                        return a.first > b.first;
+                      });
+    size_t hits = 0;
+    uint64_t max_err = 0, sum_err = 0;
+    for (size_t i = 0; i < k; i++)
+      for (const auto &c : top)
+        if (c.addr == truth[i].second) hits++;
+    for (const auto &c : top) {
+      uint64_t err = c.count - counts[c.addr];
+      max_err = std::max(max_err, err);
+      sum_err += err;
+    }
+    fprintf(stderr, "top-%zu recall: %zu/%zu, count error max %lu avg %.2f\n",
+            k, hits, k, (unsigned long)max_err,
+            top.empty() ? 0.0 : (double)sum_err / top.size());
+  }
+  return 0;
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "heap.hh"
+
+// Space-Saving heavy hitters sketch over 16 byte addresses (IPv4 is stored
+// as an IPv4-mapped IPv6 address). It keeps `capacity` counters: a counter
+// is found through an open addressing index, and the counters are ordered
+// in a heap::IndexedMinHeap so the smallest one can be recycled for a new
+// address and any counter can be incremented in O(log capacity).
+//
+// Every address whose true count exceeds total() / capacity is guaranteed
+// to be present, and each reported count overestimates the true one by at
+// most its `error`.
+
+namespace sketch {
+struct Addr {
+  uint8_t bytes[16];
+
+  bool operator==(const Addr &a) const {
+    return memcmp(bytes, a.bytes, 16) == 0;
+  }
+};
+
+struct AddrHash {
+  size_t operator()(const Addr &a) const {
+    uint64_t lo, hi;
+    memcpy(&lo, a.bytes, 8);
+    memcpy(&hi, a.bytes + 8, 8);
+    uint64_t h = (lo ^ (hi * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+    return h ^ (h >> 32);
+  }
+};
+
+class SpaceSaving {
+ public:
+  struct Counter {
+    Addr addr;
+    uint64_t count;
+    uint64_t error;
+  };
+
+ private:
+  static constexpr uint32_t kEmpty = UINT32_MAX;
+
+  size_t cap;
+  std::vector<Addr> addrs;       // slot -> address
+  std::vector<uint64_t> errors;  // slot -> overestimation bound
+  heap::IndexedMinHeap<uint64_t> counts;
+  std::vector<uint32_t> index;   // open addressing: hash -> slot
+  size_t mask;
+  uint64_t n;
+
+  size_t find(const Addr &a) const {
+    size_t i = AddrHash()(a) & mask;
+    while (index[i] != kEmpty && !(addrs[index[i]] == a)) i = (i + 1) & mask;
+    return i;
+  }
+
+  // Backward shift deletion keeps the probe sequences intact without
+  // tombstones.
+  void erase_index(size_t i) {
+    size_t j = i;
+    for (;;) {
+      j = (j + 1) & mask;
+      if (index[j] == kEmpty)
+        break;
+      size_t home = AddrHash()(addrs[index[j]]) & mask;
+      // Move index[j] into the hole unless its home lies in (i, j].
+      if (((j - home) & mask) >= ((j - i) & mask)) {
+        index[i] = index[j];
+        i = j;
+      }
+    }
+    index[i] = kEmpty;
+  }
+
+ public:
+  explicit SpaceSaving(size_t capacity)
+      : cap(capacity), counts(capacity), n(0) {
+    size_t size = 16;
+    while (size < 2 * capacity) size *= 2;
+    index.assign(size, kEmpty);
+    mask = size - 1;
+    addrs.reserve(capacity);
+    errors.reserve(capacity);
+  }
+
+  size_t capacity() const {
+    return cap;
+  }
+
+  // Number of addresses seen (sum of all weights).
+  uint64_t total() const {
+    return n;
+  }
+
+  // Count any unseen address could have had: 0 until all counters are used.
+  uint64_t min_count() const {
+    return addrs.size() < cap ? 0 : counts.top();
+  }
+
+  void add(const Addr &a, uint64_t weight = 1) {
+    n += weight;
+    size_t i = find(a);
+    if (index[i] != kEmpty) {
+      uint32_t slot = index[i];
+      counts.update(slot, counts.key(slot) + weight);
+      return;
+    }
+    if (addrs.size() < cap) {
+      uint32_t slot = addrs.size();
+      addrs.push_back(a);
+      errors.push_back(0);
+      index[i] = slot;
+      counts.push(slot, weight);
+      return;
+    }
+    // Recycle the smallest counter; its count becomes the new error bound.
+    uint32_t slot = counts.top_id();
+    uint64_t min = counts.top();
+    erase_index(find(addrs[slot]));
+    addrs[slot] = a;
+    errors[slot] = min;
+    index[find(a)] = slot;
+    counts.update(slot, min + weight);
+  }
+
+  // All counters, largest count first.
+  std::vector<Counter> counters() const {
+    std::vector<Counter> out;
+    out.reserve(addrs.size());
+    for (size_t slot = 0; slot < addrs.size(); slot++)
+      out.push_back(Counter{ addrs[slot], counts.key(slot), errors[slot] });
+    std::sort(out.begin(), out.end(), [](const Counter &a, const Counter &b) {
+      return a.count > b.count;
+    });
+    return out;
+  }
+
+  std::vector<Counter> top(size_t k) const {
+    std::vector<Counter> out = counters();
+    if (out.size() > k)
+      out.resize(k);
+    return out;
+  }
+
+  // Combines another sketch (e.g. of another thread's share of the input)
+  // into this one. An address missing from one side may have had up to
+  // that side's min_count() there, which is added to both its count and
+  // its error. The largest `capacity` results are kept.
+  void merge(const SpaceSaving &other) {
+    uint64_t min_this = min_count();
+    uint64_t min_other = other.min_count();
+    std::vector<Counter> all = counters();
+    for (auto &c : all) {
+      size_t i = other.find(c.addr);
+      if (other.index[i] != kEmpty) {
+        uint32_t slot = other.index[i];
+        c.count += other.counts.key(slot);
+        c.error += other.errors[slot];
+      } else {
+        c.count += min_other;
+        c.error += min_other;
+      }
+    }
+    for (size_t slot = 0; slot < other.addrs.size(); slot++) {
+      if (index[find(other.addrs[slot])] != kEmpty)
+        continue;
+      all.push_back(Counter{ other.addrs[slot],
+                             other.counts.key(slot) + min_this,
+                             other.errors[slot] + min_this });
+    }
+    std::sort(all.begin(), all.end(), [](const Counter &a, const Counter &b) {
+      return a.count > b.count;
+    });
+    if (all.size() > cap)
+      all.resize(cap);
+
+    uint64_t total = n + other.n;
+    *this = SpaceSaving(cap);
+    for (const auto &c : all) {
+      uint32_t slot = addrs.size();
+      addrs.push_back(c.addr);
+      errors.push_back(c.error);
+      index[find(c.addr)] = slot;
+      counts.push(slot, c.count);
+    }
+    n = total;
+  }
+
+  // Approximate heap memory held by the sketch.
+  size_t memory_bytes() const {
+    return addrs.capacity() * sizeof(Addr) +
+           errors.capacity() * sizeof(uint64_t) +
+           cap * (sizeof(size_t) + sizeof(ssize_t) + sizeof(uint64_t)) +
+           index.size() * sizeof(uint32_t);
+  }
+};
+
+}  // namespace sketch
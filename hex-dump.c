@@ -1,94 +1,153 @@
+#define _GNU_SOURCE
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <linux/fs.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "byte-search.h"
+#include "byte-stats.h"
+#include "hexcodec.h"
 
 /* Prints a given buf in hex to a given buffer, along with a NUL terminating
  * character. Offset + hex representation of 16 bytes + ascii signature of 16
  * bytes
  */
 
-static inline char hex(char c)
+/* Offsets are printed like "0x%.8" PRIx64 " : ": 13 bytes below 4 GiB and
+ * one more byte per extra hex digit above that.
+ */
+static inline int offset_digits(uint64_t offset)
 {
-	if (c >= 0 && c <= 9)
-		return '0' + c;
-	if (c >= 10 && c <= 15)
-		return 'a' + c - 10;
-	assert(0);
-	return 0;
+	int digits = 8;
+
+	while (digits < 16 && (offset >> (4 * digits)))
+		digits++;
+	return digits;
+}
+
+static inline int offset_len(uint64_t offset)
+{
+	return offset_digits(offset) + 5;
+}
+
+#define MAX_OFFSET_LEN (16 + 5)
+
+/* The digits only, "%.8" PRIx64 */
+static inline int write_offset_digits(char *out, uint64_t offset)
+{
+	int digits = offset_digits(offset);
+	int n = digits;
+
+	if (n & 1) {
+		uint8_t nibble = (offset >> (4 * (n - 1))) & 0xf;
+
+		*out++ = hex_pairs_lower[2 * nibble + 1];
+		n--;
+	}
+	for (int i = 0; i < n / 2; i++) {
+		uint8_t b = offset >> (4 * (n - 2) - 8 * i);
+		memcpy(&out[2 * i], &hex_pairs_lower[2 * b], 2);
+	}
+	return digits;
+}
+
+static inline int write_offset(char *hexbuf, uint64_t offset)
+{
+	int digits;
+
+	hexbuf[0] = '0';
+	hexbuf[1] = 'x';
+	digits = write_offset_digits(hexbuf + 2, offset);
+	memcpy(&hexbuf[2 + digits], " : ", 3);
+	return digits + 5;
+}
+
+/* Hex columns and ascii signature of a full line: the 57 bytes following
+ * the offset. The hex column is 8 groups of 2 bytes, which is what
+ * hex_encode() writes with a group of 2.
+ */
+static inline void conv_line_cols(char *hexbuf, const char *buf)
+{
+	uint8_t in[16];
+
+	/* A copy the compiler knows hexbuf doesn't overlap, so that the
+	 * ascii loop is vectorized
+	 */
+	memcpy(in, buf, 16);
+	hex_encode(hexbuf, in, 16, HEX_LOWER, ' ', 2);
+	hexbuf[39] = ' ';
+	/* isprint() in the C locale */
+	for (int i = 0; i < 16; i++)
+		hexbuf[40 + i] = in[i] >= 0x20 && in[i] < 0x7f ? in[i] : '.';
+	hexbuf[56] = '\n';
 }
 
 /** This is only a helper function. This is not intended to be called by the
  * end-users directly. Prints 16 bytes at a time with offset and ascii signature
- * This function consumes 16 bytes from `buf` and writes 70 bytes into `hexbuf`.
+ * This function consumes 16 bytes from `buf` and writes 70 bytes into `hexbuf`
+ * (more for offsets of 4 GiB and above, see offset_len()).
  * The caller must ensure that `buf` contains enough input data(16 bytes) and
- * `hexbuf` has atleast 70 bytes space.
+ * `hexbuf` has atleast MAX_OFFSET_LEN + 57 bytes space.
  * NOTE: No NUL character appended at the end
  */
-static inline int conv_16bytes(char *hexbuf, char *buf, uint32_t *offset)
+static inline int conv_16bytes(char *hexbuf, const char *buf,
+			       uint64_t *offset)
 {
-	int i, j;
-	char str[16];
+	int j;
 
-	j = sprintf(hexbuf, "0x%.8x : ", *offset);
-	assert(j == 13); // assuming 64 bit pointer addresses
-	for (i = 0; i < 16; i++) {
-		hexbuf[j++] = hex((buf[i] & 0xf0) >> 4);
-		hexbuf[j++] = hex(buf[i] & 0xf);
-		if ((i & 0x1) == 0x1)
-			hexbuf[j++] = ' ';
-		str[i] = isprint(buf[i]) ? buf[i] : '.';
-	}
-	memcpy(&hexbuf[j], str, 16);
-	j += 16;
-	hexbuf[j++] = '\n';
-	assert(j == 70);
+	j = write_offset(hexbuf, *offset);
+	conv_line_cols(hexbuf + j, buf);
 	*offset += 16;
-	return j;
+	return j + 57;
 }
 
-static inline int conv_nbytes(char *hexbuf, char *buf, int buf_size,
-			      uint32_t *offset)
+static inline int conv_nbytes(char *hexbuf, const char *buf, int buf_size,
+			      uint64_t *offset)
 {
-	int i, j;
+	int i, j, hex_end;
 	char str[16];
 
 	assert(buf_size < 16);
 
-	j = sprintf(hexbuf, "0x%.8x : ", *offset);
-	assert(j == 13); // assuming 64 bit pointer addresses
-	for (i = 0; i < buf_size; i++) {
-		hexbuf[j++] = hex((buf[i] & 0xf0) >> 4);
-		hexbuf[j++] = hex(buf[i] & 0xf);
-		if ((i & 0x1) == 0x1)
-			hexbuf[j++] = ' ';
+	j = write_offset(hexbuf, *offset);
+	hex_end = j + 40;
+	j += hex_encode(hexbuf + j, buf, buf_size, HEX_LOWER, ' ', 2);
+	for (i = 0; i < buf_size; i++)
 		str[i] = isprint(buf[i]) ? buf[i] : '.';
-	}
-	while (j < 53)
+	while (j < hex_end)
 		hexbuf[j++] = ' ';
 	memcpy(&hexbuf[j], str, buf_size);
 	j += buf_size;
 	hexbuf[j++] = '\n';
-	assert(j + 16 - buf_size == 70);
+	assert(j + 16 - buf_size == hex_end + 17);
 	*offset += buf_size;
 	return j;
 }
 
-static inline int conv_nbytes_2(char *hexbuf, char *buf, int buf_size,
-				uint32_t *offset)
+static inline int conv_nbytes_2(char *hexbuf, const char *buf, int buf_size,
+				uint64_t *offset)
 {
 	int i, j;
 
 	assert(buf_size < 16);
 
-	j = sprintf(hexbuf, "0x%.8x : ", *offset);
-	assert(j == 21); // assuming 64 bit pointer addresses
+	j = write_offset(hexbuf, *offset);
 	for (i = 0; i < buf_size; i++) {
-		hexbuf[j++] = hex((buf[i] & 0xf0) >> 4);
-		hexbuf[j++] = hex(buf[i] & 0xf);
+		memcpy(&hexbuf[j], &hex_pairs_lower[2 * (uint8_t)buf[i]], 2);
+		j += 2;
 		if ((i & 0x1) == 0x1)
 			hexbuf[j++] = ' ';
 	}
@@ -97,18 +156,17 @@ static inline int conv_nbytes_2(char *hexbuf, char *buf, int buf_size,
 	return j;
 }
 
-int hex_dump(char *hexbuf, int hexbuf_size, char *buf, int buf_size,
-	     uint32_t *offset)
+int hex_dump(char *hexbuf, int hexbuf_size, const char *buf, int buf_size,
+	     uint64_t *offset)
 {
 	int j, rc = 0;
 
 	if (buf_size < 1 || hexbuf_size < 1)
 		return rc;
 
-	/* 10 byte offset + 16 bytes * 2+1 */
-	while (hexbuf_size >= 70 && buf_size >= 16) {
+	/* offset + 16 bytes * 2+1 + 16 bytes ascii + '\n' */
+	while (hexbuf_size >= offset_len(*offset) + 57 && buf_size >= 16) {
 		j = conv_16bytes(hexbuf, buf, offset);
-		assert(j == 70);
 		rc += j;
 		hexbuf += j;
 		hexbuf_size -= j;
@@ -117,12 +175,15 @@ int hex_dump(char *hexbuf, int hexbuf_size, char *buf, int buf_size,
 	}
 
 	if (buf_size > 0) {
-		if (hexbuf_size >= 70)
+		int olen = offset_len(*offset);
+
+		j = 0;
+		if (hexbuf_size >= olen + 57)
 			j = conv_nbytes(hexbuf, buf, buf_size, offset);
-		else if (hexbuf_size > 13 + (buf_size + 1) / 2 * 5)
+		else if (hexbuf_size > olen + (buf_size + 1) / 2 * 5)
 			j = conv_nbytes_2(hexbuf, buf, buf_size, offset);
-		else if (hexbuf_size > 13)
-			j = sprintf(hexbuf, "0x%.8x : ", *offset);
+		else if (hexbuf_size > olen)
+			j = write_offset(hexbuf, *offset);
 
 		hexbuf_size -= j;
 		hexbuf += j;
@@ -163,22 +224,1430 @@ int main()
 	printf("\n");
 }
 #else
-int main()
+/* Output formats. Each one formats a line of up to 16 input bytes. The
+ * line functions are instantiated separately for full lines (n == 16 is a
+ * compile time constant there, so the per byte loops unroll) and for the
+ * short last line.
+ */
+struct formatter {
+	const char *name;
+	/* Formats n (1..16) bytes read at `offset`, returns the length */
+	int (*line)(char *out, const char *buf, int n, uint64_t offset);
+	/* Length of such a line, without formatting it */
+	int (*line_len)(uint64_t offset, int n);
+	bool end_line; /* "0x... :" line after every window */
+};
+
+/* Longest line of any format: a C array line of 16 bytes */
+#define MAX_LINE_LEN (16 * 6 + 2)
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+#define DEFINE_LINE_FN(name, body, ...)                                     \
+	static int name(char *out, const char *buf, int n, uint64_t offset) \
+	{                                                                   \
+		if (n == 16)                                                \
+			return body(out, buf, 16, offset, ##__VA_ARGS__);   \
+		return body(out, buf, n, offset, ##__VA_ARGS__);            \
+	}
+
+static ALWAYS_INLINE char ascii_char(char c)
 {
-	size_t buf_len = 4000;
-	char *buf = malloc(buf_len);
-	size_t hexbuf_len = 20000 + 1; // 5 times input
-	char *hexbuf = malloc(hexbuf_len);
-	uint32_t offset = 0;
-	while (!feof(stdin)) {
-		size_t size = fread(buf, 1, buf_len, stdin);
-		int rc = hex_dump(hexbuf, hexbuf_len, buf, size, &offset);
-		if (rc > 0)
-			printf("%s", hexbuf);
+	return c >= 0x20 && c < 0x7f ? c : '.';
+}
+
+/* The original layout: "0x%.8x : " offset, 8 groups of 2 bytes, ascii */
+static int hexdump_line(char *out, const char *buf, int n, uint64_t offset)
+{
+	if (n == 16)
+		return conv_16bytes(out, buf, &offset);
+	return conv_nbytes(out, buf, n, &offset);
+}
+
+static int hexdump_line_len(uint64_t offset, int n)
+{
+	return offset_len(offset) + 40 + n + 1;
+}
+
+/* xxd: "%08x: " offset, groups of `group` bytes, two spaces, ascii */
+static ALWAYS_INLINE int xxd_body(char *out, const char *buf, int n,
+				  uint64_t offset, int group)
+{
+	int j = write_offset_digits(out, offset);
+	int hex_end;
+	char in[16];
+
+	out[j++] = ':';
+	out[j++] = ' ';
+	hex_end = j + 32 + 16 / group;
+	/* The separator after the last group is part of the padding */
+	memcpy(in, buf, n);
+	j += hex_encode(out + j, in, n, HEX_LOWER, ' ', group);
+	while (j < hex_end)
+		out[j++] = ' ';
+	out[j++] = ' ';
+#pragma GCC unroll 16
+	for (int i = 0; i < n; i++)
+		out[j + i] = ascii_char(in[i]);
+	j += n;
+	out[j++] = '\n';
+	return j;
+}
+
+/* The default group of 2 has the same hex columns as the original layout,
+ * so a full line is formatted the same way and the ascii column is moved
+ * over by one for the second space.
+ */
+static int xxd_line_g2(char *out, const char *buf, int n, uint64_t offset)
+{
+	int j;
+
+	if (n < 16)
+		return xxd_body(out, buf, n, offset, 2);
+	j = write_offset_digits(out, offset);
+	out[j++] = ':';
+	out[j++] = ' ';
+	conv_line_cols(out + j, buf);
+	memmove(out + j + 41, out + j + 40, 17);
+	out[j + 40] = ' ';
+	return j + 58;
+}
+DEFINE_LINE_FN(xxd_line_g1, xxd_body, 1)
+DEFINE_LINE_FN(xxd_line_g4, xxd_body, 4)
+DEFINE_LINE_FN(xxd_line_g8, xxd_body, 8)
+DEFINE_LINE_FN(xxd_line_g16, xxd_body, 16)
+
+/* The groups only change the hex column width, which is the same for
+ * a full and a short line.
+ */
+#define DEFINE_XXD_LEN_FN(g)                                                \
+	static int xxd_line_len_g##g(uint64_t offset, int n)                \
+	{                                                                   \
+		return offset_digits(offset) + 2 + 32 + 16 / g + 1 + n + 1; \
+	}
+DEFINE_XXD_LEN_FN(1)
+DEFINE_XXD_LEN_FN(2)
+DEFINE_XXD_LEN_FN(4)
+DEFINE_XXD_LEN_FN(8)
+DEFINE_XXD_LEN_FN(16)
+
+/* od -An -v -tx1: " xx" per byte */
+static ALWAYS_INLINE int od_body(char *out, const char *buf, int n,
+				 uint64_t offset)
+{
+	(void)offset;
+	out[0] = ' ';
+	hex_encode(out + 1, buf, n, HEX_LOWER, ' ', 1);
+	out[3 * n] = '\n';
+	return 3 * n + 1;
+}
+DEFINE_LINE_FN(od_line, od_body)
+
+static int od_line_len(uint64_t offset, int n)
+{
+	(void)offset;
+	return 3 * n + 1;
+}
+
+/* Plain hex digits, 16 bytes per line (like xxd -p, and what hex2binary
+ * reads back)
+ */
+static ALWAYS_INLINE int plain_body(char *out, const char *buf, int n,
+				    uint64_t offset)
+{
+	(void)offset;
+	hex_encode(out, buf, n, HEX_LOWER, 0, 0);
+	out[2 * n] = '\n';
+	return 2 * n + 1;
+}
+DEFINE_LINE_FN(plain_line, plain_body)
+
+static int plain_line_len(uint64_t offset, int n)
+{
+	(void)offset;
+	return 2 * n + 1;
+}
+
+/* C array initializer: "  0x12, 0x34, ...," between a header and footer */
+static ALWAYS_INLINE int c_body(char *out, const char *buf, int n,
+				uint64_t offset)
+{
+	(void)offset;
+	out[0] = ' ';
+	out[1] = ' ';
+#pragma GCC unroll 16
+	for (int i = 0; i < n; i++) {
+		char *p = &out[2 + 6 * i];
+
+		p[0] = '0';
+		p[1] = 'x';
+		memcpy(&p[2], &hex_pairs_lower[2 * (uint8_t)buf[i]], 2);
+		p[4] = ',';
+		p[5] = ' ';
+	}
+	out[6 * n + 1] = '\n';
+	return 6 * n + 2;
+}
+DEFINE_LINE_FN(c_line, c_body)
+
+static int c_line_len(uint64_t offset, int n)
+{
+	(void)offset;
+	return 6 * n + 2;
+}
+
+static const struct formatter formats[] = {
+	{ "hexdump", hexdump_line, hexdump_line_len, true },
+	{ "xxd", xxd_line_g2, xxd_line_len_g2, false },
+	{ "od", od_line, od_line_len, false },
+	{ "plain", plain_line, plain_line_len, false },
+	{ "c", c_line, c_line_len, false },
+};
+
+/* xxd with -g 1, 2, 4, 8 and 16 */
+static const struct formatter xxd_groups[] = {
+	{ "xxd", xxd_line_g1, xxd_line_len_g1, false },
+	{ "xxd", xxd_line_g2, xxd_line_len_g2, false },
+	{ "xxd", xxd_line_g4, xxd_line_len_g4, false },
+	{ "xxd", xxd_line_g8, xxd_line_len_g8, false },
+	{ "xxd", xxd_line_g16, xxd_line_len_g16, false },
+};
+
+static const struct formatter *fmt = &formats[0];
+
+/* Size of the dump of `len` bytes starting at `offset`: full lines plus a
+ * short last line.
+ */
+static uint64_t dump_size(uint64_t offset, uint64_t len)
+{
+	uint64_t lines = len / 16;
+	uint64_t size = lines * fmt->line_len(0, 16);
+
+	/* Offset columns grow by one byte at every 16^d boundary */
+	if (fmt->line_len(UINT64_MAX, 16) != fmt->line_len(0, 16)) {
+		for (int d = 8; d < 16; d++) {
+			uint64_t t = 1ULL << (4 * d);
+			uint64_t below;
+
+			if (offset >= t) {
+				size += lines;
+				continue;
+			}
+			below = (t - offset + 15) / 16;
+			if (below < lines)
+				size += lines - below;
+		}
+	}
+	if (len % 16)
+		size += fmt->line_len(offset + len - len % 16, len % 16);
+	return size;
+}
+
+/* Input is formatted in chunks of whole lines, so only the very last line
+ * of the input can be short.
+ */
+#define IN_CHUNK (4 << 20)
+#define OUT_CHUNK (IN_CHUNK / 16 * MAX_LINE_LEN + MAX_LINE_LEN)
+#define STREAM_READ (8 << 20)
+
+/* A range of the input to dump: [start, start + len) */
+struct window {
+	uint64_t start;
+	uint64_t len;
+};
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			perror("write");
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Page aligned buffer, so write() can hand whole pages to the kernel */
+static char *alloc_buf(size_t size)
+{
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+	return p;
+}
+
+/* Maps [start, start + len) of `fd`. mmap() wants a page aligned file
+ * offset, so the mapping may begin a little earlier; *base and *base_len
+ * describe the whole mapping for munmap().
+ */
+static const char *map_window(int fd, uint64_t start, uint64_t len,
+			      void **base, size_t *base_len)
+{
+	uint64_t pgoff = start & ~((uint64_t)sysconf(_SC_PAGESIZE) - 1);
+
+	*base_len = len + (start - pgoff);
+	*base = mmap(NULL, *base_len, PROT_READ, MAP_PRIVATE, fd, pgoff);
+	if (*base == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+	madvise(*base, *base_len, MADV_SEQUENTIAL);
+	return (const char *)*base + (start - pgoff);
+}
+
+/* With --squeeze, a run of full lines identical to the line before them is
+ * printed as a single "*" line. The state carries over between blocks.
+ */
+static struct {
+	bool on;
+	bool have_prev; /* prev holds the last full line */
+	bool starred; /* "*" already printed for the current run */
+	char prev[16];
+} squeeze;
+
+static inline bool same_line(const char *a, const char *b)
+{
+	uint64_t a0, a1, b0, b1;
+
+	memcpy(&a0, a, 8);
+	memcpy(&a1, a + 8, 8);
+	memcpy(&b0, b, 8);
+	memcpy(&b1, b + 8, 8);
+	return ((a0 ^ b0) | (a1 ^ b1)) == 0;
+}
+
+static void squeeze_reset(void)
+{
+	squeeze.have_prev = false;
+	squeeze.starred = false;
+}
+
+/* --stats collects byte statistics in the same pass as the dump,
+ * --stats-only reads the input without formatting anything.
+ */
+static bool dump_on = true;
+static struct byte_stats *stats;
+static bool stats_histogram;
+
+static inline int stats_update(const char *buf, size_t len)
+{
+	if (stats && byte_stats_update(stats, buf, len) != 0) {
+		perror("stats");
+		return -1;
+	}
+	return 0;
+}
+
+/* Formats `len` bytes of input. Everything but the last (len % 16) bytes
+ * go out as full lines. Returns the number of bytes written to `hexbuf`,
+ * which must hold (len + 15) / 16 * MAX_LINE_LEN bytes.
+ */
+static size_t dump_block(char *hexbuf, const char *buf, size_t len,
+			 uint64_t *offset)
+{
+	char *p = hexbuf;
+
+	for (; len >= 16; len -= 16, buf += 16) {
+		if (squeeze.on) {
+			if (squeeze.have_prev && same_line(buf, squeeze.prev)) {
+				if (!squeeze.starred) {
+					memcpy(p, "*\n", 2);
+					p += 2;
+					squeeze.starred = true;
+				}
+				*offset += 16;
+				continue;
+			}
+			memcpy(squeeze.prev, buf, 16);
+			squeeze.have_prev = true;
+			squeeze.starred = false;
+		}
+		p += fmt->line(p, buf, 16, *offset);
+		*offset += 16;
+	}
+	if (len > 0) {
+		p += fmt->line(p, buf, len, *offset);
+		*offset += len;
+	}
+	return p - hexbuf;
+}
+
+/* Whole regular files are mapped and read sequentially, without any copy.
+ */
+static int dump_mapped(int fd, struct window w, uint64_t *offset)
+{
+	const char *in;
+	void *base;
+	size_t base_len;
+	char *out;
+	int rc = -1;
+
+	in = map_window(fd, w.start, w.len, &base, &base_len);
+	if (!in)
+		return rc;
+	out = alloc_buf(OUT_CHUNK);
+	if (!out)
+		goto unmap;
+
+	for (uint64_t pos = 0; pos < w.len; pos += IN_CHUNK) {
+		size_t len = w.len - pos < IN_CHUNK ? w.len - pos : IN_CHUNK;
+		if (stats_update(in + pos, len) != 0)
+			goto free_out;
+		if (!dump_on) {
+			*offset += len;
+			continue;
+		}
+		size_t n = dump_block(out, in + pos, len, offset);
+		if (write_all(STDOUT_FILENO, out, n) != 0)
+			goto free_out;
+	}
+	rc = 0;
+free_out:
+	munmap(out, OUT_CHUNK);
+unmap:
+	munmap(base, base_len);
+	return rc;
+}
+
+/* With --squeeze, the holes of a sparse file are not read at all: once the
+ * last line printed is all zeroes, every full line inside a hole would be
+ * squeezed anyway. Without a dump, holes are never read. Returns the
+ * number of bytes at `pos` that can be skipped that way (a multiple of 16),
+ * and sets *data_len to how much can be read before the next hole (rounded
+ * up to full lines).
+ */
+static uint64_t skip_hole(int fd, uint64_t pos, uint64_t end,
+			  uint64_t *data_len)
+{
+	static const char zero_line[16];
+	off_t data, hole;
+
+	*data_len = end - pos;
+	data = lseek(fd, pos, SEEK_DATA);
+	if (data < 0 && errno == ENXIO)
+		data = end; /* a hole up to the end of the file */
+	if (data < 0)
+		return 0; /* no SEEK_DATA support: read everything */
+	if ((uint64_t)data > pos) {
+		uint64_t n = ((uint64_t)data < end ? (uint64_t)data : end) - pos;
+
+		n &= ~(uint64_t)15;
+		if (n == 0)
+			return 0;
+		if (!dump_on ||
+		    (squeeze.have_prev && same_line(squeeze.prev, zero_line)))
+			return n;
+		*data_len = 16; /* just read one line of the hole */
+		return 0;
+	}
+	hole = lseek(fd, pos, SEEK_HOLE);
+	if (hole > data && (uint64_t)hole < end)
+		*data_len = ((uint64_t)hole - pos + 15) & ~(uint64_t)15;
+	return 0;
+}
+
+/* Small windows of big files or devices: pread() just the window. */
+static int dump_pread(int fd, struct window w, uint64_t *offset)
+{
+	size_t in_size = w.len < IN_CHUNK ? w.len : IN_CHUNK;
+	size_t out_size = (in_size + 15) / 16 * MAX_LINE_LEN;
+	char *in = alloc_buf(in_size);
+	char *out = alloc_buf(out_size);
+	uint64_t pos = 0;
+	int rc = -1;
+
+	if (!in || !out)
+		goto out;
+
+	while (pos < w.len) {
+		size_t want = w.len - pos < in_size ? w.len - pos : in_size;
+		size_t len = 0;
+
+		if (squeeze.on || !dump_on) {
+			uint64_t data_len;
+			uint64_t n = skip_hole(fd, w.start + pos,
+					       w.start + w.len, &data_len);
+
+			if (n > 0) {
+				size_t k = 0;
+
+				if (stats && byte_stats_zeros(stats, n) != 0) {
+					perror("stats");
+					goto out;
+				}
+				/* The whole hole is one run of repeats */
+				if (dump_on && !squeeze.starred) {
+					memcpy(out + k, "*\n", 2);
+					k += 2;
+					squeeze.starred = true;
+				}
+				if (write_all(STDOUT_FILENO, out, k) != 0)
+					goto out;
+				*offset += n;
+				pos += n;
+				continue;
+			}
+			if (data_len < want)
+				want = data_len;
+		}
+
+		while (len < want) {
+			ssize_t n = pread(fd, in + len, want - len,
+					  w.start + pos + len);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0) {
+				perror("pread");
+				goto out;
+			}
+			if (n == 0)
+				break;
+			len += n;
+		}
+		if (stats_update(in, len) != 0)
+			goto out;
+		size_t n = dump_on ? dump_block(out, in, len, offset) : 0;
+		if (!dump_on)
+			*offset += len;
+		if (write_all(STDOUT_FILENO, out, n) != 0)
+			goto out;
+		if (len < want)
+			break; /* file shrank under us */
+		pos += len;
+	}
+	rc = 0;
+out:
+	if (in)
+		munmap(in, in_size);
+	if (out)
+		munmap(out, out_size);
+	return rc;
+}
+
+/* Parallel dump of a mapped window. Full lines have a length that only
+ * depends on their offset, so chunk i always lands at output position
+ * dump_size(start, i * IN_CHUNK) and the chunks can be formatted in any
+ * order. With a regular file as output the workers pwrite() their chunk in
+ * place; otherwise they fill a ring of slots and the main thread writes the
+ * slots out in order. Statistics are kept per chunk and merged in order
+ * at the end.
+ */
+struct par_slot {
+	char *buf;
+	size_t len;
+	size_t chunk;
+	bool ready;
+};
+
+struct par_dump {
+	const char *in;
+	struct window w;
+	size_t nchunks;
+	size_t next_chunk; /* next chunk to be formatted */
+	size_t written; /* chunks written out (ordered mode) */
+	off_t out_base; /* pwrite mode if >= 0 */
+	struct par_slot *slots;
+	size_t nslots;
+	struct byte_stats *chunk_stats;
+	bool failed;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static void *par_worker(void *arg)
+{
+	struct par_dump *pd = arg;
+	char *own = NULL;
+
+	if (pd->out_base >= 0 && !(own = alloc_buf(OUT_CHUNK))) {
+		pthread_mutex_lock(&pd->lock);
+		pd->failed = true;
+		pthread_cond_broadcast(&pd->cond);
+		pthread_mutex_unlock(&pd->lock);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&pd->lock);
+	while (!pd->failed && pd->next_chunk < pd->nchunks) {
+		size_t c = pd->next_chunk++;
+		struct par_slot *slot = NULL;
+
+		if (!own) {
+			/* Wait for the slot's previous chunk to be written */
+			while (!pd->failed && c >= pd->written + pd->nslots)
+				pthread_cond_wait(&pd->cond, &pd->lock);
+			slot = &pd->slots[c % pd->nslots];
+		}
+		pthread_mutex_unlock(&pd->lock);
+
+		uint64_t pos = (uint64_t)c * IN_CHUNK;
+		size_t len = pd->w.len - pos < IN_CHUNK ? pd->w.len - pos :
+							  IN_CHUNK;
+		uint64_t offset = pd->w.start + pos;
+		char *out = own ? own : slot->buf;
+		size_t n = 0;
+		bool ok = true;
+
+		if (dump_on)
+			n = dump_block(out, pd->in + pos, len, &offset);
+		if (pd->chunk_stats) {
+			struct byte_stats *cs = &pd->chunk_stats[c];
+
+			byte_stats_init(cs, stats->block_size);
+			if (byte_stats_update(cs, pd->in + pos, len) != 0 ||
+			    byte_stats_finish(cs) != 0) {
+				perror("stats");
+				ok = false;
+			}
+		}
+
+		if (own) {
+			off_t at = pd->out_base + dump_size(pd->w.start, pos);
+			for (size_t done = 0; ok && done < n;) {
+				ssize_t w = pwrite(STDOUT_FILENO, out + done,
+						   n - done, at + done);
+				if (w < 0 && errno == EINTR)
+					continue;
+				if (w < 0) {
+					perror("pwrite");
+					ok = false;
+				}
+				done += w;
+			}
+		}
+
+		pthread_mutex_lock(&pd->lock);
+		if (!ok)
+			pd->failed = true;
+		if (slot) {
+			slot->len = n;
+			slot->chunk = c;
+			slot->ready = true;
+		}
+		pthread_cond_broadcast(&pd->cond);
+	}
+	pthread_mutex_unlock(&pd->lock);
+	if (own)
+		munmap(own, OUT_CHUNK);
+	return NULL;
+}
+
+/* Writes the ring slots out in chunk order (non seekable output). */
+static void par_write_ordered(struct par_dump *pd)
+{
+	pthread_mutex_lock(&pd->lock);
+	while (!pd->failed && pd->written < pd->nchunks) {
+		struct par_slot *slot = &pd->slots[pd->written % pd->nslots];
+
+		if (!slot->ready || slot->chunk != pd->written) {
+			pthread_cond_wait(&pd->cond, &pd->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&pd->lock);
+		int rc = write_all(STDOUT_FILENO, slot->buf, slot->len);
+		pthread_mutex_lock(&pd->lock);
+		if (rc != 0)
+			pd->failed = true;
+		slot->ready = false;
+		pd->written++;
+		pthread_cond_broadcast(&pd->cond);
+	}
+	pthread_mutex_unlock(&pd->lock);
+}
+
+static int dump_parallel(int fd, struct window w, int nthreads,
+			 uint64_t *offset)
+{
+	struct par_dump pd = {
+		.w = w,
+		.nchunks = (w.len + IN_CHUNK - 1) / IN_CHUNK,
+		.out_base = -1,
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+	};
+	pthread_t threads[nthreads];
+	struct stat st;
+	void *base;
+	size_t base_len;
+	int started = 0, rc = -1;
+
+	pd.in = map_window(fd, w.start, w.len, &base, &base_len);
+	if (!pd.in)
+		return rc;
+	if (stats &&
+	    !(pd.chunk_stats = calloc(pd.nchunks, sizeof(*pd.chunk_stats))))
+		goto unmap;
+
+	/* pwrite() ignores the offset with O_APPEND, keep those ordered too */
+	if (fstat(STDOUT_FILENO, &st) == 0 && S_ISREG(st.st_mode) &&
+	    !(fcntl(STDOUT_FILENO, F_GETFL) & O_APPEND))
+		pd.out_base = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+
+	if (pd.out_base < 0) {
+		pd.nslots = 2 * nthreads;
+		pd.slots = calloc(pd.nslots, sizeof(*pd.slots));
+		if (!pd.slots)
+			goto unmap;
+		for (size_t i = 0; i < pd.nslots; i++)
+			if (!(pd.slots[i].buf = alloc_buf(OUT_CHUNK)))
+				goto free_slots;
+	}
+
+	for (; started < nthreads; started++)
+		if (pthread_create(&threads[started], NULL, par_worker, &pd))
+			break;
+	if (started == 0)
+		goto free_slots;
+	if (pd.out_base < 0)
+		par_write_ordered(&pd);
+	for (int i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	if (pd.failed)
+		goto free_slots;
+	for (size_t c = 0; pd.chunk_stats && c < pd.nchunks; c++)
+		if (byte_stats_merge(stats, &pd.chunk_stats[c]) != 0)
+			goto free_slots;
+
+	if (pd.out_base >= 0)
+		lseek(STDOUT_FILENO, pd.out_base + dump_size(w.start, w.len),
+		      SEEK_SET);
+	*offset += w.len;
+	rc = 0;
+free_slots:
+	for (size_t i = 0; pd.slots && i < pd.nslots; i++)
+		if (pd.slots[i].buf)
+			munmap(pd.slots[i].buf, OUT_CHUNK);
+	free(pd.slots);
+	for (size_t c = 0; pd.chunk_stats && c < pd.nchunks; c++)
+		byte_stats_free(&pd.chunk_stats[c]);
+	free(pd.chunk_stats);
+unmap:
+	munmap(base, base_len);
+	return rc;
+}
+
+/* Pipes and terminals: read until the buffer is full (or EOF) so that a
+ * short read never produces a short line in the middle of the output.
+ * The first w.start bytes are read and thrown away.
+ */
+static int dump_stream(int fd, struct window w, uint64_t *offset)
+{
+	size_t out_size = STREAM_READ / 16 * MAX_LINE_LEN + MAX_LINE_LEN;
+	char *in = alloc_buf(STREAM_READ);
+	char *out = alloc_buf(out_size);
+	uint64_t skip = w.start, left = w.len;
+	bool eof = false;
+	int rc = -1;
+
+	if (!in || !out)
+		goto out;
+
+	while (!eof && left > 0) {
+		size_t want = STREAM_READ;
+		size_t len = 0;
+
+		/* Skipped bytes are read in full buffers however short the
+		 * window is, only the bytes to dump are limited by it.
+		 */
+		if (skip > 0 && skip < want)
+			want = skip;
+		else if (skip == 0 && left < want)
+			want = left;
+		while (len < want) {
+			ssize_t n = read(fd, in + len, want - len);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0) {
+				perror("read");
+				goto out;
+			}
+			if (n == 0) {
+				eof = true;
+				break;
+			}
+			len += n;
+		}
+		if (skip > 0) {
+			skip -= len;
+			continue;
+		}
+		if (stats_update(in, len) != 0)
+			goto out;
+		size_t n = dump_on ? dump_block(out, in, len, offset) : 0;
+		if (!dump_on)
+			*offset += len;
+		if (write_all(STDOUT_FILENO, out, n) != 0)
+			goto out;
+		left -= len;
+	}
+	rc = 0;
+out:
+	if (in)
+		munmap(in, STREAM_READ);
+	if (out)
+		munmap(out, out_size);
+	return rc;
+}
+
+/* With --pattern, every match in a window is printed with `context` lines
+ * of the dump before and after it. Matches whose context lines touch are
+ * printed as one group, and groups are separated by "--" like grep -C does.
+ */
+static struct byte_pattern pattern;
+static uint64_t context = 1;
+static uint64_t search_groups;
+
+struct search_group {
+	uint64_t start, end; /* lines to print, relative to the window */
+	uint64_t first; /* first match */
+	uint64_t count;
+};
+
+static int print_group(const char *in, struct window w,
+		       const struct search_group *g, char *out)
+{
+	uint64_t offset = w.start + g->start;
+	int n = 0;
+
+	if (search_groups++ > 0)
+		n = sprintf(out, "--\n");
+	n += sprintf(out + n, "match 0x%.8" PRIx64, w.start + g->first);
+	if (g->count > 1)
+		n += sprintf(out + n, " (+%" PRIu64 " more)", g->count - 1);
+	out[n++] = '\n';
+	if (write_all(STDOUT_FILENO, out, n) != 0)
+		return -1;
+
+	squeeze_reset();
+	for (uint64_t pos = g->start; pos < g->end; pos += IN_CHUNK) {
+		size_t len = g->end - pos < IN_CHUNK ? g->end - pos : IN_CHUNK;
+		size_t k = dump_block(out, in + pos, len, &offset);
+		if (write_all(STDOUT_FILENO, out, k) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int search_window(int fd, struct window w)
+{
+	const uint8_t *in, *end, *m;
+	struct search_group g = { 0 };
+	uint64_t ctx = context * 16;
+	void *base;
+	size_t base_len;
+	char *out;
+	int rc = -1;
+
+	in = (const uint8_t *)map_window(fd, w.start, w.len, &base, &base_len);
+	if (!in)
+		return rc;
+	out = alloc_buf(OUT_CHUNK);
+	if (!out)
+		goto unmap;
+
+	end = in + w.len;
+	for (m = in; (m = byte_search(&pattern, m, end - m)); m++) {
+		uint64_t pos = m - in;
+		uint64_t start = pos & ~(uint64_t)15;
+		uint64_t stop = ((pos + pattern.len + 15) & ~(uint64_t)15) + ctx;
+
+		start = start > ctx ? start - ctx : 0;
+		if (stop > w.len)
+			stop = w.len;
+		if (g.count > 0 && start <= g.end) {
+			if (stop > g.end)
+				g.end = stop;
+			g.count++;
+			continue;
+		}
+		if (g.count > 0 && print_group((const char *)in, w, &g, out))
+			goto free_out;
+		g = (struct search_group){ start, stop, pos, 1 };
+	}
+	if (g.count > 0 && print_group((const char *)in, w, &g, out))
+		goto free_out;
+	rc = 0;
+free_out:
+	munmap(out, OUT_CHUNK);
+unmap:
+	munmap(base, base_len);
+	return rc;
+}
+
+/* With --diff, the window of a second file is compared with the input and
+ * only the lines that differ are printed, both side by side. Identical
+ * stretches are skipped with a vector compare without formatting them.
+ * The changed byte ranges are summed up at the end.
+ */
+static struct {
+	const char *name[2];
+	int fd;
+	int64_t size;
+	struct window *ranges; /* changed bytes, file offsets */
+	size_t nranges, cap;
+	uint64_t bytes;
+} diff = { .fd = -1 };
+
+#define DIFF_LINE_LEN (MAX_OFFSET_LEN + 56 + 3 + 56 + 1)
+
+/* Hex and ascii columns of n bytes. A short line is padded with spaces to
+ * the width of a full one, but its length leaves out the padding.
+ */
+static int diff_half(char *out, const char *buf, int n)
+{
+	if (n == 16) {
+		conv_line_cols(out, buf);
+		return 56;
+	}
+	memset(out, ' ', 56);
+	for (int i = 0; i < n; i++) {
+		uint8_t b = buf[i];
+
+		memcpy(out + 5 * (i / 2) + 2 * (i & 1), &hex_pairs_lower[2 * b],
+		       2);
+		out[40 + i] = ascii_char(b);
+	}
+	return 40 + n;
+}
+
+static int diff_range(uint64_t start, uint64_t end)
+{
+	if (diff.nranges == diff.cap) {
+		size_t cap = diff.cap ? 2 * diff.cap : 64;
+		struct window *p = realloc(diff.ranges, cap * sizeof(*p));
+
+		if (!p) {
+			perror("diff");
+			return -1;
+		}
+		diff.ranges = p;
+		diff.cap = cap;
+	}
+	diff.ranges[diff.nranges++] = (struct window){ start, end - start };
+	diff.bytes += end - start;
+	return 0;
+}
+
+/* Length of the part of `w` within a file of `size` bytes */
+static uint64_t clamp_window(struct window w, uint64_t size)
+{
+	uint64_t start = w.start < size ? w.start : size;
+
+	return w.len < size - start ? w.len : size - start;
+}
+
+static int diff_window(int fd, int64_t size, struct window w)
+{
+	uint64_t la = clamp_window(w, size), lb = clamp_window(w, diff.size);
+	uint64_t common = la < lb ? la : lb;
+	const char *a = NULL, *b = NULL;
+	void *base[2] = { NULL, NULL };
+	size_t base_len[2];
+	char *out, *p;
+	uint64_t pos = 0, rstart = 0;
+	bool open = false;
+	int rc = -1;
+
+	out = alloc_buf(OUT_CHUNK);
+	if (!out)
+		return rc;
+	if (common > 0 &&
+	    (!(a = map_window(fd, w.start, common, &base[0], &base_len[0])) ||
+	     !(b = map_window(diff.fd, w.start, common, &base[1],
+			      &base_len[1]))))
+		goto out;
+
+	p = out;
+	while (pos < common) {
+		uint64_t line;
+
+		pos += byte_mismatch((const uint8_t *)a + pos,
+				     (const uint8_t *)b + pos, common - pos);
+		if (pos == common)
+			break;
+		line = pos & ~(uint64_t)15;
+		for (; line < common; line += 16) {
+			int n = common - line < 16 ? common - line : 16;
+
+			if (memcmp(a + line, b + line, n) == 0)
+				break;
+			for (int i = 0; i < n; i++) {
+				if (a[line + i] != b[line + i]) {
+					if (!open)
+						rstart = line + i;
+					open = true;
+				} else if (open) {
+					if (diff_range(w.start + rstart,
+						       w.start + line + i) != 0)
+						goto out;
+					open = false;
+				}
+			}
+			p += write_offset(p, w.start + line);
+			diff_half(p, a + line, n);
+			p += 56;
+			memcpy(p, " | ", 3);
+			p += 3;
+			p += diff_half(p, b + line, n);
+			*p++ = '\n';
+			if (p - out > OUT_CHUNK - DIFF_LINE_LEN) {
+				if (write_all(STDOUT_FILENO, out, p - out) != 0)
+					goto out;
+				p = out;
+			}
+		}
+		/* A short last line leaves `line` past the end */
+		if (open && diff_range(w.start + rstart,
+				       w.start + (line < common ? line : common))
+		    != 0)
+			goto out;
+		open = false;
+		pos = line;
+	}
+	if (write_all(STDOUT_FILENO, out, p - out) != 0)
+		goto out;
+	if (la != lb &&
+	    diff_range(w.start + common, w.start + (la > lb ? la : lb)) != 0)
+		goto out;
+	rc = 0;
+out:
+	for (int i = 0; i < 2; i++)
+		if (base[i])
+			munmap(base[i], base_len[i]);
+	munmap(out, OUT_CHUNK);
+	return rc;
+}
+
+/* The ranges in file order, and the bytes only one of the files has */
+static void diff_summary(int64_t size)
+{
+	for (size_t i = 0; i < diff.nranges; i++) {
+		struct window *r = &diff.ranges[i];
+		uint64_t end = r->start + r->len;
+
+		printf("0x%.8" PRIx64 "-0x%.8" PRIx64 " ", r->start, end);
+		if (r->start >= (uint64_t)size ||
+		    r->start >= (uint64_t)diff.size)
+			printf("only in %s",
+			       diff.name[r->start < (uint64_t)size ? 0 : 1]);
+		else
+			printf("differ");
+		printf(" (%" PRIu64 " bytes)\n", r->len);
+	}
+	printf("%" PRIu64 " bytes in %zu ranges differ\n", diff.bytes,
+	       diff.nranges);
+	fflush(stdout);
+}
+
+/* Size of a regular file or block device, -1 for anything not seekable */
+static int64_t input_size(int fd)
+{
+	struct stat st;
+	uint64_t size;
+
+	if (fstat(fd, &st) != 0)
+		return -1;
+	if (S_ISREG(st.st_mode))
+		return st.st_size;
+	if (S_ISBLK(st.st_mode) && ioctl(fd, BLKGETSIZE64, &size) == 0)
+		return size;
+	return -1;
+}
+
+/* Parses a size with an optional k, m, g or t (binary) suffix */
+static int parse_size(const char *str, uint64_t *val)
+{
+	char *end;
+
+	errno = 0;
+	*val = strtoull(str, &end, 0);
+	if (errno || end == str)
+		return -1;
+	switch (*end) {
+	case 'k':
+	case 'K':
+		*val <<= 10;
+		end++;
+		break;
+	case 'm':
+	case 'M':
+		*val <<= 20;
+		end++;
+		break;
+	case 'g':
+	case 'G':
+		*val <<= 30;
+		end++;
+		break;
+	case 't':
+	case 'T':
+		*val <<= 40;
+		end++;
+		break;
+	}
+	return *end == '\0' ? 0 : -1;
+}
+
+/* "offset:length" or "offset" (to the end), comma separated */
+static int parse_windows(char *str, struct window **ws, int *nws)
+{
+	for (char *tok = strtok(str, ","); tok; tok = strtok(NULL, ",")) {
+		struct window w = { .len = UINT64_MAX };
+		char *colon = strchr(tok, ':');
+		struct window *p;
+
+		if (colon)
+			*colon = '\0';
+		if (parse_size(tok, &w.start) != 0 ||
+		    (colon && parse_size(colon + 1, &w.len) != 0))
+			return -1;
+		p = realloc(*ws, (*nws + 1) * sizeof(**ws));
+		if (!p)
+			return -1;
+		*ws = p;
+		(*ws)[(*nws)++] = w;
+	}
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options] [file]\n"
+		"  -j, --jobs N           format with N threads\n"
+		"  -s, --skip OFFSET      start dumping at OFFSET\n"
+		"  -n, --length LEN       dump at most LEN bytes\n"
+		"  -r, --range OFF[:LEN][,OFF[:LEN]...]\n"
+		"                         dump each of these windows\n"
+		"  -z, --squeeze          print repeated lines as a single '*'\n"
+		"  -f, --format FMT       hexdump (default), xxd, od, plain or c\n"
+		"  -g, --group N          bytes per group for xxd: 1, 2, 4, 8, 16\n"
+		"  -N, --name NAME        array name for the c format\n"
+		"      --stats            print byte statistics to stderr\n"
+		"  -S, --stats-only       print byte statistics instead of a dump\n"
+		"  -b, --block SIZE       entropy of every SIZE bytes (power of\n"
+		"                         two up to 4m), implies --stats\n"
+		"  -H, --histogram        byte histogram, implies --stats\n"
+		"  -p, --pattern HEX      print the matches of HEX, '?' matches\n"
+		"                         any nibble; exits with 1 if none\n"
+		"  -C, --context N        lines around each match (default 1)\n"
+		"  -d, --diff FILE2       print the lines where file and FILE2\n"
+		"                         differ; exits with 1 if they do\n"
+		"Sizes take a k, m, g or t suffix.\n",
+		prog);
+}
+
+static const struct option long_options[] = {
+	{ "jobs", required_argument, NULL, 'j' },
+	{ "skip", required_argument, NULL, 's' },
+	{ "length", required_argument, NULL, 'n' },
+	{ "range", required_argument, NULL, 'r' },
+	{ "squeeze", no_argument, NULL, 'z' },
+	{ "format", required_argument, NULL, 'f' },
+	{ "group", required_argument, NULL, 'g' },
+	{ "name", required_argument, NULL, 'N' },
+	{ "stats", no_argument, NULL, 'T' },
+	{ "stats-only", no_argument, NULL, 'S' },
+	{ "block", required_argument, NULL, 'b' },
+	{ "histogram", no_argument, NULL, 'H' },
+	{ "pattern", required_argument, NULL, 'p' },
+	{ "context", required_argument, NULL, 'C' },
+	{ "diff", required_argument, NULL, 'd' },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL, 0, NULL, 0 },
+};
+
+/* The c format wraps the dump in a declaration, like xxd -i */
+static char *c_array_name(const char *name, const char *file)
+{
+	char *p, *s = strdup(name ? name : file ? file : "data");
+
+	if (!s)
+		return NULL;
+	for (p = s; *p; p++)
+		if (!isalnum((unsigned char)*p))
+			*p = '_';
+	if (isdigit((unsigned char)s[0]))
+		s[0] = '_';
+	return s;
+}
+
+/* The name is written on its own: it comes from the command line or the
+ * input path and has no length limit.
+ */
+static int write_c_header(const char *name)
+{
+	static const char prefix[] = "unsigned char ", suffix[] = "[] = {\n";
+
+	if (write_all(STDOUT_FILENO, prefix, sizeof(prefix) - 1) != 0 ||
+	    write_all(STDOUT_FILENO, name, strlen(name)) != 0)
+		return -1;
+	return write_all(STDOUT_FILENO, suffix, sizeof(suffix) - 1);
+}
+
+static int write_c_footer(const char *name, uint64_t len)
+{
+	static const char prefix[] = "};\nunsigned long long ";
+	char buf[64];
+	int n = snprintf(buf, sizeof(buf), "_len = %" PRIu64 ";\n", len);
+
+	if (write_all(STDOUT_FILENO, prefix, sizeof(prefix) - 1) != 0 ||
+	    write_all(STDOUT_FILENO, name, strlen(name)) != 0)
+		return -1;
+	return write_all(STDOUT_FILENO, buf, n);
+}
+
+/* Statistics go to stderr when they come along with a dump */
+static int report_stats(struct window w, bool whole)
+{
+	FILE *f = dump_on ? stderr : stdout;
+
+	if (byte_stats_finish(stats) != 0) {
+		perror("stats");
+		return -1;
+	}
+	if (!whole)
+		fprintf(f, "0x%.8" PRIx64 "-0x%.8" PRIx64 ":\n", w.start,
+			w.start + stats->total);
+	byte_stats_print(f, stats, w.start, stats_histogram);
+	return fflush(f) == 0 ? 0 : -1;
+}
+
+static int dump_window(int fd, int64_t size, struct window w, bool whole,
+		       int nthreads, uint64_t *total)
+{
+	uint64_t offset = w.start;
+	char end_line[MAX_OFFSET_LEN + 1];
+	int rc;
+
+	if (diff.fd >= 0)
+		return diff_window(fd, size, w);
+	if (size >= 0) {
+		if (w.start > (uint64_t)size)
+			w.start = offset = size;
+		if (w.len > size - w.start)
+			w.len = size - w.start;
+	}
+
+	if (pattern.len > 0)
+		return w.len > 0 ? search_window(fd, w) : 0;
+
+	/* Squeezing depends on the previous line, it can't be split up.
+	 * dump_pread() is the path that knows how to skip holes.
+	 */
+	squeeze_reset();
+	if (stats) {
+		byte_stats_free(stats);
+		byte_stats_init(stats, stats->block_size);
+	}
+	if (size < 0)
+		rc = dump_stream(fd, w, &offset);
+	else if (w.len == 0)
+		rc = 0;
+	else if (nthreads > 1 && w.len > IN_CHUNK && !squeeze.on)
+		rc = dump_parallel(fd, w, nthreads, &offset);
+	else if (whole && !squeeze.on)
+		rc = dump_mapped(fd, w, &offset);
+	else
+		rc = dump_pread(fd, w, &offset);
+	if (rc != 0)
+		return rc;
+	*total += offset - w.start;
+	if (stats && report_stats(w, whole) != 0)
+		return -1;
+	if (!dump_on || !fmt->end_line)
+		return 0;
+
+	/* "0x%.8x :" */
+	int n = write_offset(end_line, offset);
+	end_line[n - 1] = '\n';
+	return write_all(STDOUT_FILENO, end_line, n);
+}
+
+int main(int argc, char *argv[])
+{
+	struct window *ws = NULL;
+	struct window one = { 0, UINT64_MAX };
+	int nws = 0;
+	bool have_one = false;
+	int64_t size;
+	int fd = STDIN_FILENO;
+	int nthreads = 1;
+	const char *format = "hexdump";
+	int group = 2;
+	const char *name = NULL;
+	char *c_name = NULL;
+	uint64_t total = 0;
+	static struct byte_stats window_stats;
+	uint64_t block = 0;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "j:s:n:r:zf:g:N:Sb:Hp:C:d:h",
+				  long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'j':
+			nthreads = atoi(optarg);
+			if (nthreads < 1 || nthreads > 1024)
+				goto usage;
+			break;
+		case 's':
+			if (parse_size(optarg, &one.start) != 0)
+				goto usage;
+			have_one = true;
+			break;
+		case 'n':
+			if (parse_size(optarg, &one.len) != 0)
+				goto usage;
+			have_one = true;
+			break;
+		case 'r':
+			if (parse_windows(optarg, &ws, &nws) != 0)
+				goto usage;
+			break;
+		case 'z':
+			squeeze.on = true;
+			break;
+		case 'f':
+			format = optarg;
+			break;
+		case 'g':
+			group = atoi(optarg);
+			break;
+		case 'N':
+			name = optarg;
+			break;
+		case 'S':
+			dump_on = false;
+			/* fall through */
+		case 'T':
+			stats = &window_stats;
+			break;
+		case 'b':
+			/* Blocks must not straddle the chunks of -j */
+			if (parse_size(optarg, &block) != 0 || block == 0 ||
+			    (block & (block - 1)) || block > IN_CHUNK)
+				goto usage;
+			stats = &window_stats;
+			break;
+		case 'H':
+			stats_histogram = true;
+			stats = &window_stats;
+			break;
+		case 'p':
+			if (byte_pattern_parse(&pattern, optarg) != 0)
+				goto usage;
+			break;
+		case 'C':
+			if (parse_size(optarg, &context) != 0 ||
+			    context > UINT32_MAX)
+				goto usage;
+			break;
+		case 'd':
+			diff.name[1] = optarg;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	fmt = NULL;
+	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+		if (strcmp(format, formats[i].name) == 0)
+			fmt = &formats[i];
+	if (!fmt)
+		goto usage;
+	if (fmt == &formats[1]) {
+		int i = __builtin_ctz(group | 32);
+
+		if (group != 1 << i || i > 4)
+			goto usage;
+		fmt = &xxd_groups[i];
+	}
+	/* A '*' line doesn't compile, and the array must hold every byte */
+	if (fmt == &formats[4])
+		squeeze.on = false;
+	if (argc - optind > 1 || (pattern.len > 0 && stats) ||
+	    (diff.name[1] && (pattern.len > 0 || stats || optind == argc)))
+		goto usage;
+	if (optind < argc) {
+		fd = open(argv[optind], O_RDONLY);
+		if (fd < 0) {
+			perror(argv[optind]);
+			return EINVAL;
+		}
+	}
+
+	size = input_size(fd);
+	if (have_one || nws == 0) {
+		struct window *p = realloc(ws, (nws + 1) * sizeof(*ws));
+		if (!p)
+			return ENOMEM;
+		ws = p;
+		memmove(&ws[1], &ws[0], nws * sizeof(*ws));
+		ws[0] = one;
+		nws++;
+	}
+	/* A pipe can only be read once, front to back */
+	if (size < 0 && nws > 1) {
+		fprintf(stderr, "Multiple ranges need a seekable input\n");
+		return EINVAL;
+	}
+	if (size < 0 && pattern.len > 0) {
+		fprintf(stderr, "Searching needs a seekable input\n");
+		return EINVAL;
+	}
+	if (diff.name[1]) {
+		diff.name[0] = argv[optind];
+		diff.fd = open(diff.name[1], O_RDONLY);
+		if (diff.fd < 0) {
+			perror(diff.name[1]);
+			return EINVAL;
+		}
+		diff.size = input_size(diff.fd);
+		if (size < 0 || diff.size < 0) {
+			fprintf(stderr, "Comparing needs seekable inputs\n");
+			return EINVAL;
+		}
+	}
+
+	if (stats)
+		byte_stats_init(stats, block);
+	if (dump_on && pattern.len == 0 && diff.fd < 0 &&
+	    fmt == &formats[4]) {
+		c_name = c_array_name(name, optind < argc ? argv[optind] : NULL);
+		if (!c_name || write_c_header(c_name) != 0)
+			return EIO;
+	}
+	for (int i = 0; i < nws; i++) {
+		bool whole = !have_one && nws == 1;
+		if (dump_window(fd, size, ws[i], whole, nthreads, &total) != 0)
+			return EIO;
+	}
+	if (c_name && write_c_footer(c_name, total) != 0)
+		return EIO;
+	free(c_name);
+	free(ws);
+	if (stats)
+		byte_stats_free(stats);
+	if (pattern.len > 0) {
+		byte_pattern_free(&pattern);
+		return search_groups > 0 ? 0 : 1;
+	}
+	if (diff.fd >= 0) {
+		diff_summary(size);
+		free(diff.ranges);
+		return diff.nranges > 0 ? 1 : 0;
 	}
-	printf("0x%.8x :\n", offset);
-	free(buf);
-	free(hexbuf);
 	return 0;
+usage:
+	usage(argv[0]);
+	return EINVAL;
 }
 #endif
@@ -1,89 +1,571 @@
-#include <fstream>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <iostream>
-#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "basenc.h"
+#include "byte-buffer.hh"
+#include "hex2binary.h"
+#include "hexcodec.h"
 
 /**
  * Converts a hex file into a binary file.
  * Oppositeof hex-dump which dumps a binary file
  * as a hexa-decimal representation of the contents.
  */
-extern "C" {
-#include "hex2binary.c"
+
+// Input is read and decoded in blocks of this size
+static const size_t block_size = 8 << 20;
+
+static bool write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return false;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+// Whether stdout is a regular file we are at the start of, and can write
+// at any offset: pwrite() ignores the offset with O_APPEND
+static bool stdout_is_file() {
+  struct stat st;
+  return fstat(STDOUT_FILENO, &st) == 0 && S_ISREG(st.st_mode) &&
+         !(fcntl(STDOUT_FILENO, F_GETFL) & O_APPEND) &&
+         lseek(STDOUT_FILENO, 0, SEEK_CUR) == 0;
+}
+
+static void usage(const char *prog) {
+  std::cerr << "Usage: " << prog
+            << " [-v] [-j N | -t | -r | [-b | -u | -B] [-e]] [file]\n"
+            << "  -t  also skip ':' and '-' separators and 0x prefixes\n"
+            << "  -r  read hex-dump output back, like xxd -r\n"
+            << "  -b  base64 instead of hex\n"
+            << "  -u  URL and file name safe base64\n"
+            << "  -B  base32\n"
+            << "  -e  encode to hex, base64 or base32 instead, in lines of "
+               "76 chars\n"
+            << "  -j N  decode hex with N threads, file must be a regular "
+               "file\n"
+            << "  -v  report progress on stderr\n"
+            << "Decodes hex from file (or stdin) to stdout, ignoring "
+               "whitespace.\n";
 }
 
-class Buffer {
- private:
-  char *buf;
-  size_t size;
-  static const size_t init_size;
-
- public:
-  Buffer();
-  Buffer(size_t size);
-  ~Buffer();
-
-  Buffer &operator=(const Buffer &b) = delete;
-  void resizeBuf(size_t newSize);
-  void ensureBufSize(size_t size);
-  inline char *getBuf() { return buf; }
-  inline size_t getSize() { return size; }
+// The hex or the base64/base32 stream, whichever the options ask for
+struct Decoder {
+  int codec;  // enum basenc, or -1 for hex
+  struct hex_stream hs;
+  struct basenc_stream bs;
+
+  Decoder(int codec, int mode) : codec(codec) {
+    hex_stream_init(&hs);
+    hs.mode = mode;
+    basenc_stream_init(&bs, codec);
+  }
+
+  uint64_t offset() const { return codec < 0 ? hs.offset : bs.offset; }
+
+  size_t max_output(size_t n) const {
+    return codec < 0 ? n / 2 + 1 : basenc_decoded_max(codec, n);
+  }
+
+  size_t decode(const char *p, size_t n, char *out, int *error) {
+    return codec < 0 ? hex_stream_decode(&hs, p, n, out, error)
+                     : basenc_stream_decode(&bs, p, n, out, error);
+  }
+
+  int finish(char *out) {
+    return codec < 0 ? hex_stream_finish(&hs, out)
+                     : basenc_stream_finish(&bs, out);
+  }
 };
 
-const size_t Buffer::init_size = 32;
-Buffer::Buffer() : Buffer(init_size) {}
+// -j: the input is mapped and cut into a piece per thread at line
+// boundaries. Every two digits make a byte, so once a first pass has
+// counted the digits of every piece their prefix sums give each piece's
+// place in the output. The second pass decodes all pieces at once, into
+// a preallocated output file with pwrite() if stdout is one, or into
+// memory for a pipe.
+//
+// A byte may have its digits in two pieces. The piece with the first
+// digit finishes it with the next digit after its end, and the piece
+// with the second one skips that.
+struct Piece {
+  const char *begin;
+  const char *end;
+  uint64_t digits = 0;
+  uint64_t first_digit = 0;  // of all pieces before this one
+  const char *error = nullptr;  // the first invalid char
+  int write_error = 0;
+};
+
+// Where the pieces go: out, or the file at fd if out is null
+struct Sink {
+  char *out;
+  int fd;
 
-Buffer::Buffer(size_t size) : buf(nullptr), size(size) {
-  buf = (char *)malloc(size);
-  if (buf == nullptr) {
-    throw std::bad_alloc();
+  bool write(uint64_t offset, const char *p, size_t n) const {
+    while (n > 0) {
+      ssize_t k = pwrite(fd, p, n, offset);
+      if (k < 0 && errno == EINTR) continue;
+      if (k < 0) return false;
+      p += k;
+      n -= k;
+      offset += k;
+    }
+    return true;
   }
+};
+
+static inline bool is_space(char c) {
+  return c == '\n' || c == '\r' || c == ' ' || c == '\t';
 }
 
-Buffer::~Buffer() {
-  free(buf);
-  size = 0;
+static void decode_piece(Piece &p, const Sink &sink, const char *input_end) {
+  const char *c = p.begin;
+  struct hex_stream hs;
+  bytes::ByteBuffer buf;
+  uint64_t offset = (p.first_digit + 1) / 2;
+  int error = 0;
+
+  if (p.digits == 0) return;
+  if (p.first_digit % 2 != 0) {
+    while (is_space(*c)) c++;
+    c++;
+  }
+  hex_stream_init(&hs);
+  if (!sink.out) buf.reserve(block_size / 2 + 1);
+  auto decode = [&](const char *s, size_t n) {
+    char *o = sink.out ? sink.out + offset : buf.write_ptr();
+    size_t k = hex_stream_decode(&hs, s, n, o, &error);
+    if (!sink.out && !sink.write(offset, o, k)) p.write_error = errno;
+    offset += k;
+  };
+  for (size_t i = 0, n = p.end - c; i < n && !error && !p.write_error;
+       i += block_size)
+    decode(c + i, std::min(n - i, block_size));
+  if (error) {
+    p.error = c + hs.offset;
+    return;
+  }
+  if (hs.nibble < 0) return;
+  const char *next = p.end;
+  while (next < input_end && is_space(*next)) next++;
+  // Nothing left: the odd number of digits is reported by the caller
+  if (next < input_end) {
+    decode(next, 1);
+    if (error) p.error = next;
+  }
 }
 
-void Buffer::resizeBuf(size_t newSize) {
-  char *buf2 = (char *)malloc(newSize);
-  if (buf2 == nullptr) throw std::bad_alloc();
-  free(buf);
-  buf = buf2;
-  size = newSize;
+// The work of decode_parallel() on the mapped input
+static int decode_mapped(const char *data, size_t len, unsigned threads,
+                         bool verbose) {
+  const char *end = data + len;
+
+  std::vector<Piece> pieces;
+  const char *begin = data;
+  for (unsigned t = 1; t <= threads; t++) {
+    const char *p = t == threads ? end : data + len / threads * t;
+    if (p < begin) p = begin;
+    const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+    p = nl ? nl + 1 : end;
+    pieces.push_back({begin, p});
+    begin = p;
+  }
+
+  auto run = [&](auto fn) {
+    std::vector<std::thread> workers;
+    for (auto &p : pieces) workers.emplace_back([&] { fn(p); });
+    for (auto &w : workers) w.join();
+  };
+  run([](Piece &p) { p.digits = hex_count_digits(p.begin, p.end - p.begin); });
+  uint64_t digits = 0;
+  for (auto &p : pieces) {
+    p.first_digit = digits;
+    digits += p.digits;
+  }
+
+  uint64_t size = digits / 2;
+  bytes::ByteBuffer buf;
+  Sink sink{nullptr, STDOUT_FILENO};
+  if (stdout_is_file()) {
+    if (posix_fallocate(STDOUT_FILENO, 0, size) != 0 &&
+        ftruncate(STDOUT_FILENO, size) != 0) {
+      std::cerr << "Error writing output: " << strerror(errno) << '\n';
+      return EIO;
+    }
+  } else {
+    buf = bytes::ByteBuffer(size, true);
+    buf.commit(size);
+    sink.out = buf.data();
+  }
+  run([&](Piece &p) { decode_piece(p, sink, end); });
+
+  for (auto &p : pieces) {
+    if (p.write_error) {
+      std::cerr << "Error writing output: " << strerror(p.write_error)
+                << '\n';
+      return EIO;
+    }
+    if (!p.error) continue;
+    // Line and column of the char, both from 1
+    const char *c = p.error, *line = c;
+    uint64_t n = 1 + std::count(data, c, '\n');
+    while (line > data && line[-1] != '\n') line--;
+    std::cerr << "Invalid hex char '" << *c << "' at line " << n
+              << ", column " << c - line + 1 << '\n';
+    return EINVAL;
+  }
+  if (digits % 2 != 0) {
+    std::cerr << "Odd number of hex digits, last one dropped\n";
+    return EINVAL;
+  }
+  if (sink.out && !write_all(STDOUT_FILENO, sink.out, size)) {
+    std::cerr << "Error writing output: " << strerror(errno) << '\n';
+    return EIO;
+  }
+  if (verbose)
+    std::cerr << "decoded " << size << " bytes with " << pieces.size()
+              << " threads\n";
+  return 0;
 }
 
-void Buffer::ensureBufSize(size_t size) {
-  if (size <= this->size) return;
+static int decode_parallel(int fd, const char *name, unsigned threads,
+                           bool verbose) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    std::cerr << "-j needs a regular file\n";
+    return EINVAL;
+  }
+  if (st.st_size == 0) return 0;
+  void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (m == MAP_FAILED) {
+    std::cerr << "Error mapping " << name << ": " << strerror(errno) << '\n';
+    return EIO;
+  }
+  madvise(m, st.st_size, MADV_WILLNEED);
+  int err = decode_mapped(static_cast<const char *>(m), st.st_size, threads,
+                          verbose);
+  munmap(m, st.st_size);
+  return err;
+}
 
-  resizeBuf(size);
+static const size_t line_width = 76;
+
+// Chars that encode() turns `len` bytes into, codec -1 for hex
+static size_t encoded_len(int codec, size_t len) {
+  return codec < 0 ? hex_encoded_len(len, 0, 0)
+                   : basenc_encoded_len(codec, len);
+}
+
+// Encodes whole groups of each block and keeps the bytes of a partial
+// group for the next one. Lines are cut at line_width chars, across
+// blocks.
+static int encode(int fd, const char *name, int codec, bool verbose) {
+  const size_t group = codec < 0 ? 1 : codec == BASE32 ? 5 : 3;
+  bytes::ByteBuffer in(block_size, true);
+  bytes::ByteBuffer text(encoded_len(codec, block_size), true);
+  bytes::ByteBuffer out;
+  size_t column = 0;
+  uint64_t total = 0;
+  bool eof = false;
+
+  while (!eof) {
+    in.reserve(block_size - in.size());
+    ssize_t n = read(fd, in.write_ptr(), in.writable());
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      std::cerr << "Error reading " << name << ": " << strerror(errno)
+                << '\n';
+      return EIO;
+    }
+    in.commit(n);
+    eof = n == 0;
+    size_t len = eof ? in.size() : in.size() / group * group;
+    if (len == 0 && !eof) continue;
+
+    text.reset();
+    text.reserve(encoded_len(codec, len));
+    if (codec < 0)
+      text.commit(hex_encode(text.write_ptr(), in.data(), len, HEX_LOWER, 0,
+                             0));
+    else
+      text.commit(encode_basenc(codec, in.data(), len, text.write_ptr()));
+    in.consume(len);
+    total += len;
+
+    out.reset();
+    out.reserve(text.size() + text.size() / line_width + 2);
+    for (const char *p = text.data(), *end = p + text.size(); p < end;) {
+      size_t k = std::min<size_t>(end - p, line_width - column);
+      out.append(p, k);
+      p += k;
+      column += k;
+      if (column == line_width) {
+        out.append("\n", 1);
+        column = 0;
+      }
+    }
+    if (eof && column > 0) out.append("\n", 1);
+    if (!write_all(STDOUT_FILENO, out.data(), out.size())) {
+      std::cerr << "Error writing output: " << strerror(errno) << '\n';
+      return EIO;
+    }
+    if (verbose) std::cerr << "encoded " << len << " bytes\n";
+  }
+  if (verbose) std::cerr << "encoded " << total << " bytes\n";
+  return 0;
+}
+
+// Output of -r. Bytes go to stdout at the offset of the dump line they
+// come from: a gap before a line is the previous line repeated if it
+// follows a '*', zeros otherwise. Zeros are skipped with lseek() when
+// stdout is a regular file, which keeps sparse files sparse.
+struct DumpOutput {
+  bytes::ByteBuffer buf{block_size, true};
+  uint64_t pos = 0;  // offset of the next byte
+  bool seekable = false;
+  bool hole = false;  // the output ends in a skipped range
+
+  DumpOutput() { seekable = stdout_is_file(); }
+
+  bool flush() {
+    bool ok = write_all(STDOUT_FILENO, buf.data(), buf.size());
+    buf.reset();
+    return ok;
+  }
+
+  bool write(const char *p, size_t n) {
+    buf.append(p, n);
+    pos += n;
+    hole = false;
+    return buf.size() < block_size || flush();
+  }
+
+  bool zeros(uint64_t n) {
+    if (n == 0) return true;
+    if (!seekable) {
+      static const char zero[4096] = {};
+      for (; n > 0; n -= n < sizeof(zero) ? n : sizeof(zero))
+        if (!write(zero, n < sizeof(zero) ? n : sizeof(zero))) return false;
+      return true;
+    }
+    if (!flush() || lseek(STDOUT_FILENO, n, SEEK_CUR) < 0) return false;
+    pos += n;
+    hole = true;
+    return true;
+  }
+
+  // n bytes of `line` repeated, starting with its first byte
+  bool repeat(const char *line, size_t len, uint64_t n) {
+    if (len == 0 || std::count(line, line + len, 0) == (long)len)
+      return zeros(n);
+    for (; n >= len; n -= len)
+      if (!write(line, len)) return false;
+    return write(line, n);
+  }
+
+  bool finish() {
+    if (!flush()) return false;
+    return !hole || ftruncate(STDOUT_FILENO, pos) == 0;
+  }
+};
+
+static int reverse_dump(int fd, const char *name, bool verbose) {
+  bytes::ByteBuffer in(block_size, true);
+  DumpOutput out;
+  char last[16];
+  size_t last_n = 0;
+  bool repeat = false;
+  uint64_t lineno = 0;
+  bool eof = false;
+
+  while (!eof) {
+    in.reserve(block_size);
+    ssize_t n = read(fd, in.write_ptr(), in.writable());
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      std::cerr << "Error reading " << name << ": " << strerror(errno)
+                << '\n';
+      return EIO;
+    }
+    in.commit(n);
+    eof = n == 0;
+
+    for (;;) {
+      const char *p = in.data();
+      const char *eol = static_cast<const char *>(memchr(p, '\n', in.size()));
+      if (!eol && !(eof && !in.empty())) break;
+      size_t len = eol ? eol - p : in.size();
+      uint64_t offset;
+      char bin[16];
+      size_t k;
+      int type = hexdump_parse_line(p, len, &offset, bin, &k);
+      in.consume(eol ? len + 1 : len);
+      lineno++;
+
+      if (type == HEXDUMP_REPEAT) {
+        repeat = true;
+        continue;
+      }
+      if (type == HEXDUMP_BAD || offset < out.pos) {
+        std::cerr << (type == HEXDUMP_BAD ? "Not a hex-dump line "
+                                          : "Offset going backwards on line ")
+                  << lineno << '\n';
+        return EINVAL;
+      }
+      bool ok = repeat ? out.repeat(last, last_n, offset - out.pos)
+                       : out.zeros(offset - out.pos);
+      repeat = false;
+      if (type == HEXDUMP_DATA) {
+        ok = ok && out.write(bin, k);
+        memcpy(last, bin, k);
+        last_n = k;
+      }
+      if (!ok) {
+        std::cerr << "Error writing output: " << strerror(errno) << '\n';
+        return EIO;
+      }
+    }
+  }
+  if (!out.finish()) {
+    std::cerr << "Error writing output: " << strerror(errno) << '\n';
+    return EIO;
+  }
+  if (verbose) std::cerr << "wrote " << out.pos << " bytes\n";
+  return 0;
 }
 
 int main(int argc, char *argv[]) {
-  if (argc < 2) {
-    std::cerr << "File name is needed\n";
-    return 0;
+  bool verbose = false;
+  bool reverse = false;
+  bool encoding = false;
+  int mode = HEX_STRICT;
+  int codec = -1;
+  unsigned threads = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "trbuBej:vh")) != -1) {
+    switch (opt) {
+      case 't':
+        mode = HEX_TOLERANT;
+        break;
+      case 'r':
+        reverse = true;
+        break;
+      case 'b':
+        codec = BASE64;
+        break;
+      case 'u':
+        codec = BASE64URL;
+        break;
+      case 'B':
+        codec = BASE32;
+        break;
+      case 'e':
+        encoding = true;
+        break;
+      case 'j':
+        threads = strtoul(optarg, nullptr, 0);
+        if (threads == 0) {
+          usage(argv[0]);
+          return EINVAL;
+        }
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      default:
+        usage(argv[0]);
+        return EINVAL;
+    }
   }
-  std::ifstream ifs(argv[1], std::ifstream::in);
-  if (!ifs) {
-    std::cerr << "Error opening file " << argv[1] << '\n';
+  if (argc - optind > 1 ||
+      (encoding && (reverse || threads || mode != HEX_STRICT)) ||
+      (codec >= 0 && (reverse || mode != HEX_STRICT)) ||
+      (threads && (codec >= 0 || reverse || mode != HEX_STRICT))) {
+    usage(argv[0]);
     return EINVAL;
   }
-  int error;
-  Buffer buf;
-  std::string line;
-  std::getline(ifs, line);
-  while (ifs) {
-    buf.ensureBufSize(line.size());
-    size_t s = decode_hex_to_binary(line.c_str(), line.size(), buf.getBuf(),
-                                    buf.getSize(), &error);
-    std::cerr << "decoded bytes s = " << s << "\n";
-    if (error == -1) {
-      std::cerr << "Error decoding hex string: " << line << '\n';
+
+  int fd = STDIN_FILENO;
+  const char *name = "stdin";
+  if (optind < argc && strcmp(argv[optind], "-") != 0) {
+    name = argv[optind];
+    fd = open(name, O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "Error opening file " << name << '\n';
+      return EINVAL;
     }
-    for (size_t i = 0; i < s; ++i) {
-      std::cout << buf.getBuf()[i];
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  if (reverse) return reverse_dump(fd, name, verbose);
+  if (encoding) return encode(fd, name, codec, verbose);
+  if (threads) return decode_parallel(fd, name, threads, verbose);
+
+  // Both buffers are sized once and reset for every block
+  Decoder dec(codec, mode);
+  const char *what = codec < 0 ? "hex" : codec == BASE32 ? "base32" : "base64";
+  bytes::ByteBuffer in(block_size, true);
+  bytes::ByteBuffer out(dec.max_output(block_size), true);
+  uint64_t total = 0;
+  for (;;) {
+    in.reset();
+    out.reset();
+    ssize_t n = read(fd, in.write_ptr(), in.writable());
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      std::cerr << "Error reading " << name << ": " << strerror(errno)
+                << '\n';
+      return EIO;
     }
-    std::getline(ifs, line);
+    if (n == 0) break;
+
+    int error;
+    uint64_t start = dec.offset();
+    in.commit(n);
+    out.reserve(dec.max_output(n));
+    out.commit(dec.decode(in.data(), n, out.write_ptr(), &error));
+    size_t s = out.size();
+    if (!write_all(STDOUT_FILENO, out.data(), s)) {
+      std::cerr << "Error writing output: " << strerror(errno) << '\n';
+      return EIO;
+    }
+    total += s;
+    if (verbose)
+      std::cerr << "decoded " << s << " bytes from " << dec.offset() - start
+                << " chars\n";
+    if (error) {
+      char c = in.data()[dec.offset() - start];
+      std::cerr << "Invalid " << what << " char '" << c << "' at offset "
+                << dec.offset() << '\n';
+      return EINVAL;
+    }
+  }
+  char tail[4];
+  int k = dec.finish(tail);
+  if (k < 0) {
+    if (codec < 0)
+      std::cerr << "Odd number of hex digits, last one dropped\n";
+    else
+      std::cerr << "Input ends in the middle of a " << what << " group\n";
+    return EINVAL;
+  }
+  if (!write_all(STDOUT_FILENO, tail, k)) {
+    std::cerr << "Error writing output: " << strerror(errno) << '\n';
+    return EIO;
   }
+  total += k;
+  if (verbose) std::cerr << "decoded " << total << " bytes\n";
   return 0;
 }
@@ -1,20 +1,15 @@
 
+#include "hex2binary.h"
+#include "hexcodec.h"
+
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
-static inline unsigned char int_val(char hex)
-{
-	if ('0' <= hex && hex <= '9') {
-		return hex - '0';
-	}
-	if ('a' <= hex && hex <= 'f') {
-		return hex - 'a' + 10;
-	}
-	if ('A' <= hex && hex <= 'F') {
-		return hex - 'A' + 10;
-	}
-	return 0xff;
-}
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
 
 /**
  * This program converts a hex-string into
@@ -33,8 +28,8 @@ size_t decode_hex_to_binary(const char *hex, size_t hexlen, char *bin,
 	size_t i = 0; // hex buffer
 	size_t j = 0; // bin buffer
 	if (hexlen % 2 != 0) {
-		unsigned char b = int_val(hex[i++]);
-		if (b == 0xff) {
+		int b = hex_digit_value(hex[i++]);
+		if (b < 0) {
 			fprintf(stderr,
 				"Invalid hex string. offending char = '%c'\n",
 				hex[i - 1]);
@@ -42,17 +37,531 @@ size_t decode_hex_to_binary(const char *hex, size_t hexlen, char *bin,
 		}
 		bin[j++] = b;
 	}
-	for (; i < hexlen && j < buflen;) {
-		unsigned char b1 = int_val(hex[i++]);
-		unsigned char b2 = int_val(hex[i++]);
-		if (b1 == 0xff || b2 == 0xff) {
-			fprintf(stderr,
-				"Invalid hex string. offending char = %c%c\n",
-				hex[i - 2], hex[i - 1]);
-			return j;
-		}
-		bin[j++] = (b1 << 4) | b2;
+	size_t n = buflen - j;
+	size_t k = hex_decode_pairs(hex + i, bin + j, n);
+	i += 2 * k;
+	j += k;
+	if (k < n) {
+		fprintf(stderr, "Invalid hex string. offending char = %c%c\n",
+			hex[i], hex[i + 1]);
+		return j;
 	}
 	*error = 0;
 	return j;
 }
+
+void hex_stream_init(struct hex_stream *s)
+{
+	s->offset = 0;
+	s->nibble = -1;
+	s->mode = HEX_STRICT;
+	s->zero = 0;
+}
+
+static inline bool is_hex_space(char c)
+{
+	return c == '\n' || c == '\r' || c == ' ' || c == '\t';
+}
+
+static inline bool is_separator(char c)
+{
+	return is_hex_space(c) || c == ':' || c == '-';
+}
+
+/* The whole pairs of digits of a line go through hex_decode_pairs(), which
+ * stops at the first pair with anything but hex digits in it. The char
+ * there is either whitespace, the first half of a pair split by
+ * whitespace, or an error. Handing over one line at a time lets the
+ * kernels do the last pairs of the line as a vector too.
+ */
+static size_t decode_strict(struct hex_stream *s, const char *hex, size_t len,
+			    char *bin, int *error)
+{
+	const char *p = hex, *end = hex + len;
+	const char *eol = NULL; /* the next '\n', or end */
+	char *out = bin;
+
+	while (p < end) {
+		if (s->nibble < 0 && end - p >= 2) {
+			/* Looked up once per line: a long line of separated
+			 * pairs comes through here once per pair.
+			 */
+			if (!eol || eol < p) {
+				eol = memchr(p, '\n', end - p);
+				if (!eol)
+					eol = end;
+			}
+			size_t n = (eol - p) / 2;
+			size_t k = hex_decode_pairs(p, out, n);
+
+			p += 2 * k;
+			out += k;
+			if (p == end)
+				break;
+		}
+		if (is_hex_space(*p)) {
+			p++;
+			continue;
+		}
+		int v = hex_digit_value(*p);
+		if (v < 0) {
+			*error = -1;
+			break;
+		}
+		if (s->nibble < 0) {
+			s->nibble = v;
+		} else {
+			*out++ = s->nibble << 4 | v;
+			s->nibble = -1;
+		}
+		p++;
+	}
+	s->offset += p - hex;
+	return out - bin;
+}
+
+/* The tolerant mode first strips everything but the digits from a few KiB
+ * of input into a scratch buffer and then decodes that as whole pairs.
+ * Stripping looks at one more char than it keeps, for the 'x' after a
+ * "0". A "0" at the very end of a piece is held back in s->zero until the
+ * next piece shows whether it starts a prefix.
+ */
+#define STRIP_BLOCK 4096
+#define STRIP_SLACK 64 /* the vector versions store whole vectors */
+
+typedef const char *(*strip_fn)(const char *p, const char *stop,
+				const char *end, char *digits, size_t *n,
+				int *zero);
+
+/* Copies the digits in [p, stop) to digits + *n, dropping separators and
+ * the "0x" of prefixes. `end` is the end of the piece. Returns stop, or
+ * the first invalid char.
+ */
+static const char *strip_scalar(const char *p, const char *stop,
+				const char *end, char *digits, size_t *n,
+				int *zero)
+{
+	size_t k = *n;
+
+	for (; p < stop; p++) {
+		char c = *p;
+
+		if (c == '0' && p + 1 == end) {
+			*zero = 1;
+		} else if (c == '0' && (p[1] | 0x20) == 'x') {
+			p++;
+		} else if (hex_digit_value(c) >= 0) {
+			digits[k++] = c;
+		} else if (!is_separator(c)) {
+			break;
+		}
+	}
+	*n = k;
+	return p;
+}
+
+#ifdef HAVE_X86_SIMD
+/* pshufb masks that move the bytes selected by an 8 bit mask to the
+ * front, in order
+ */
+static uint64_t compress_lut[256];
+
+static void init_compress_lut(void)
+{
+	for (int m = 0; m < 256; m++) {
+		uint64_t v = ~0ull;
+		int k = 0;
+
+		for (int i = 0; i < 8; i++)
+			if (m & 1 << i) {
+				v &= ~(0xffull << 8 * k);
+				v |= (uint64_t)i << 8 * k++;
+			}
+		compress_lut[m] = v;
+	}
+}
+
+/* Bit i is set if byte i of `c` is a hex digit to keep, of `ok` if it is
+ * a digit, a separator or part of a "0x". `next` is `c` one char later.
+ * An 'x' is only part of a "0x" right after the '0': *zx says whether the
+ * char before `c` is such a '0', and is set for the one after it.
+ */
+__attribute__((target("ssse3"))) static inline unsigned
+classify_ssse3(__m128i c, __m128i next, unsigned *ok, unsigned *zx)
+{
+	__m128i lc = _mm_or_si128(c, _mm_set1_epi8(0x20));
+	__m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	__m128i l = _mm_sub_epi8(lc, _mm_set1_epi8('a'));
+	__m128i hex = _mm_or_si128(
+		_mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d),
+		_mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l));
+	__m128i x = _mm_cmpeq_epi8(lc, _mm_set1_epi8('x'));
+	__m128i zero_x = _mm_and_si128(
+		_mm_cmpeq_epi8(c, _mm_set1_epi8('0')),
+		_mm_cmpeq_epi8(_mm_or_si128(next, _mm_set1_epi8(0x20)),
+			       _mm_set1_epi8('x')));
+	__m128i sep = _mm_or_si128(
+		_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')),
+			     _mm_cmpeq_epi8(c, _mm_set1_epi8('\n'))),
+		_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(':')),
+			     _mm_cmpeq_epi8(c, _mm_set1_epi8('-'))));
+
+	sep = _mm_or_si128(sep,
+			   _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\r')),
+					_mm_cmpeq_epi8(c, _mm_set1_epi8('\t'))));
+	unsigned z = _mm_movemask_epi8(zero_x);
+	unsigned after = z << 1 | *zx;
+
+	*ok = (_mm_movemask_epi8(_mm_or_si128(hex, sep)) |
+	       (_mm_movemask_epi8(x) & after)) &
+	      0xffff;
+	*zx = z >> 15;
+	return _mm_movemask_epi8(hex) & ~z;
+}
+
+/* Compress-store of 16 chars as two 8 byte shuffles. A block with an
+ * invalid char is left to the scalar loop.
+ */
+__attribute__((target("ssse3,popcnt"))) static const char *
+strip_ssse3(const char *p, const char *stop, const char *end, char *digits,
+	    size_t *n, int *zero)
+{
+	size_t k = *n;
+	unsigned zx = 0;
+
+	for (; p + 16 <= stop && p + 17 <= end; p += 16) {
+		__m128i c = _mm_loadu_si128((const __m128i *)p);
+		__m128i hi = _mm_srli_si128(c, 8);
+		unsigned ok, keep, prev = zx;
+
+		keep = classify_ssse3(
+			c, _mm_loadu_si128((const __m128i *)(p + 1)), &ok, &zx);
+		if (ok != 0xffff) {
+			zx = prev;
+			break;
+		}
+		c = _mm_shuffle_epi8(
+			c, _mm_loadl_epi64((const __m128i *)&compress_lut[keep &
+									  0xff]));
+		_mm_storel_epi64((__m128i *)(digits + k), c);
+		k += __builtin_popcount(keep & 0xff);
+		hi = _mm_shuffle_epi8(
+			hi, _mm_loadl_epi64((const __m128i *)&compress_lut[keep >>
+									   8]));
+		_mm_storel_epi64((__m128i *)(digits + k), hi);
+		k += __builtin_popcount(keep >> 8);
+	}
+	/* The 'x' of a "0x" split by the last block */
+	p += zx;
+	*n = k;
+	return strip_scalar(p, stop, end, digits, n, zero);
+}
+
+/* The same with 64 chars at a time and a real compress instruction */
+__attribute__((target("avx512bw,avx512vbmi2,popcnt"))) static const char *
+strip_avx512(const char *p, const char *stop, const char *end, char *digits,
+	     size_t *n, int *zero)
+{
+	const __m512i lower = _mm512_set1_epi8(0x20);
+	size_t k = *n;
+	__mmask64 after = 0; /* where an 'x' would follow the '0' of a "0x" */
+
+	for (; p + 64 <= stop && p + 65 <= end; p += 64) {
+		__m512i c = _mm512_loadu_si512(p);
+		__m512i next = _mm512_loadu_si512(p + 1);
+		__m512i lc = _mm512_or_si512(c, lower);
+		__mmask64 hex = _mm512_cmple_epu8_mask(
+			_mm512_sub_epi8(c, _mm512_set1_epi8('0')),
+			_mm512_set1_epi8(9));
+		__mmask64 x, zx, sep;
+
+		hex |= _mm512_cmple_epu8_mask(
+			_mm512_sub_epi8(lc, _mm512_set1_epi8('a')),
+			_mm512_set1_epi8(5));
+		x = _mm512_cmpeq_epi8_mask(lc, _mm512_set1_epi8('x'));
+		zx = _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8('0')) &
+		     _mm512_cmpeq_epi8_mask(_mm512_or_si512(next, lower),
+					    _mm512_set1_epi8('x'));
+		sep = _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8(' ')) |
+		      _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8('\n')) |
+		      _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8(':')) |
+		      _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8('-')) |
+		      _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8('\r')) |
+		      _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8('\t'));
+		if ((hex | (x & (zx << 1 | after)) | sep) != ~0ull)
+			break;
+		after = zx >> 63;
+		hex &= ~zx;
+		_mm512_storeu_si512(digits + k, _mm512_maskz_compress_epi8(hex, c));
+		k += __builtin_popcountll(hex);
+	}
+	p += after;
+	*n = k;
+	return strip_scalar(p, stop, end, digits, n, zero);
+}
+#endif
+
+static strip_fn strip = strip_scalar;
+
+__attribute__((constructor)) static void select_strip(void)
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512bw") &&
+	    __builtin_cpu_supports("avx512vbmi2")) {
+		strip = strip_avx512;
+	} else if (__builtin_cpu_supports("ssse3") &&
+		   __builtin_cpu_supports("popcnt")) {
+		init_compress_lut();
+		strip = strip_ssse3;
+	}
+#endif
+}
+
+/* Decodes n digits that are known to be valid */
+static char *put_digits(struct hex_stream *s, const char *digits, size_t n,
+			char *out)
+{
+	size_t i = 0;
+
+	if (s->nibble >= 0 && n > 0) {
+		*out++ = s->nibble << 4 | hex_digit_value(digits[i++]);
+		s->nibble = -1;
+	}
+	out += hex_decode_pairs(digits + i, out, (n - i) / 2);
+	i += (n - i) & ~(size_t)1;
+	if (i < n)
+		s->nibble = hex_digit_value(digits[i]);
+	return out;
+}
+
+static size_t decode_tolerant(struct hex_stream *s, const char *hex,
+			      size_t len, char *bin, int *error)
+{
+	char digits[STRIP_BLOCK + STRIP_SLACK];
+	const char *p = hex, *end = hex + len;
+	char *out = bin;
+
+	if (s->zero && p < end) {
+		s->zero = 0;
+		if ((*p | 0x20) == 'x')
+			p++;
+		else
+			out = put_digits(s, "0", 1, out);
+	}
+	while (p < end) {
+		const char *stop = end - p > STRIP_BLOCK ? p + STRIP_BLOCK : end;
+		size_t n = 0;
+
+		p = strip(p, stop, end, digits, &n, &s->zero);
+		out = put_digits(s, digits, n, out);
+		if (p < stop) {
+			*error = -1;
+			break;
+		}
+	}
+	s->offset += p - hex;
+	return out - bin;
+}
+
+size_t hex_stream_decode(struct hex_stream *s, const char *hex, size_t len,
+			 char *bin, int *error)
+{
+	*error = 0;
+	if (s->mode == HEX_TOLERANT)
+		return decode_tolerant(s, hex, len, bin, error);
+	return decode_strict(s, hex, len, bin, error);
+}
+
+static uint64_t count_spaces_scalar(const char *p, size_t n)
+{
+	uint64_t k = 0;
+
+	for (size_t i = 0; i < n; i++)
+		k += is_hex_space(p[i]);
+	return k;
+}
+
+#ifdef HAVE_X86_SIMD
+/* The compares give -1 per whitespace char, subtracted from 8 bit
+ * counters that sad_epu8 adds up before they can overflow.
+ */
+#define DEFINE_COUNT_SPACES_FN(name, isa, vec, width, set1, loadu, or,       \
+			       cmpeq, sub, zero, sad, add64, sum)             \
+	__attribute__((target(isa))) static uint64_t name(const char *p,      \
+							  size_t n)           \
+	{                                                                     \
+		vec total = zero();                                           \
+		size_t i = 0;                                                 \
+                                                                              \
+		while (i + width <= n) {                                      \
+			vec acc = zero();                                     \
+                                                                              \
+			for (int k = 0; k < 255 && i + width <= n;            \
+			     k++, i += width) {                               \
+				vec c = loadu((const vec *)(p + i));          \
+				vec s = or(or(cmpeq(c, set1(' ')),            \
+					      cmpeq(c, set1('\n'))),          \
+					   or(cmpeq(c, set1('\r')),           \
+					      cmpeq(c, set1('\t'))));         \
+				acc = sub(acc, s);                            \
+			}                                                     \
+			total = add64(total, sad(acc, zero()));               \
+		}                                                             \
+		return sum(total) + count_spaces_scalar(p + i, n - i);        \
+	}
+
+__attribute__((target("sse2"))) static inline uint64_t sum_sse2(__m128i v)
+{
+	return (uint64_t)_mm_cvtsi128_si64(v) +
+	       (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v));
+}
+
+__attribute__((target("avx2"))) static inline uint64_t sum_avx2(__m256i v)
+{
+	__m128i s = _mm_add_epi64(_mm256_castsi256_si128(v),
+				  _mm256_extracti128_si256(v, 1));
+
+	return (uint64_t)_mm_cvtsi128_si64(s) +
+	       (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(s, s));
+}
+
+DEFINE_COUNT_SPACES_FN(count_spaces_sse2, "sse2", __m128i, 16, _mm_set1_epi8,
+		       _mm_loadu_si128, _mm_or_si128, _mm_cmpeq_epi8,
+		       _mm_sub_epi8, _mm_setzero_si128, _mm_sad_epu8,
+		       _mm_add_epi64, sum_sse2)
+DEFINE_COUNT_SPACES_FN(count_spaces_avx2, "avx2", __m256i, 32,
+		       _mm256_set1_epi8, _mm256_loadu_si256, _mm256_or_si256,
+		       _mm256_cmpeq_epi8, _mm256_sub_epi8, _mm256_setzero_si256,
+		       _mm256_sad_epu8, _mm256_add_epi64, sum_avx2)
+#endif
+
+typedef uint64_t (*count_spaces_fn)(const char *p, size_t n);
+
+/* Picked before main(), as the codec's kernels are, so that the -j
+ * threads only ever read it
+ */
+static count_spaces_fn count_spaces = count_spaces_scalar;
+
+__attribute__((constructor)) static void select_count_spaces(void)
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		count_spaces = count_spaces_avx2;
+	else
+		count_spaces = count_spaces_sse2;
+#endif
+}
+
+uint64_t hex_count_digits(const char *hex, size_t len)
+{
+	return len - count_spaces(hex, len);
+}
+
+int hex_stream_finish(struct hex_stream *s, char *bin)
+{
+	int n = 0;
+
+	if (s->zero) {
+		s->zero = 0;
+		n = put_digits(s, "0", 1, bin) - bin;
+	}
+	return s->nibble < 0 ? n : -1;
+}
+
+/* The hex column of a data line: 8 groups of 4 digits, 39 chars. */
+#define HEXDUMP_COLUMN 39
+
+#ifdef HAVE_X86_SIMD
+/* A whole line has the groups at fixed places. Three overlapping loads
+ * each have groups at 0, 5 and 10, the same shuffle gathers their digits
+ * and the spaces in between are checked with a single compare.
+ */
+__attribute__((target("ssse3"))) static bool hexdump_column_ssse3(
+	const char *col, char *bin)
+{
+	const __m128i gather = _mm_setr_epi8(0, 1, 2, 3, 5, 6, 7, 8, 10, 11,
+					     12, 13, -1, -1, -1, -1);
+	const __m128i spaces = _mm_setr_epi8(-1, -1, -1, -1, ' ', -1, -1, -1,
+					     -1, ' ', -1, -1, -1, -1, ' ', -1);
+	__m128i a = _mm_loadu_si128((const __m128i *)col);
+	__m128i b = _mm_loadu_si128((const __m128i *)(col + 15));
+	__m128i c = _mm_loadu_si128((const __m128i *)(col + 30));
+	__m128i gaps;
+	char digits[48];
+
+	/* Bytes 4, 9 and 14 of the first two loads, 4 of the last one */
+	gaps = _mm_and_si128(_mm_cmpeq_epi8(a, spaces),
+			     _mm_cmpeq_epi8(b, spaces));
+	if ((_mm_movemask_epi8(gaps) & 0x4210) != 0x4210 || col[34] != ' ')
+		return false;
+	_mm_storeu_si128((__m128i *)digits, _mm_shuffle_epi8(a, gather));
+	_mm_storeu_si128((__m128i *)(digits + 12), _mm_shuffle_epi8(b, gather));
+	_mm_storeu_si128((__m128i *)(digits + 24), _mm_shuffle_epi8(c, gather));
+	return hex_decode_pairs(digits, bin, 16) == 16;
+}
+
+static bool column_ssse3;
+
+__attribute__((constructor)) static void select_column(void)
+{
+	__builtin_cpu_init();
+	column_ssse3 = __builtin_cpu_supports("ssse3");
+}
+#endif
+
+/* Any number of digit pairs, with spaces around the groups */
+static bool hexdump_column(const char *col, size_t len, char *bin, size_t *n)
+{
+	char digits[HEXDUMP_COLUMN];
+	size_t k = 0;
+
+	for (size_t i = 0; i < len; i++)
+		if (col[i] != ' ')
+			digits[k++] = col[i];
+	if (k % 2 != 0 || k > 32)
+		return false;
+	*n = k / 2;
+	return hex_decode_pairs(digits, bin, *n) == *n;
+}
+
+int hexdump_parse_line(const char *line, size_t len, uint64_t *offset,
+		       char bin[16], size_t *n)
+{
+	const char *p = line + 2, *end = line + len;
+	size_t width;
+
+	*n = 0;
+	if (len == 1 && line[0] == '*')
+		return HEXDUMP_REPEAT;
+	if (len < 5 || line[0] != '0' || line[1] != 'x')
+		return HEXDUMP_BAD;
+	*offset = 0;
+	for (; p < end && hex_digit_value(*p) >= 0; p++) {
+		if (p - line == 18)
+			return HEXDUMP_BAD;
+		*offset = *offset << 4 | hex_digit_value(*p);
+	}
+	if (p == line + 2 || end - p < 2 || p[0] != ' ' || p[1] != ':')
+		return HEXDUMP_BAD;
+	p += 2;
+	if (p == end)
+		return HEXDUMP_END;
+	if (*p++ != ' ')
+		return HEXDUMP_BAD;
+
+	/* Then a space and an ascii char for every byte */
+#ifdef HAVE_X86_SIMD
+	if (column_ssse3 && end - p == HEXDUMP_COLUMN + 1 + 16 &&
+	    hexdump_column_ssse3(p, bin)) {
+		*n = 16;
+		return HEXDUMP_DATA;
+	}
+#endif
+	width = end - p < HEXDUMP_COLUMN ? end - p : HEXDUMP_COLUMN;
+	if (!hexdump_column(p, width, bin, n) ||
+	    (size_t)(end - p) != HEXDUMP_COLUMN + 1 + *n)
+		return HEXDUMP_BAD;
+	return HEXDUMP_DATA;
+}
@@ -0,0 +1,62 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+size_t decode_hex_to_binary(const char *hex, size_t hexlen, char *bin,
+			    size_t binlen, int *error);
+
+/* What hex_stream_decode() accepts between the digits */
+enum hex_mode {
+	HEX_STRICT, /* whitespace */
+	HEX_TOLERANT, /* whitespace, ':', '-' and "0x" prefixes */
+};
+
+/* Decoder for a hex stream fed in pieces of any size. Separators between
+ * the digits are skipped, and a digit left over at the end of a piece is
+ * paired with the first one of the next piece.
+ */
+struct hex_stream {
+	uint64_t offset; /* chars consumed so far */
+	int nibble; /* the pending high nibble, or -1 */
+	int mode; /* enum hex_mode, HEX_STRICT after hex_stream_init() */
+	int zero; /* the piece ended in a '0' that may start a "0x" */
+};
+
+void hex_stream_init(struct hex_stream *s);
+/* Decodes `len` chars into `bin`, which must have room for len / 2 + 1
+ * bytes. Returns the number of bytes written. On an invalid char *error
+ * is -1 and s->offset is the char's offset in the stream.
+ */
+size_t hex_stream_decode(struct hex_stream *s, const char *hex, size_t len,
+			 char *bin, int *error);
+/* The chars among `len` that aren't whitespace: the number of digits a
+ * strict stream decodes from them if they are all valid.
+ */
+uint64_t hex_count_digits(const char *hex, size_t len);
+/* Writes what is still pending at the end of the stream to `bin`, which
+ * must have room for a byte. Returns the number of bytes written, or -1 if
+ * the stream ended in the middle of a byte.
+ */
+int hex_stream_finish(struct hex_stream *s, char *bin);
+
+/* The kinds of lines in the default layout of hex-dump */
+enum hexdump_line {
+	HEXDUMP_DATA, /* "0x00000010 : 0011 2233 ...  ascii" */
+	HEXDUMP_REPEAT, /* "*", the previous line repeated */
+	HEXDUMP_END, /* "0x00000040 :", the end of a window */
+	HEXDUMP_BAD,
+};
+
+/* Parses a line of hex-dump output, without the newline. Sets *offset for
+ * data and end lines, and decodes the up to 16 bytes of a data line into
+ * `bin`. Returns an enum hexdump_line.
+ */
+int hexdump_parse_line(const char *line, size_t len, uint64_t *offset,
+		       char bin[16], size_t *n);
+
+#ifdef __cplusplus
+}
+#endif
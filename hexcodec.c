@@ -0,0 +1,559 @@
+#include "hexcodec.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+#define HEX_ROW(h, a, b, c, d, e, f)                                        \
+	h "0" h "1" h "2" h "3" h "4" h "5" h "6" h "7" h "8" h "9" h a h b \
+		h c h d h e h f
+#define HEX_PAIRS(a, b, c, d, e, f)                                           \
+	HEX_ROW("0", a, b, c, d, e, f) HEX_ROW("1", a, b, c, d, e, f)         \
+	HEX_ROW("2", a, b, c, d, e, f) HEX_ROW("3", a, b, c, d, e, f)         \
+	HEX_ROW("4", a, b, c, d, e, f) HEX_ROW("5", a, b, c, d, e, f)         \
+	HEX_ROW("6", a, b, c, d, e, f) HEX_ROW("7", a, b, c, d, e, f)         \
+	HEX_ROW("8", a, b, c, d, e, f) HEX_ROW("9", a, b, c, d, e, f)         \
+	HEX_ROW(a, a, b, c, d, e, f) HEX_ROW(b, a, b, c, d, e, f)             \
+	HEX_ROW(c, a, b, c, d, e, f) HEX_ROW(d, a, b, c, d, e, f)             \
+	HEX_ROW(e, a, b, c, d, e, f) HEX_ROW(f, a, b, c, d, e, f)
+
+const char hex_pairs_lower[512] = HEX_PAIRS("a", "b", "c", "d", "e", "f");
+const char hex_pairs_upper[512] = HEX_PAIRS("A", "B", "C", "D", "E", "F");
+
+const signed char hex_digit_values[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+/* The kernels: encode() writes 2n chars, encode_sep() 3n - 1 chars, with
+ * `sep` between every two bytes, encode_sep2() 2n + (n - 1) / 2 chars, with
+ * `sep` between every two groups of 2 bytes. All need n > 0.
+ */
+static void encode_scalar(char *out, const uint8_t *bin, size_t n, int upper)
+{
+	const char *pairs = upper ? hex_pairs_upper : hex_pairs_lower;
+
+	for (size_t i = 0; i < n; i++)
+		memcpy(&out[2 * i], &pairs[2 * bin[i]], 2);
+}
+
+static void encode_sep_scalar(char *out, const uint8_t *bin, size_t n,
+			      int upper, char sep)
+{
+	const char *pairs = upper ? hex_pairs_upper : hex_pairs_lower;
+
+	memcpy(out, &pairs[2 * bin[0]], 2);
+	for (size_t i = 1; i < n; i++) {
+		out[3 * i - 1] = sep;
+		memcpy(&out[3 * i], &pairs[2 * bin[i]], 2);
+	}
+}
+
+static void encode_sep2_scalar(char *out, const uint8_t *bin, size_t n,
+			       int upper, char sep)
+{
+	const char *pairs = upper ? hex_pairs_upper : hex_pairs_lower;
+
+	for (size_t i = 0; i < n; i++) {
+		memcpy(&out[2 * i + i / 2], &pairs[2 * bin[i]], 2);
+		if (i & 1 && i + 1 < n)
+			out[2 * i + i / 2 + 2] = sep;
+	}
+}
+
+static size_t decode_pairs_scalar(const char *hex, uint8_t *bin, size_t n)
+{
+	for (size_t j = 0; j < n; j++, hex += 2) {
+		int b1 = hex_digit_value(hex[0]);
+		int b2 = hex_digit_value(hex[1]);
+		if (b1 < 0 || b2 < 0)
+			return j;
+		bin[j] = (b1 << 4) | b2;
+	}
+	return n;
+}
+
+#ifdef HAVE_X86_SIMD
+/* The 128 bit helpers are always inlined, so that the AVX2 kernels get
+ * VEX encoded copies: going from 256 bit code to legacy SSE code without
+ * a vzeroupper in between is very slow on Intel cores.
+ */
+__attribute__((target("ssse3"))) static ALWAYS_INLINE __m128i
+digit_lut_128(int upper)
+{
+	if (upper)
+		return _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+				     '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+	return _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+			     'a', 'b', 'c', 'd', 'e', 'f');
+}
+
+/* The 32 digits of 16 bytes: the nibbles are looked up with pshufb and
+ * interleaved, high nibble first. *a gets bytes 0..7, *b bytes 8..15.
+ */
+__attribute__((target("ssse3"))) static ALWAYS_INLINE void
+digits16_ssse3(const uint8_t *bin, __m128i lut, __m128i *a, __m128i *b)
+{
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	__m128i in = _mm_loadu_si128((const __m128i *)bin);
+	__m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(in, nibble));
+	__m128i hi = _mm_shuffle_epi8(
+		lut, _mm_and_si128(_mm_srli_epi16(in, 4), nibble));
+
+	*a = _mm_unpacklo_epi8(hi, lo);
+	*b = _mm_unpackhi_epi8(hi, lo);
+}
+
+__attribute__((target("ssse3"))) static ALWAYS_INLINE void
+encode16_ssse3(char *out, const uint8_t *bin, __m128i lut)
+{
+	__m128i a, b;
+
+	digits16_ssse3(bin, lut, &a, &b);
+	_mm_storeu_si128((__m128i *)out, a);
+	_mm_storeu_si128((__m128i *)(out + 16), b);
+}
+
+/* Encoding a byte twice writes the same chars, so a short last block is
+ * done by encoding the last 16 bytes again.
+ */
+__attribute__((target("ssse3"))) static ALWAYS_INLINE void
+encode_128(char *out, const uint8_t *bin, size_t n, int upper)
+{
+	const __m128i lut = digit_lut_128(upper);
+	size_t i = 0;
+
+	if (n < 16) {
+		encode_scalar(out, bin, n, upper);
+		return;
+	}
+	for (; i + 16 <= n; i += 16)
+		encode16_ssse3(out + 2 * i, bin + i, lut);
+	if (i < n)
+		encode16_ssse3(out + 2 * (n - 16), bin + n - 16, lut);
+}
+
+/* 16 bytes to 40 chars in groups of 2 bytes: three shuffles spread the
+ * digits over the 40 chars, the holes get the separator. A last block
+ * leaves out the separator after it.
+ */
+__attribute__((target("ssse3"))) static ALWAYS_INLINE void
+encode_sep2_16_ssse3(char *out, const uint8_t *bin, __m128i lut, __m128i sep,
+		     bool last)
+{
+	const __m128i spread0 = _mm_setr_epi8(0, 1, 2, 3, -1, 4, 5, 6, 7, -1, 8,
+					      9, 10, 11, -1, 12);
+	const __m128i spread1a = _mm_setr_epi8(13, 14, 15, -1, -1, -1, -1, -1,
+					       -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i spread1b = _mm_setr_epi8(-1, -1, -1, -1, 0, 1, 2, 3, -1,
+					       4, 5, 6, 7, -1, 8, 9);
+	const __m128i spread2 = _mm_setr_epi8(10, 11, -1, 12, 13, 14, 15, -1,
+					      -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i holes0 = _mm_setr_epi8(0, 0, 0, 0, -1, 0, 0, 0, 0, -1,
+					     0, 0, 0, 0, -1, 0);
+	const __m128i holes1 = _mm_setr_epi8(0, 0, 0, -1, 0, 0, 0, 0, -1, 0,
+					     0, 0, 0, -1, 0, 0);
+	const __m128i holes2 = _mm_setr_epi8(0, 0, -1, 0, 0, 0, 0, -1, 0, 0,
+					     0, 0, 0, 0, 0, 0);
+	__m128i a, b;
+
+	digits16_ssse3(bin, lut, &a, &b);
+	__m128i out0 = _mm_or_si128(_mm_shuffle_epi8(a, spread0),
+				    _mm_and_si128(holes0, sep));
+	__m128i out1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, spread1a),
+						 _mm_shuffle_epi8(b, spread1b)),
+				    _mm_and_si128(holes1, sep));
+	__m128i out2 = _mm_or_si128(_mm_shuffle_epi8(b, spread2),
+				    _mm_and_si128(holes2, sep));
+
+	_mm_storeu_si128((__m128i *)out, out0);
+	_mm_storeu_si128((__m128i *)(out + 16), out1);
+	if (last)
+		_mm_storel_epi64((__m128i *)(out + 31),
+				 _mm_alignr_epi8(out2, out1, 15));
+	else
+		_mm_storel_epi64((__m128i *)(out + 32), out2);
+}
+
+/* 16 bytes to 48 chars: the digits of 5 1/3 bytes go into each vector,
+ * the holes left by the shuffles get the separator. The last block of a
+ * buffer has no separator after it, its last vector is moved back by one
+ * char to end at the last digit.
+ */
+__attribute__((target("ssse3"))) static ALWAYS_INLINE void
+encode_sep16_ssse3(char *out, const uint8_t *bin, __m128i lut, __m128i sep,
+		   bool last)
+{
+	const __m128i spread0 = _mm_setr_epi8(0, 1, -1, 2, 3, -1, 4, 5, -1, 6,
+					      7, -1, 8, 9, -1, 10);
+	const __m128i spread1a = _mm_setr_epi8(11, -1, 12, 13, -1, 14, 15, -1,
+					       -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i spread1b = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+					       0, 1, -1, 2, 3, -1, 4, 5);
+	const __m128i spread2 = _mm_setr_epi8(-1, 6, 7, -1, 8, 9, -1, 10, 11,
+					      -1, 12, 13, -1, 14, 15, -1);
+	const __m128i holes0 = _mm_setr_epi8(0, 0, -1, 0, 0, -1, 0, 0, -1, 0,
+					     0, -1, 0, 0, -1, 0);
+	const __m128i holes1 = _mm_setr_epi8(0, -1, 0, 0, -1, 0, 0, -1, 0, 0,
+					     -1, 0, 0, -1, 0, 0);
+	const __m128i holes2 = _mm_setr_epi8(-1, 0, 0, -1, 0, 0, -1, 0, 0, -1,
+					     0, 0, -1, 0, 0, -1);
+	__m128i a, b;
+
+	digits16_ssse3(bin, lut, &a, &b);
+	__m128i out0 = _mm_or_si128(_mm_shuffle_epi8(a, spread0),
+				    _mm_and_si128(holes0, sep));
+	__m128i out1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, spread1a),
+						 _mm_shuffle_epi8(b, spread1b)),
+				    _mm_and_si128(holes1, sep));
+	__m128i out2 = _mm_or_si128(_mm_shuffle_epi8(b, spread2),
+				    _mm_and_si128(holes2, sep));
+
+	_mm_storeu_si128((__m128i *)out, out0);
+	_mm_storeu_si128((__m128i *)(out + 16), out1);
+	if (last)
+		_mm_storeu_si128((__m128i *)(out + 31),
+				 _mm_alignr_epi8(out2, out1, 15));
+	else
+		_mm_storeu_si128((__m128i *)(out + 32), out2);
+}
+
+__attribute__((target("ssse3"))) static ALWAYS_INLINE void
+encode_sep_128(char *out, const uint8_t *bin, size_t n, int upper, char sep)
+{
+	const __m128i lut = digit_lut_128(upper);
+	const __m128i seps = _mm_set1_epi8(sep);
+	size_t i = 0;
+
+	if (n < 16) {
+		encode_sep_scalar(out, bin, n, upper, sep);
+		return;
+	}
+	for (; i + 16 < n; i += 16)
+		encode_sep16_ssse3(out + 3 * i, bin + i, lut, seps, false);
+	encode_sep16_ssse3(out + 3 * (n - 16), bin + n - 16, lut, seps, true);
+}
+
+/* Nibble values of 16 hex digits: c - '0' for the digits and
+ * (c | 0x20) - 'a' + 10 for the letters of either case. Each range check
+ * is one unsigned min and a compare. Returns false if any of them is not
+ * a hex digit.
+ */
+__attribute__((target("ssse3"))) static ALWAYS_INLINE bool
+nibbles_ssse3(__m128i c, __m128i *val)
+{
+	__m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	__m128i l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+				 _mm_set1_epi8('a'));
+	__m128i is_d = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+	__m128i is_l = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+
+	l = _mm_add_epi8(l, _mm_set1_epi8(10));
+	*val = _mm_or_si128(_mm_and_si128(is_d, d), _mm_and_si128(is_l, l));
+	return _mm_movemask_epi8(_mm_or_si128(is_d, is_l)) == 0xffff;
+}
+
+/* Decodes 16 bytes, unless there is an invalid digit among the 32.
+ * maddubs multiplies every high nibble by 16 and adds the low one next to
+ * it, packus narrows the 16 bit sums to bytes.
+ */
+__attribute__((target("ssse3"))) static ALWAYS_INLINE bool
+decode16_ssse3(const char *hex, uint8_t *bin)
+{
+	const __m128i weights = _mm_set1_epi16(0x0110);
+	const __m128i *in = (const __m128i *)hex;
+	__m128i a, b;
+
+	if (!nibbles_ssse3(_mm_loadu_si128(in), &a) ||
+	    !nibbles_ssse3(_mm_loadu_si128(in + 1), &b))
+		return false;
+	a = _mm_maddubs_epi16(a, weights);
+	b = _mm_maddubs_epi16(b, weights);
+	_mm_storeu_si128((__m128i *)bin, _mm_packus_epi16(a, b));
+	return true;
+}
+
+/* 32 digits per iteration. A block with an invalid digit is left to the
+ * scalar loop, which finds the exact pair. A short last block is done by
+ * decoding the last 16 pairs again, overlapping the previous block, so
+ * that short lines don't end up in the scalar loop.
+ */
+__attribute__((target("ssse3"))) static ALWAYS_INLINE size_t
+decode_pairs_128(const char *hex, uint8_t *bin, size_t n)
+{
+	size_t j = 0;
+
+	for (; j + 16 <= n; j += 16)
+		if (!decode16_ssse3(hex + 2 * j, bin + j))
+			break;
+	if (j < n && n >= 16 && j + 16 > n &&
+	    decode16_ssse3(hex + 2 * (n - 16), bin + n - 16))
+		return n;
+	return j + decode_pairs_scalar(hex + 2 * j, bin + j, n - j);
+}
+
+/* A short last block of an even count of bytes is done by encoding the
+ * last 16 bytes again, which keeps the groups in place. An odd count ends
+ * in a group of one byte, done by the scalar loop.
+ */
+__attribute__((target("ssse3"))) static ALWAYS_INLINE void
+encode_sep2_128(char *out, const uint8_t *bin, size_t n, int upper, char sep)
+{
+	const __m128i lut = digit_lut_128(upper);
+	const __m128i seps = _mm_set1_epi8(sep);
+	size_t i = 0;
+
+	if (n < 16) {
+		encode_sep2_scalar(out, bin, n, upper, sep);
+		return;
+	}
+	for (; i + 16 < n; i += 16)
+		encode_sep2_16_ssse3(out + 5 * i / 2, bin + i, lut, seps, false);
+	if (i + 16 == n || n % 2 == 0)
+		encode_sep2_16_ssse3(out + 5 * (n - 16) / 2, bin + n - 16, lut,
+				     seps, true);
+	else
+		encode_sep2_scalar(out + 5 * i / 2, bin + i, n - i, upper, sep);
+}
+
+__attribute__((target("ssse3"))) static void
+encode_ssse3(char *out, const uint8_t *bin, size_t n, int upper)
+{
+	encode_128(out, bin, n, upper);
+}
+
+__attribute__((target("ssse3"))) static void
+encode_sep_ssse3(char *out, const uint8_t *bin, size_t n, int upper, char sep)
+{
+	encode_sep_128(out, bin, n, upper, sep);
+}
+
+__attribute__((target("ssse3"))) static void
+encode_sep2_ssse3(char *out, const uint8_t *bin, size_t n, int upper,
+		  char sep)
+{
+	encode_sep2_128(out, bin, n, upper, sep);
+}
+
+__attribute__((target("ssse3"))) static size_t
+decode_pairs_ssse3(const char *hex, uint8_t *bin, size_t n)
+{
+	return decode_pairs_128(hex, bin, n);
+}
+
+/* Same as digits16_ssse3() for 32 bytes. unpack works within 128 bit
+ * lanes, the permutes put the two halves of each lane back in order.
+ */
+__attribute__((target("avx2"))) static inline void
+encode32_avx2(char *out, const uint8_t *bin, __m256i lut)
+{
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	__m256i in = _mm256_loadu_si256((const __m256i *)bin);
+	__m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(in, nibble));
+	__m256i hi = _mm256_shuffle_epi8(
+		lut, _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble));
+	__m256i a = _mm256_unpacklo_epi8(hi, lo);
+	__m256i b = _mm256_unpackhi_epi8(hi, lo);
+
+	_mm256_storeu_si256((__m256i *)out,
+			    _mm256_permute2x128_si256(a, b, 0x20));
+	_mm256_storeu_si256((__m256i *)(out + 32),
+			    _mm256_permute2x128_si256(a, b, 0x31));
+}
+
+__attribute__((target("avx2"))) static void
+encode_avx2(char *out, const uint8_t *bin, size_t n, int upper)
+{
+	const __m256i lut = _mm256_broadcastsi128_si256(digit_lut_128(upper));
+	size_t i = 0;
+
+	if (n < 32) {
+		encode_128(out, bin, n, upper);
+		return;
+	}
+	for (; i + 32 <= n; i += 32)
+		encode32_avx2(out + 2 * i, bin + i, lut);
+	if (i < n)
+		encode32_avx2(out + 2 * (n - 32), bin + n - 32, lut);
+}
+
+/* The separated layout doesn't gain from the wider registers: the
+ * shuffles can't cross lanes. It still wants the VEX encoding.
+ */
+__attribute__((target("avx2"))) static void
+encode_sep_avx2(char *out, const uint8_t *bin, size_t n, int upper, char sep)
+{
+	encode_sep_128(out, bin, n, upper, sep);
+}
+
+__attribute__((target("avx2"))) static void
+encode_sep2_avx2(char *out, const uint8_t *bin, size_t n, int upper, char sep)
+{
+	encode_sep2_128(out, bin, n, upper, sep);
+}
+
+__attribute__((target("avx2"))) static inline bool nibbles_avx2(__m256i c,
+								 __m256i *val)
+{
+	__m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+	__m256i l = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)),
+				    _mm256_set1_epi8('a'));
+	__m256i is_d =
+		_mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+	__m256i is_l =
+		_mm256_cmpeq_epi8(_mm256_min_epu8(l, _mm256_set1_epi8(5)), l);
+
+	l = _mm256_add_epi8(l, _mm256_set1_epi8(10));
+	*val = _mm256_or_si256(_mm256_and_si256(is_d, d),
+			       _mm256_and_si256(is_l, l));
+	return _mm256_movemask_epi8(_mm256_or_si256(is_d, is_l)) == -1;
+}
+
+/* Same as decode16_ssse3() for 32 bytes. packus works within 128 bit
+ * lanes, the permute puts the four 8 byte results back in order.
+ */
+__attribute__((target("avx2"))) static inline bool
+decode32_avx2(const char *hex, uint8_t *bin)
+{
+	const __m256i weights = _mm256_set1_epi16(0x0110);
+	const __m256i *in = (const __m256i *)hex;
+	__m256i a, b;
+
+	if (!nibbles_avx2(_mm256_loadu_si256(in), &a) ||
+	    !nibbles_avx2(_mm256_loadu_si256(in + 1), &b))
+		return false;
+	a = _mm256_maddubs_epi16(a, weights);
+	b = _mm256_maddubs_epi16(b, weights);
+	a = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+	_mm256_storeu_si256((__m256i *)bin, a);
+	return true;
+}
+
+__attribute__((target("avx2"))) static size_t
+decode_pairs_avx2(const char *hex, uint8_t *bin, size_t n)
+{
+	size_t j = 0;
+
+	for (; j + 32 <= n; j += 32)
+		if (!decode32_avx2(hex + 2 * j, bin + j))
+			break;
+	if (j < n && n >= 32 && j + 32 > n &&
+	    decode32_avx2(hex + 2 * (n - 32), bin + n - 32))
+		return n;
+	return j + decode_pairs_128(hex + 2 * j, bin + j, n - j);
+}
+#endif
+
+struct kernels {
+	const char *isa;
+	void (*encode)(char *out, const uint8_t *bin, size_t n, int upper);
+	void (*encode_sep)(char *out, const uint8_t *bin, size_t n, int upper,
+			   char sep);
+	void (*encode_sep2)(char *out, const uint8_t *bin, size_t n, int upper,
+			    char sep);
+	size_t (*decode_pairs)(const char *hex, uint8_t *bin, size_t n);
+};
+
+/* Scalar until the constructor has run, so that other constructors can
+ * use the codec too. Picking the kernels once before main() also keeps
+ * threads from racing to do it on their first call.
+ */
+static struct kernels kernels = {
+	"scalar", encode_scalar, encode_sep_scalar, encode_sep2_scalar,
+	decode_pairs_scalar
+};
+
+__attribute__((constructor)) static void select_kernels(void)
+{
+#ifdef HAVE_X86_SIMD
+	static const struct kernels avx2 = {
+		"avx2", encode_avx2, encode_sep_avx2, encode_sep2_avx2,
+		decode_pairs_avx2
+	};
+	static const struct kernels ssse3 = {
+		"ssse3", encode_ssse3, encode_sep_ssse3, encode_sep2_ssse3,
+		decode_pairs_ssse3
+	};
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		kernels = avx2;
+	else if (__builtin_cpu_supports("ssse3"))
+		kernels = ssse3;
+#endif
+}
+
+const char *hexcodec_isa(void)
+{
+	return kernels.isa;
+}
+
+size_t hex_encoded_len(size_t len, char sep, size_t group)
+{
+	if (len == 0)
+		return 0;
+	if (sep == 0 || group == 0)
+		return 2 * len;
+	return 2 * len + (len - 1) / group;
+}
+
+size_t hex_encode(char *out, const void *bin, size_t len, int flags, char sep,
+		  size_t group)
+{
+	int upper = flags & HEX_UPPER;
+	size_t seps;
+
+	if (len == 0)
+		return 0;
+	if (sep == 0 || group == 0 || group >= len) {
+		kernels.encode(out, bin, len, upper);
+		return 2 * len;
+	}
+	if (group == 1) {
+		kernels.encode_sep(out, bin, len, upper, sep);
+		return 3 * len - 1;
+	}
+	if (group == 2) {
+		kernels.encode_sep2(out, bin, len, upper, sep);
+		return 2 * len + (len - 1) / 2;
+	}
+	/* All the digits in one go, then the groups are moved apart starting
+	 * with the last one, which never overwrites one still to move. Small
+	 * groups make calling the kernel per group far slower than this.
+	 */
+	kernels.encode(out, bin, len, upper);
+	seps = (len - 1) / group;
+	for (size_t i = seps; i > 0; i--) {
+		size_t from = 2 * group * i;
+
+		memmove(out + from + i, out + from,
+			i == seps ? 2 * len - from : 2 * group);
+		out[from + i - 1] = sep;
+	}
+	return 2 * len + seps;
+}
+
+size_t hex_decode_pairs(const char *hex, void *bin, size_t n)
+{
+	return kernels.decode_pairs(hex, bin, n);
+}
@@ -0,0 +1,51 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Hex digit codec shared by hex-dump, hex2binary and the IPv6 parser.
+ * The scalar, SSSE3 or AVX2 kernels are picked once at startup, from
+ * what the CPU supports.
+ */
+
+/* Two digits for every byte value: hex_pairs_lower[2 * b] and
+ * hex_pairs_lower[2 * b + 1]
+ */
+extern const char hex_pairs_lower[512];
+extern const char hex_pairs_upper[512];
+/* Value of a digit of either case, -1 for any other char */
+extern const signed char hex_digit_values[256];
+
+static inline int hex_digit_value(char c)
+{
+	return hex_digit_values[(unsigned char)c];
+}
+
+enum hex_flags {
+	HEX_LOWER = 0,
+	HEX_UPPER = 1, /* 'A'-'F' instead of 'a'-'f' */
+};
+
+/* Chars that hex_encode() writes for `len` bytes */
+size_t hex_encoded_len(size_t len, char sep, size_t group);
+/* Writes two digits per byte, and `sep` after every `group` bytes except
+ * the last ones: "de:ad:be:ef" for a group of 1, "dead beef" for 2. No
+ * separators if `sep` or `group` is 0. Returns the number of chars written,
+ * hex_encoded_len(len, sep, group).
+ */
+size_t hex_encode(char *out, const void *bin, size_t len, int flags, char sep,
+		  size_t group);
+
+/* Decodes the n digit pairs at `hex` into n bytes. Returns the number of
+ * bytes decoded before the first invalid pair, n if there is none.
+ */
+size_t hex_decode_pairs(const char *hex, void *bin, size_t n);
+
+/* "avx2", "ssse3" or "scalar": the kernels in use */
+const char *hexcodec_isa(void);
+
+#ifdef __cplusplus
+}
+#endif
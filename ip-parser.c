@@ -1,5 +1,6 @@
 
 #include "ip-parser.h"
+#include "hexcodec.h"
 
 #include <assert.h>
 #include <limits.h>
@@ -127,15 +128,12 @@ void print_ipv4(uint32_t ip, int mask)
 void print_ipv6(unsigned char buf[16], int prefix)
 {
 	char b[44];
-	snprintf(
-		b, sizeof(b),
-		"%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%"
-		"02x%02x/%-3d",
-		buf[0], buf[1], buf[2], buf[3], buf[4], buf[5], buf[6], buf[7],
-		buf[8], buf[9], buf[10], buf[11], buf[12], buf[13], buf[14],
-		buf[15], prefix);
+	size_t n = hex_encode(b, buf, 16, HEX_LOWER, ':', 2);
+
 	if (prefix < 0)
-		b[39] = '\0';
+		b[n] = '\0';
+	else
+		snprintf(b + n, sizeof(b) - n, "/%-3d", prefix);
 	printf("%s\n", b);
 	return;
 }
@@ -208,19 +206,8 @@ static inline const char *parse_sep(const char *buf, sep_t *separator)
 
 static inline const char *parse_hexdigit(const char *buf, int *hex_val)
 {
-	*hex_val = -1;
-	int c = *buf;
-
-	if (c >= '0' && c <= '9')
-		*hex_val = c - '0';
-	else if (c >= 'a' && c <= 'f')
-		*hex_val = c - 'a' + 10;
-	else if (c >= 'A' && c <= 'F')
-		*hex_val = c - 'A' + 10;
-	else
-		return buf;
-
-	return buf + 1;
+	*hex_val = hex_digit_value(*buf);
+	return *hex_val < 0 ? buf : buf + 1;
 }
 
 static inline const char *parse_hextet(const char *buf, int *hextet_val)
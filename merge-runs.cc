@@ -0,0 +1,370 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "heap.hh"
+
+/**
+ * Merges sorted run files of ip ranges, one range per line:
+ *     0xff000000 - 0xff001000
+ * (the format merge.py reads), into one sorted stream without loading
+ * the runs into memory. Each run is read sequentially through a large
+ * buffer, the current head of every run sits in a heap::MinHeap, and the
+ * output is written from a second thread while the next buffer fills.
+ *
+ * With -c, overlapping and adjacent ranges are coalesced the same way
+ * merge.py's merge_ranges() does, so huge inputs can be sorted into runs,
+ * merged here and only the (much smaller) result handed to merge.py.
+ */
+
+static const size_t kReadBufSize = 4 << 20;
+static const size_t kWriteBufSize = 8 << 20;
+
+struct Range {
+  uint64_t start;
+  uint64_t end;
+};
+
+// The head of one run. Ordered like merge.py's tuple sort, with the run
+// number as the tie breaker to keep the merge stable.
+struct Cursor {
+  uint64_t start;
+  uint64_t end;
+  uint32_t run;
+
+  bool operator<(const Cursor &c) const {
+    if (start != c.start) return start < c.start;
+    if (end != c.end) return end < c.end;
+    return run < c.run;
+  }
+  bool operator>(const Cursor &c) const { return c < *this; }
+  bool operator==(const Cursor &c) const {
+    return start == c.start && end == c.end && run == c.run;
+  }
+  bool operator!=(const Cursor &c) const { return !(*this == c); }
+};
+
+static inline int hex_val(char c) {
+  if ('0' <= c && c <= '9') return c - '0';
+  if ('a' <= c && c <= 'f') return c - 'a' + 10;
+  if ('A' <= c && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static inline const char *skip_blanks(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+  return p;
+}
+
+static const char *parse_hex(const char *p, const char *end, uint64_t *val,
+                             bool *ok) {
+  *ok = false;
+  if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') &&
+      hex_val(p[2]) >= 0)
+    p += 2;
+  uint64_t v = 0;
+  int digits = 0;
+  for (int d; p < end && (d = hex_val(*p)) >= 0; p++, digits++)
+    v = (v << 4) | d;
+  *ok = digits > 0 && digits <= 16;
+  *val = v;
+  return p;
+}
+
+// Parses "start - end" out of one line (without the '\n').
+static bool parse_range(const char *p, const char *end, Range *r) {
+  bool ok;
+  p = parse_hex(skip_blanks(p, end), end, &r->start, &ok);
+  if (!ok) return false;
+  p = skip_blanks(p, end);
+  if (p == end || *p != '-') return false;
+  p = parse_hex(skip_blanks(p + 1, end), end, &r->end, &ok);
+  if (!ok) return false;
+  return skip_blanks(p, end) == end;
+}
+
+class RunReader {
+ private:
+  const char *name;
+  int fd;
+  std::vector<char> buf;
+  size_t pos, len;
+  size_t line;
+  bool eof;
+
+  // Moves the unread tail to the front and refills the rest of the buffer.
+  bool fill() {
+    memmove(buf.data(), buf.data() + pos, len - pos);
+    len -= pos;
+    pos = 0;
+    if (len == buf.size()) buf.resize(2 * buf.size());  // very long line
+    while (!eof && len < buf.size()) {
+      ssize_t n = read(fd, buf.data() + len, buf.size() - len);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) {
+        std::cerr << name << ": " << strerror(errno) << '\n';
+        exit(EXIT_FAILURE);
+      }
+      if (n == 0) eof = true;
+      len += n;
+    }
+    return len > 0;
+  }
+
+ public:
+  RunReader(const char *name)
+      : name(name), fd(-1), buf(kReadBufSize), pos(0), len(0), line(0),
+        eof(false) {
+    fd = open(name, O_RDONLY);
+    if (fd < 0) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+
+  ~RunReader() {
+    if (fd >= 0) close(fd);
+  }
+
+  RunReader(const RunReader &) = delete;
+  RunReader &operator=(const RunReader &) = delete;
+
+  bool ok() const { return fd >= 0; }
+  const char *getName() const { return name; }
+  size_t getLine() const { return line; }
+
+  // Reads the next valid range. Blank, malformed and reversed ranges are
+  // skipped, as merge.py does.
+  bool next(Range *r) {
+    for (;;) {
+      const char *start = buf.data() + pos;
+      const char *nl =
+          static_cast<const char *>(memchr(start, '\n', len - pos));
+      const char *end = nl;
+      if (!nl) {
+        if (!eof) {
+          fill();
+          continue;
+        }
+        if (pos == len) return false;
+        end = buf.data() + len;  // last line without '\n'
+      }
+      pos = (nl ? nl + 1 : end) - buf.data();
+      line++;
+      if (parse_range(start, end, r) && r->start <= r->end) return true;
+    }
+  }
+};
+
+// Double buffered writer: the caller fills one buffer while a background
+// thread write()s the other.
+class AsyncWriter {
+ private:
+  int fd;
+  std::vector<char> bufs[2];
+  size_t fill_len;
+  int filling;
+  bool pending;  // the other buffer is being written
+  bool done;
+  int error;  // errno of the first failed write(), on the writer thread
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::thread writer;
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;) {
+      cv.wait(lock, [this] { return pending || done; });
+      if (!pending) return;
+      std::vector<char> &b = bufs[1 - filling];
+      lock.unlock();
+      int err = write_all(b.data(), b.size());
+      lock.lock();
+      if (err && !error) error = err;
+      pending = false;
+      cv.notify_all();
+    }
+  }
+
+  // Returns 0 or the errno of the failed write().
+  int write_all(const char *p, size_t n) {
+    while (n > 0) {
+      ssize_t w = write(fd, p, n);
+      if (w < 0 && errno == EINTR) continue;
+      if (w < 0) return errno;
+      p += w;
+      n -= w;
+    }
+    return 0;
+  }
+
+  void flip() {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return !pending; });
+    bufs[filling].resize(fill_len);
+    filling = 1 - filling;
+    bufs[filling].resize(kWriteBufSize);
+    fill_len = 0;
+    pending = true;
+    cv.notify_all();
+  }
+
+ public:
+  AsyncWriter(int fd)
+      : fd(fd), fill_len(0), filling(0), pending(false), done(false),
+        error(0) {
+    bufs[0].resize(kWriteBufSize);
+    bufs[1].resize(kWriteBufSize);
+    writer = std::thread(&AsyncWriter::run, this);
+  }
+
+  ~AsyncWriter() { finish(); }
+
+  char *reserve(size_t n) {
+    if (fill_len + n > kWriteBufSize) flip();
+    return bufs[filling].data() + fill_len;
+  }
+
+  void commit(size_t n) { fill_len += n; }
+
+  // Flushes everything. Returns 0, or the errno of the first write that
+  // failed.
+  int finish() {
+    if (writer.joinable()) {
+      if (fill_len > 0) flip();
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        done = true;
+      }
+      cv.notify_all();
+      writer.join();
+    }
+    return error;
+  }
+};
+
+static void emit(AsyncWriter &out, const Range &r) {
+  static const char digits[] = "0123456789abcdef";
+  char *p = out.reserve(2 * 18 + 4);
+  char *s = p;
+  const uint64_t vals[2] = {r.start, r.end};
+  for (int k = 0; k < 2; k++) {
+    uint64_t v = vals[k];
+    int n = 8;
+    while (n < 16 && (v >> (4 * n))) n++;
+    *s++ = '0';
+    *s++ = 'x';
+    for (int i = n - 1; i >= 0; i--) *s++ = digits[(v >> (4 * i)) & 0xf];
+    if (k == 0) {
+      memcpy(s, " - ", 3);
+      s += 3;
+    }
+  }
+  *s++ = '\n';
+  out.commit(s - p);
+}
+
+static void usage(const char *prog) {
+  std::cerr << "Usage: " << prog << " [-c] [-o output] run1 [run2 ...]\n"
+            << "  -c  coalesce overlapping and adjacent ranges\n";
+}
+
+int main(int argc, char *argv[]) {
+  bool coalesce = false;
+  const char *output = nullptr;
+  int opt;
+  while ((opt = getopt(argc, argv, "co:h")) != -1) {
+    switch (opt) {
+      case 'c':
+        coalesce = true;
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return EINVAL;
+    }
+  }
+  if (optind == argc) {
+    usage(argv[0]);
+    return EINVAL;
+  }
+
+  std::vector<std::unique_ptr<RunReader>> runs;
+  for (int i = optind; i < argc; i++) {
+    runs.emplace_back(new RunReader(argv[i]));
+    if (!runs.back()->ok()) {
+      std::cerr << "Error opening file " << argv[i] << '\n';
+      return EINVAL;
+    }
+  }
+
+  int fd = STDOUT_FILENO;
+  if (output) {
+    fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      std::cerr << "Error opening file " << output << '\n';
+      return EINVAL;
+    }
+  }
+
+  std::vector<Cursor> heads;
+  for (uint32_t i = 0; i < runs.size(); i++) {
+    Range r;
+    if (runs[i]->next(&r)) heads.push_back(Cursor{r.start, r.end, i});
+  }
+  heap::MinHeap<Cursor> h(heads.begin(), heads.end());
+
+  int rc = 0;
+  AsyncWriter out(fd);
+  Range cur = {0, 0};
+  bool have_cur = false;
+  while (!h.empty()) {
+    Cursor c = h.top();
+    Range r = {c.start, c.end};
+    Range nr;
+    if (runs[c.run]->next(&nr)) {
+      if (nr.start < r.start || (nr.start == r.start && nr.end < r.end)) {
+        std::cerr << runs[c.run]->getName() << ":" << runs[c.run]->getLine()
+                  << ": run is not sorted\n";
+        rc = EINVAL;
+        break;
+      }
+      // Replace the top in place: one sink instead of a pop and a push.
+      h.top() = Cursor{nr.start, nr.end, c.run};
+      h.sink();
+    } else {
+      h.pop();
+    }
+
+    if (!coalesce) {
+      emit(out, r);
+      continue;
+    }
+    // Sorted input, so only the last range can touch the new one.
+    if (have_cur && (r.start <= cur.end || r.start - cur.end == 1)) {
+      if (r.end > cur.end) cur.end = r.end;
+      continue;
+    }
+    if (have_cur) emit(out, cur);
+    cur = r;
+    have_cur = true;
+  }
+  if (have_cur && rc == 0) emit(out, cur);
+
+  if (int err = out.finish()) {
+    std::cerr << "Error writing output: " << strerror(err) << '\n';
+    rc = EIO;
+  }
+  if (output) close(fd);
+  return rc;
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// A node based pairing heap. Unlike heap::Heap, push() hands out a stable
+// node pointer which can later be passed to decrease_key() in O(1)
+// (amortized o(log n)), which is what graph searches need. Nodes come from a
+// per-heap pool, so there is no new/delete per element. meld() takes over
+// the other heap's pool as well, so its node pointers stay valid.
+
+namespace heap {
+template <typename T, bool U = true>
+class PairingHeap {
+ public:
+  class node {
+   public:
+    const T& value() const {
+      return val;
+    }
+
+   private:
+    friend class PairingHeap;
+    T val;
+    node* child;
+    node* sibling;
+    node* prev;  // parent for the leftmost child, left sibling otherwise
+  };
+
+ private:
+  // Storage for nodes, handed out in geometrically growing chunks. Released
+  // nodes are chained through `sibling` on a free list.
+  class Pool {
+    struct Slot {
+      alignas(node) unsigned char bytes[sizeof(node)];
+    };
+    std::vector<std::unique_ptr<Slot[]>> chunks;
+    size_t chunk_size = 64;
+    size_t chunk_used = 0;
+    node* free_list = nullptr;
+
+   public:
+    node* alloc() {
+      if (free_list) {
+        node* n = free_list;
+        free_list = n->sibling;
+        return n;
+      }
+      if (chunks.empty() || chunk_used == chunk_size) {
+        if (!chunks.empty() && chunk_size < (1 << 16))
+          chunk_size *= 2;
+        chunks.emplace_back(new Slot[chunk_size]);
+        chunk_used = 0;
+      }
+      return reinterpret_cast<node*>(&chunks.back()[chunk_used++]);
+    }
+
+    void free(node* n) {
+      n->sibling = free_list;
+      free_list = n;
+    }
+
+    // Takes over all of other's chunks. Unless this pool is still empty, the
+    // partially used chunk of `other` is not carved any further.
+    void splice(Pool& other) {
+      if (chunks.empty()) {
+        std::swap(chunks, other.chunks);
+        chunk_size = other.chunk_size;
+        chunk_used = other.chunk_used;
+      } else {
+        for (auto& c : other.chunks)
+          chunks.insert(chunks.end() - 1, std::move(c));
+        other.chunks.clear();
+      }
+      while (other.free_list) {
+        node* n = other.free_list;
+        other.free_list = n->sibling;
+        free(n);
+      }
+      other.chunk_size = 64;
+      other.chunk_used = 0;
+    }
+  };
+
+  Pool pool;
+  node* root;
+  size_t count;
+
+  static bool better(const T& a, const T& b) {
+    return U ? a > b : a < b;
+  }
+
+  // Links two roots; the loser becomes the leftmost child of the winner.
+  static node* link(node* a, node* b) {
+    if (better(b->val, a->val))
+      std::swap(a, b);
+    b->prev = a;
+    b->sibling = a->child;
+    if (a->child)
+      a->child->prev = b;
+    a->child = b;
+    a->sibling = nullptr;
+    a->prev = nullptr;
+    return a;
+  }
+
+  // Standard two pass pairing: link the children pairwise left to right,
+  // then fold the pairs right to left.
+  static node* merge_pairs(node* first) {
+    if (!first)
+      return nullptr;
+    node* pairs = nullptr;  // pass one results, in reverse order
+    while (first) {
+      node* a = first;
+      node* b = a->sibling;
+      if (!b) {
+        a->prev = nullptr;
+        a->sibling = pairs;
+        pairs = a;
+        break;
+      }
+      first = b->sibling;
+      node* w = link(a, b);
+      w->sibling = pairs;
+      pairs = w;
+    }
+    node* r = pairs;
+    pairs = pairs->sibling;
+    r->sibling = nullptr;
+    while (pairs) {
+      node* next = pairs->sibling;
+      r = link(r, pairs);
+      pairs = next;
+    }
+    return r;
+  }
+
+  void destroy(node* n) {
+    // Iterative: fold each child list into the sibling chain.
+    while (n) {
+      if (n->child) {
+        node* c = n->child;
+        while (c->sibling) c = c->sibling;
+        c->sibling = n->sibling;
+        n->sibling = n->child;
+        n->child = nullptr;
+      }
+      node* next = n->sibling;
+      n->val.~T();
+      pool.free(n);
+      n = next;
+    }
+  }
+
+ public:
+  PairingHeap() : root(nullptr), count(0) {
+  }
+
+  PairingHeap(const PairingHeap&) = delete;
+  PairingHeap& operator=(const PairingHeap&) = delete;
+
+  ~PairingHeap() {
+    destroy(root);
+  }
+
+  size_t size() const {
+    return count;
+  }
+
+  bool empty() const {
+    return count == 0;
+  }
+
+  const T& top() const {
+    return root->val;
+  }
+
+  node* top_node() const {
+    return root;
+  }
+
+  node* push(const T& elem) {
+    node* n = pool.alloc();
+    new (&n->val) T(elem);
+    n->child = n->sibling = n->prev = nullptr;
+    root = root ? link(root, n) : n;
+    count++;
+    return n;
+  }
+
+  void pop() {
+    node* old = root;
+    root = merge_pairs(old->child);
+    old->val.~T();
+    pool.free(old);
+    count--;
+  }
+
+  // Moves `n` towards the top: `elem` must not be worse than n's current
+  // value (smaller for a MinHeap, larger for a MaxHeap).
+  void decrease_key(node* n, const T& elem) {
+    n->val = elem;
+    if (n == root)
+      return;
+    if (n->prev->child == n)
+      n->prev->child = n->sibling;
+    else
+      n->prev->sibling = n->sibling;
+    if (n->sibling)
+      n->sibling->prev = n->prev;
+    n->sibling = n->prev = nullptr;
+    root = link(root, n);
+  }
+
+  // Moves everything from `other` into this heap in O(1). Node pointers of
+  // `other` remain valid and now belong to this heap.
+  void meld(PairingHeap& other) {
+    if (!other.root)
+      return;
+    pool.splice(other.pool);
+    root = root ? link(root, other.root) : other.root;
+    count += other.count;
+    other.root = nullptr;
+    other.count = 0;
+  }
+};
+
+template <typename T>
+using PairingMinHeap = PairingHeap<T, false>;
+template <typename T>
+using PairingMaxHeap = PairingHeap<T, true>;
+
+}  // namespace heap
@@ -0,0 +1,127 @@
+#include "properties-image.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-s | -m | -i image] [-f file] [key...]\n"
+		"  -f  properties file (default test.properties)\n"
+		"  -s  scan the file once per key instead of indexing it\n"
+		"  -m  index the file mmap()ed in place, without copying it\n"
+		"  -i  look up in an image from properties-compile instead\n"
+		"Prints the value of every key, ENV_CERT_CHAIN by default.\n",
+		prog);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *file = "test.properties";
+	const char *default_key = "ENV_CERT_CHAIN";
+	const char *image = NULL;
+	bool scan = false, map = false;
+	int opt, err = 0;
+
+	while ((opt = getopt(argc, argv, "f:smi:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			file = optarg;
+			break;
+		case 's':
+			scan = true;
+			break;
+		case 'm':
+			map = true;
+			break;
+		case 'i':
+			image = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return EINVAL;
+		}
+	}
+
+	const char *const *keys = (const char *const *)argv + optind;
+	size_t n = argc - optind;
+	if (n == 0) {
+		keys = &default_key;
+		n = 1;
+	}
+
+	struct parse_ctx pctx;
+	init_parse_ctx(&pctx);
+	pctx.white_space = " \t";
+	pctx.comment_prefix = "##";
+
+	if (scan + map + !!image > 1) {
+		usage(argv[0]);
+		return EINVAL;
+	}
+	if (image) {
+		struct props_image img;
+
+		if (props_image_open(&img, image) != 0) {
+			fprintf(stderr, "Error opening %s: %s\n", image,
+				strerror(errno));
+			return -1;
+		}
+		for (size_t i = 0; i < n; i++) {
+			const char *value = props_image_get(&img, keys[i]);
+
+			if (!value) {
+				fprintf(stderr, "%s not found\n", keys[i]);
+				err = -1;
+				continue;
+			}
+			printf("%s = %s\n", keys[i], value);
+		}
+		props_image_close(&img);
+		return err;
+	}
+	if (scan) {
+		for (size_t i = 0; i < n; i++) {
+			char value[MAX_VALUE_SIZE];
+
+			if (parse_key_value_from_file(file, keys[i], value,
+						      &pctx) != 0) {
+				fprintf(stderr, "%s not found\n", keys[i]);
+				err = -1;
+				continue;
+			}
+			printf("%s = %s\n", keys[i], value);
+		}
+		return err;
+	}
+
+	struct props_store store;
+	struct props_view *values = malloc(n * sizeof(*values));
+	int loaded = map ? props_store_map(&store, file, &pctx) :
+			   props_store_load(&store, file, &pctx);
+	if (!values || loaded != 0) {
+		fprintf(stderr, "Error parsing the file: %s\n",
+			strerror(errno));
+		free(values);
+		return -1;
+	}
+	props_store_view_many(&store, keys, n, values);
+	for (size_t i = 0; i < n; i++) {
+		if (!values[i].data) {
+			fprintf(stderr, "%s not found\n", keys[i]);
+			err = -1;
+			continue;
+		}
+		printf("%s = ", keys[i]);
+		fwrite(values[i].data, 1, values[i].len, stdout);
+		putchar('\n');
+	}
+	props_store_free(&store);
+	free(values);
+	return err;
+}
@@ -0,0 +1,63 @@
+#include "properties-image.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <string.h>
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-f file] -o image\n"
+		"  -f  properties file (default test.properties)\n"
+		"  -o  image to write, for properties-cmd -i\n"
+		"Compiles the file into an image that is mmap()ed and looked\n"
+		"up in without parsing.\n",
+		prog);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *file = "test.properties";
+	const char *image = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:o:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			file = optarg;
+			break;
+		case 'o':
+			image = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return EINVAL;
+		}
+	}
+	if (!image || optind != argc) {
+		usage(argv[0]);
+		return EINVAL;
+	}
+
+	/* The rules of properties-cmd */
+	struct parse_ctx pctx;
+	init_parse_ctx(&pctx);
+	pctx.white_space = " \t";
+	pctx.comment_prefix = "##";
+
+	struct props_store store;
+	if (props_store_map(&store, file, &pctx) != 0) {
+		fprintf(stderr, "Error parsing the file: %s\n",
+			strerror(errno));
+		return -1;
+	}
+	int err = props_image_write(&store, image);
+	if (err)
+		fprintf(stderr, "Error writing %s: %s\n", image,
+			strerror(errno));
+	else
+		printf("%zu keys\n", store.count);
+	props_store_free(&store);
+	return err;
+}
@@ -0,0 +1,382 @@
+#define _DEFAULT_SOURCE
+#include "properties-image.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Keys per bucket on average. Fewer means more pilots, and faster
+ * building as fewer keys have to fit together.
+ */
+#define KEYS_PER_BUCKET 4
+/* Seeds to try before giving up, and pilots to try for a bucket before
+ * trying the next seed. The last buckets, of one key each, need about
+ * as many tries as there are keys.
+ */
+#define MAX_SEEDS 16
+#define MAX_TRIES(n) (64 * (uint64_t)(n) + 1024)
+
+static inline uint64_t fmix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/* Part of the image format: it can't change without a new version */
+static inline uint64_t image_hash(const char *s, size_t len, uint64_t seed)
+{
+	uint64_t h = seed ^ (len * 0x9e3779b97f4a7c15ULL);
+	uint64_t w;
+
+	for (; len >= 8; s += 8, len -= 8) {
+		memcpy(&w, s, 8);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+	}
+	if (len > 0) {
+		w = 0;
+		memcpy(&w, s, len);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+	}
+	return fmix64(h);
+}
+
+/* The high half of the hash picks the bucket. The hash XORed with the
+ * pilot and multiplied, so that every bit of it counts, picks the slot.
+ * Both are scaled to the range with a multiply instead of a division.
+ */
+static inline uint32_t image_bucket(uint64_t h, uint32_t nbuckets)
+{
+	return ((h >> 32) * nbuckets) >> 32;
+}
+
+static inline uint32_t image_slot(uint64_t h, uint32_t pilot, uint32_t n)
+{
+	return ((((h ^ pilot) * 0x9e3779b97f4a7c15ULL) >> 32) * n) >> 32;
+}
+
+struct bucket {
+	uint32_t id;
+	uint32_t size;
+	uint32_t start; /* in keys[] */
+};
+
+static int by_size(const void *a, const void *b)
+{
+	const struct bucket *x = a, *y = b;
+
+	if (x->size != y->size)
+		return x->size > y->size ? -1 : 1;
+	return x->id < y->id ? -1 : x->id > y->id;
+}
+
+/* Finds a pilot for every bucket, biggest buckets first, such that the
+ * keys of all of them land on distinct slots. Returns false if two keys
+ * of a bucket hash the same, then no pilot can separate them, or if a
+ * bucket runs out of tries.
+ */
+static bool find_pilots(const uint64_t *hash, uint32_t n, uint32_t nbuckets,
+			uint64_t seed, uint32_t *pilots, uint32_t *slot_of)
+{
+	struct bucket *buckets = calloc(nbuckets, sizeof(*buckets));
+	uint32_t *keys = malloc(n * sizeof(*keys));
+	uint32_t *slots = malloc(n * sizeof(*slots));
+	bool *taken = calloc(n, sizeof(*taken));
+	bool ok = buckets && keys && slots && taken;
+	uint32_t start = 0;
+
+	if (!ok) {
+		errno = ENOMEM;
+		goto out;
+	}
+	for (uint32_t i = 0; i < n; i++)
+		buckets[image_bucket(hash[i], nbuckets)].size++;
+	for (uint32_t b = 0; b < nbuckets; b++) {
+		buckets[b].id = b;
+		buckets[b].start = start;
+		start += buckets[b].size;
+		buckets[b].size = 0;
+	}
+	for (uint32_t i = 0; i < n; i++) {
+		struct bucket *b = &buckets[image_bucket(hash[i], nbuckets)];
+
+		keys[b->start + b->size++] = i;
+	}
+	for (uint32_t b = 0; b < nbuckets; b++)
+		for (uint32_t i = 1; i < buckets[b].size; i++)
+			for (uint32_t j = 0; j < i; j++)
+				if (hash[keys[buckets[b].start + i]] ==
+				    hash[keys[buckets[b].start + j]]) {
+					ok = false;
+					goto out;
+				}
+	qsort(buckets, nbuckets, sizeof(*buckets), by_size);
+
+	for (uint32_t b = 0; b < nbuckets && buckets[b].size > 0; b++) {
+		const uint32_t *k = keys + buckets[b].start;
+		uint32_t size = buckets[b].size;
+
+		for (uint64_t try = 0;; try++) {
+			uint32_t pilot = fmix64(try ^ seed);
+			uint32_t i;
+
+			if (try == MAX_TRIES(n)) {
+				ok = false;
+				goto out;
+			}
+
+			for (i = 0; i < size; i++) {
+				slots[i] = image_slot(hash[k[i]], pilot, n);
+				if (taken[slots[i]])
+					break;
+				taken[slots[i]] = true;
+			}
+			if (i == size) {
+				pilots[buckets[b].id] = pilot;
+				for (i = 0; i < size; i++)
+					slot_of[k[i]] = slots[i];
+				break;
+			}
+			while (i-- > 0)
+				taken[slots[i]] = false;
+		}
+	}
+out:
+	free(buckets);
+	free(keys);
+	free(slots);
+	free(taken);
+	return ok;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t k = write(fd, buf, len);
+
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k < 0)
+			return -1;
+		buf += k;
+		len -= k;
+	}
+	return 0;
+}
+
+/* Written to a temporary file that is renamed over `file`, so that a
+ * process that has the old image mapped keeps reading it intact.
+ */
+static int write_image(const char *file, const char *buf, size_t len)
+{
+	size_t n = strlen(file);
+	char *tmp = malloc(n + sizeof(".XXXXXX"));
+	int fd, err = 0;
+
+	if (!tmp)
+		return -1;
+	memcpy(tmp, file, n);
+	memcpy(tmp + n, ".XXXXXX", sizeof(".XXXXXX"));
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		free(tmp);
+		return -1;
+	}
+	if (fchmod(fd, 0644) != 0 || write_all(fd, buf, len) != 0)
+		err = errno;
+	if (close(fd) != 0 && !err)
+		err = errno;
+	if (!err && rename(tmp, file) != 0)
+		err = errno;
+	if (err)
+		unlink(tmp);
+	free(tmp);
+	errno = err;
+	return err ? -1 : 0;
+}
+
+int props_image_write(const struct props_store *s, const char *file)
+{
+	struct props_image_header hdr = {
+		.magic = PROPS_IMAGE_MAGIC,
+		.version = PROPS_IMAGE_VERSION,
+	};
+	uint64_t *hash = NULL;
+	uint32_t *slot_of = NULL;
+	char *buf = NULL;
+	uint32_t *pilots;
+	struct props_image_slot *slots;
+	char *strings;
+	size_t len;
+	int ret = -1;
+
+	for (size_t i = 0; i < s->count; i++)
+		hdr.strings_size += s->entries[i].key_len +
+				    s->entries[i].value_len + 2;
+	if (s->count > UINT32_MAX || hdr.strings_size > UINT32_MAX) {
+		errno = EFBIG;
+		return -1;
+	}
+	hdr.count = s->count;
+	hdr.nbuckets = (hdr.count + KEYS_PER_BUCKET - 1) / KEYS_PER_BUCKET;
+	len = sizeof(hdr) + hdr.nbuckets * sizeof(*pilots) +
+	      hdr.count * sizeof(*slots) + hdr.strings_size;
+	/* +1 so that an empty file doesn't look like a failed malloc() */
+	hash = malloc((hdr.count + 1) * sizeof(*hash));
+	slot_of = malloc((hdr.count + 1) * sizeof(*slot_of));
+	buf = calloc(1, len);
+	if (!hash || !slot_of || !buf) {
+		errno = ENOMEM;
+		goto out;
+	}
+	pilots = (uint32_t *)(buf + sizeof(hdr));
+	slots = (struct props_image_slot *)(pilots + hdr.nbuckets);
+	strings = (char *)(slots + hdr.count);
+
+	for (; hdr.count > 0; hdr.seed++) {
+		if (hdr.seed == MAX_SEEDS) {
+			errno = EINVAL;
+			goto out;
+		}
+		for (uint32_t i = 0; i < hdr.count; i++)
+			hash[i] = image_hash(s->entries[i].key,
+					     s->entries[i].key_len, hdr.seed);
+		errno = 0;
+		if (find_pilots(hash, hdr.count, hdr.nbuckets, hdr.seed,
+				pilots, slot_of))
+			break;
+		if (errno == ENOMEM)
+			goto out;
+	}
+
+	uint32_t off = 0;
+
+	for (uint32_t i = 0; i < hdr.count; i++) {
+		const struct props_entry *e = &s->entries[i];
+		struct props_image_slot *slot = &slots[slot_of[i]];
+
+		slot->key_off = off;
+		slot->key_len = e->key_len;
+		memcpy(strings + off, e->key, e->key_len);
+		off += e->key_len + 1;
+		slot->value_off = off;
+		slot->value_len = e->value_len;
+		memcpy(strings + off, e->value, e->value_len);
+		off += e->value_len + 1;
+	}
+	memcpy(buf, &hdr, sizeof(hdr));
+	ret = write_image(file, buf, len);
+out:
+	free(hash);
+	free(slot_of);
+	free(buf);
+	return ret;
+}
+
+int props_image_open(struct props_image *img, const char *file)
+{
+	int fd = open(file, O_RDONLY);
+	struct props_image_header hdr;
+	struct stat st;
+	void *p;
+
+	memset(img, 0, sizeof(*img));
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(hdr)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return -1;
+	memcpy(&hdr, p, sizeof(hdr));
+	if (memcmp(hdr.magic, PROPS_IMAGE_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.version != PROPS_IMAGE_VERSION ||
+	    (hdr.count > 0 && hdr.nbuckets == 0) ||
+	    (uint64_t)st.st_size != sizeof(hdr) +
+	    (uint64_t)hdr.nbuckets * sizeof(*img->pilots) +
+	    (uint64_t)hdr.count * sizeof(*img->slots) + hdr.strings_size) {
+		munmap(p, st.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+	img->base = p;
+	img->size = st.st_size;
+	img->count = hdr.count;
+	img->nbuckets = hdr.nbuckets;
+	img->seed = hdr.seed;
+	img->pilots = (const uint32_t *)(img->base + sizeof(hdr));
+	img->slots = (const struct props_image_slot *)(img->pilots +
+						       hdr.nbuckets);
+	img->strings = (const char *)(img->slots + hdr.count);
+	img->strings_size = hdr.strings_size;
+	return 0;
+}
+
+void props_image_close(struct props_image *img)
+{
+	if (img->base)
+		munmap((void *)img->base, img->size);
+	memset(img, 0, sizeof(*img));
+}
+
+/* One hash and one compare. The offsets are checked against the string
+ * table here rather than all of them at open, which would read the whole
+ * image.
+ */
+static inline const struct props_image_slot *
+image_lookup(const struct props_image *img, const char *key, size_t len)
+{
+	const struct props_image_slot *slot;
+	uint64_t h;
+
+	if (img->count == 0)
+		return NULL;
+	h = image_hash(key, len, img->seed);
+	slot = &img->slots[image_slot(
+		h, img->pilots[image_bucket(h, img->nbuckets)], img->count)];
+	if (slot->key_len != len ||
+	    (uint64_t)slot->key_off + len >= img->strings_size ||
+	    (uint64_t)slot->value_off + slot->value_len >= img->strings_size ||
+	    memcmp(img->strings + slot->key_off, key, len) != 0)
+		return NULL;
+	return slot;
+}
+
+const char *props_image_get(const struct props_image *img, const char *key)
+{
+	const struct props_image_slot *slot =
+		image_lookup(img, key, strlen(key));
+
+	return slot ? img->strings + slot->value_off : NULL;
+}
+
+int props_image_view(const struct props_image *img, const char *key,
+		     size_t len, struct props_view *value)
+{
+	const struct props_image_slot *slot = image_lookup(img, key, len);
+
+	if (!slot) {
+		*value = (struct props_view){ NULL, 0 };
+		return -1;
+	}
+	*value = (struct props_view){ img->strings + slot->value_off,
+				      slot->value_len };
+	return 0;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "properties-parser.h"
+
+/* A properties file compiled into a binary image that is mmap()ed and
+ * queried as it is, without parsing anything.
+ *
+ * The image is a header, then the pilots of a minimal perfect hash over
+ * the keys, then one slot per key, then the keys and values NUL
+ * terminated in a packed string table. A lookup hashes the key once,
+ * picks a bucket from the hash, XORs the hash with the pilot of the
+ * bucket to get the slot, and compares the key of that slot: a key that
+ * isn't in the file lands on some other key's slot.
+ *
+ * Numbers are in the byte order of the machine that wrote the image, an
+ * image from the other order is rejected.
+ */
+#define PROPS_IMAGE_MAGIC "PROPSIMG"
+#define PROPS_IMAGE_VERSION 1
+
+struct props_image_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t count; /* keys and slots */
+	uint32_t nbuckets; /* and pilots */
+	uint32_t reserved;
+	uint64_t seed;
+	uint64_t strings_size;
+};
+
+/* Offsets into the string table */
+struct props_image_slot {
+	uint32_t key_off;
+	uint32_t key_len;
+	uint32_t value_off;
+	uint32_t value_len;
+};
+
+struct props_image {
+	const char *base; /* the mapping */
+	size_t size;
+	uint32_t count;
+	uint32_t nbuckets;
+	uint64_t seed;
+	const uint32_t *pilots;
+	const struct props_image_slot *slots;
+	const char *strings;
+	uint64_t strings_size;
+};
+
+/* Compiles the keys and values of a store, loaded or mapped, into an
+ * image file. Returns 0, or -1 with errno set.
+ */
+int props_image_write(const struct props_store *s, const char *file);
+/* Maps an image. Returns 0, or -1 with errno set, EINVAL if the file is
+ * not an image this version can read.
+ */
+int props_image_open(struct props_image *img, const char *file);
+void props_image_close(struct props_image *img);
+
+/* The value of `key`, or NULL */
+const char *props_image_get(const struct props_image *img, const char *key);
+/* The value of the key [key, key + len). Returns 0, or -1 and an empty
+ * view if the key is missing.
+ */
+int props_image_view(const struct props_image *img, const char *key,
+		     size_t len, struct props_view *value);
+
+#ifdef __cplusplus
+}
+#endif
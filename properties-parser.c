@@ -1,18 +1,16 @@
-#include <bsd/string.h>
+#define _DEFAULT_SOURCE
+#include "properties-parser.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-#define MAX_LINE_SIZE 1024
-#define MAX_VALUE_SIZE 512
-
-struct parse_ctx {
-	const char *white_space;
-	const char *comment_prefix;
-	const char *key_val_separator;
-	const char *value_wrapper;
-};
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /*
  * A line which starts with a '#' is treated as a comment
@@ -106,7 +104,8 @@ int parse_key_value_from_file(const char *file, const char *key,
 			parse_key_value_from_line(line, len, key, pctx);
 		if (_value == NULL)
 			continue;
-		if (strlcpy(value, _value, MAX_VALUE_SIZE) > MAX_VALUE_SIZE)
+		if (snprintf(value, MAX_VALUE_SIZE, "%s", _value) >=
+		    MAX_VALUE_SIZE)
 			fprintf(stderr, "The value of \"%s\" truncated!\n",
 				key);
 		err = 0;
@@ -118,19 +117,414 @@ int parse_key_value_from_file(const char *file, const char *key,
 	return err;
 }
 
-int main()
+
+/* The char sets of a parse_ctx as one lookup per char */
+enum { CHAR_WHITE = 1, CHAR_SEPARATOR = 2, CHAR_WRAPPER = 4 };
+
+static void char_classes(uint8_t cls[256], const struct parse_ctx *pctx)
+{
+	const char *p;
+
+	memset(cls, 0, 256);
+	for (p = pctx->white_space; *p; p++)
+		cls[(uint8_t)*p] |= CHAR_WHITE;
+	for (p = pctx->key_val_separator; *p; p++)
+		cls[(uint8_t)*p] |= CHAR_SEPARATOR;
+	for (p = pctx->value_wrapper; *p; p++)
+		cls[(uint8_t)*p] |= CHAR_WRAPPER;
+}
+
+static inline const char *skip_class(const char *p, const char *end,
+				     const uint8_t cls[256], int c)
 {
-	struct parse_ctx pctx;
-	init_parse_ctx(&pctx);
-	pctx.white_space = " \t";
-	pctx.comment_prefix = "##";
-	const char *key = "ENV_CERT_CHAIN";
-	char value[MAX_VALUE_SIZE];
-	if (parse_key_value_from_file("test.properties", key, value, &pctx) !=
-	    0) {
-		fprintf(stderr, "Error parsing the file\n");
+	while (p < end && (cls[(uint8_t)*p] & c))
+		p++;
+	return p;
+}
+
+static inline const char *find_class(const char *p, const char *end,
+				     const uint8_t cls[256], int c)
+{
+	while (p < end && !(cls[(uint8_t)*p] & c))
+		p++;
+	return p;
+}
+
+/* parse_key_value_from_line() for the line [line, end), which includes
+ * its '\n' if it has one, without modifying it. Returns false if the
+ * line has no key value pair.
+ */
+static bool parse_line(const char *line, const char *end,
+		       const uint8_t cls[256], const struct parse_ctx *pctx,
+		       const char **key, size_t *key_len, const char **value,
+		       size_t *value_len)
+{
+	const char *p = skip_class(line, end, cls, CHAR_WHITE);
+	const char *sep, *k, *open, *close;
+	size_t n;
+
+	if (have_comments(pctx)) {
+		n = strlen(pctx->comment_prefix);
+		if ((size_t)(end - p) >= n &&
+		    memcmp(p, pctx->comment_prefix, n) == 0)
+			return false;
+	}
+	sep = find_class(p, end, cls, CHAR_SEPARATOR);
+	if (sep == end)
+		return false;
+
+	/* A single word, with nothing but whitespace around it */
+	k = find_class(p, sep, cls, CHAR_WHITE);
+	if (skip_class(k, sep, cls, CHAR_WHITE) != sep)
+		return false;
+
+	/* Whitespace, the value in a pair of wrappers, whitespace. The
+	 * original only checks that one char is left after the trailing
+	 * whitespace: the '\n', or anything at the end of the file.
+	 */
+	open = find_class(sep + 1, end, cls, CHAR_WRAPPER);
+	if (open == end || skip_class(sep + 1, open, cls, CHAR_WHITE) != open)
+		return false;
+	close = find_class(open + 1, end, cls, CHAR_WRAPPER);
+	if (close == end ||
+	    end - skip_class(close + 1, end, cls, CHAR_WHITE) != 1)
+		return false;
+
+	*key = p;
+	*key_len = k - p;
+	*value = open + 1;
+	*value_len = close - open - 1;
+	return true;
+}
+
+static inline uint64_t props_hash(const char *s, size_t len)
+{
+	uint64_t h = len * 0x9e3779b97f4a7c15ULL;
+	uint64_t w;
+
+	for (; len >= 8; s += 8, len -= 8) {
+		memcpy(&w, s, 8);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+	}
+	if (len > 0) {
+		w = 0;
+		memcpy(&w, s, len);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+	}
+	return h ^ (h >> 32);
+}
+
+#define PROPS_EMPTY UINT32_MAX
+
+/* Slot of `key`, or of the free slot where it would go */
+static inline size_t props_find(const struct props_store *s, const char *key,
+				size_t len, uint64_t hash)
+{
+	size_t i = hash & s->mask;
+
+	for (; s->index[i] != PROPS_EMPTY; i = (i + 1) & s->mask) {
+		const struct props_entry *e = &s->entries[s->index[i]];
+
+		if (e->key_len == len && memcmp(e->key, key, len) == 0)
+			break;
+	}
+	return i;
+}
+
+static int props_grow_index(struct props_store *s)
+{
+	size_t size = s->mask ? 2 * (s->mask + 1) : 64;
+	uint32_t *index = malloc(size * sizeof(*index));
+
+	if (!index)
+		return -1;
+	memset(index, 0xff, size * sizeof(*index));
+	free(s->index);
+	s->index = index;
+	s->mask = size - 1;
+	for (size_t j = 0; j < s->count; j++) {
+		const struct props_entry *e = &s->entries[j];
+
+		s->index[props_find(s, e->key, e->key_len,
+				    props_hash(e->key, e->key_len))] = j;
+	}
+	return 0;
+}
+
+/* Adds a pair unless the key is there already. The index is kept at most
+ * half full.
+ */
+static int props_insert(struct props_store *s, const char *key, size_t key_len,
+			const char *value, size_t value_len)
+{
+	size_t i;
+
+	if (2 * (s->count + 1) > s->mask + 1 && props_grow_index(s) != 0)
+		return -1;
+	i = props_find(s, key, key_len, props_hash(key, key_len));
+	if (s->index[i] != PROPS_EMPTY)
+		return 0;
+	if (s->count == s->cap) {
+		size_t cap = s->cap ? 2 * s->cap : 64;
+		void *p = realloc(s->entries, cap * sizeof(*s->entries));
+
+		if (!p)
+			return -1;
+		s->entries = p;
+		s->cap = cap;
+	}
+	s->entries[s->count] = (struct props_entry){ key, value, key_len,
+						     value_len };
+	s->index[i] = s->count++;
+	return 0;
+}
+
+static int read_file(const char *file, char **buf, size_t *size)
+{
+	int fd = open(file, O_RDONLY);
+	struct stat st;
+	size_t n = 0;
+
+	*buf = NULL;
+	if (fd < 0)
 		return -1;
+	if (fstat(fd, &st) != 0 || !(*buf = malloc(st.st_size + 1)))
+		goto err;
+	while (n < (size_t)st.st_size) {
+		ssize_t k = read(fd, *buf + n, st.st_size - n);
+
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k < 0)
+			goto err;
+		if (k == 0)
+			break;
+		n += k;
 	}
-	printf("%s = %s\n", key, value);
+	(*buf)[n] = '\0';
+	*size = n;
+	close(fd);
 	return 0;
+err:
+	free(*buf);
+	*buf = NULL;
+	close(fd);
+	return -1;
+}
+
+/* Indexes every key value pair of the arena. With `terminate`, the char
+ * after each key and value is overwritten with a NUL: it is one of the
+ * syntax, which has served its purpose.
+ */
+static int index_lines(struct props_store *s, const struct parse_ctx *pctx,
+		       bool terminate)
+{
+	uint8_t cls[256];
+	const char *p = s->arena, *end = p + s->size;
+
+	char_classes(cls, pctx);
+	while (p < end) {
+		const char *eol = memchr(p, '\n', end - p);
+		const char *next = eol ? eol + 1 : end;
+		const char *key, *value;
+		size_t key_len, value_len;
+
+		if (parse_line(p, next, cls, pctx, &key, &key_len, &value,
+			       &value_len)) {
+			if (props_insert(s, key, key_len, value, value_len)) {
+				errno = ENOMEM;
+				return -1;
+			}
+			if (terminate) {
+				((char *)key)[key_len] = '\0';
+				((char *)value)[value_len] = '\0';
+			}
+		}
+		p = next;
+	}
+	return 0;
+}
+
+int props_store_load(struct props_store *s, const char *file,
+		     const struct parse_ctx *pctx)
+{
+	if (pctx == NULL)
+		pctx = &PCTX;
+	memset(s, 0, sizeof(*s));
+	if (read_file(file, &s->arena, &s->size) != 0)
+		return -1;
+	if (index_lines(s, pctx, true) != 0) {
+		props_store_free(s);
+		return -1;
+	}
+	return 0;
+}
+
+int props_store_map(struct props_store *s, const char *file,
+		    const struct parse_ctx *pctx)
+{
+	int fd = open(file, O_RDONLY);
+	struct stat st;
+	void *p;
+
+	if (pctx == NULL)
+		pctx = &PCTX;
+	memset(s, 0, sizeof(*s));
+	s->mapped = true;
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+	/* mmap() fails for an empty file, which has nothing to map anyway */
+	if (st.st_size > 0) {
+		p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) {
+			close(fd);
+			return -1;
+		}
+		madvise(p, st.st_size, MADV_WILLNEED);
+		s->arena = p;
+		s->size = st.st_size;
+	}
+	close(fd);
+	if (index_lines(s, pctx, false) != 0) {
+		props_store_free(s);
+		return -1;
+	}
+	return 0;
+}
+
+void props_store_free(struct props_store *s)
+{
+	if (s->mapped) {
+		if (s->arena)
+			munmap(s->arena, s->size);
+	} else {
+		free(s->arena);
+	}
+	free(s->entries);
+	free(s->index);
+	memset(s, 0, sizeof(*s));
+}
+
+static inline const struct props_entry *
+props_lookup(const struct props_store *s, const char *key, size_t len)
+{
+	size_t i;
+
+	if (s->count == 0)
+		return NULL;
+	i = props_find(s, key, len, props_hash(key, len));
+	return s->index[i] == PROPS_EMPTY ? NULL : &s->entries[s->index[i]];
+}
+
+const char *props_store_get(const struct props_store *s, const char *key)
+{
+	const struct props_entry *e;
+
+	assert(!s->mapped);
+	e = props_lookup(s, key, strlen(key));
+	return e ? e->value : NULL;
+}
+
+int props_store_view(const struct props_store *s, const char *key,
+		     size_t len, struct props_view *value)
+{
+	const struct props_entry *e = props_lookup(s, key, len);
+
+	if (!e) {
+		*value = (struct props_view){ NULL, 0 };
+		return -1;
+	}
+	*value = (struct props_view){ e->value, e->value_len };
+	return 0;
+}
+
+#define PROPS_BATCH 16
+
+/* The keys are hashed and their slots prefetched first, so that the
+ * cache misses of a batch overlap instead of coming one after the other.
+ * n is at most PROPS_BATCH.
+ */
+static size_t props_lookup_many(const struct props_store *s,
+				const char *const keys[], size_t n,
+				const struct props_entry *found[])
+{
+	uint64_t hash[PROPS_BATCH];
+	size_t len[PROPS_BATCH];
+	size_t count = 0;
+
+	if (s->count == 0) {
+		memset(found, 0, n * sizeof(*found));
+		return 0;
+	}
+	for (size_t j = 0; j < n; j++) {
+		len[j] = strlen(keys[j]);
+		hash[j] = props_hash(keys[j], len[j]);
+		__builtin_prefetch(&s->index[hash[j] & s->mask]);
+	}
+	for (size_t j = 0; j < n; j++) {
+		uint32_t e = s->index[hash[j] & s->mask];
+
+		if (e != PROPS_EMPTY)
+			__builtin_prefetch(&s->entries[e]);
+	}
+	for (size_t j = 0; j < n; j++) {
+		uint32_t e = s->index[props_find(s, keys[j], len[j], hash[j])];
+
+		found[j] = e == PROPS_EMPTY ? NULL : &s->entries[e];
+		count += e != PROPS_EMPTY;
+	}
+	return count;
+}
+
+size_t props_store_get_many(const struct props_store *s,
+			    const char *const keys[], size_t n,
+			    const char *values[])
+{
+	const struct props_entry *found[PROPS_BATCH];
+	size_t count = 0;
+
+	assert(!s->mapped);
+	for (size_t b = 0; b < n; b += PROPS_BATCH) {
+		size_t m = n - b < PROPS_BATCH ? n - b : PROPS_BATCH;
+
+		count += props_lookup_many(s, keys + b, m, found);
+		for (size_t j = 0; j < m; j++)
+			values[b + j] = found[j] ? found[j]->value : NULL;
+	}
+	return count;
+}
+
+size_t props_store_view_many(const struct props_store *s,
+			     const char *const keys[], size_t n,
+			     struct props_view values[])
+{
+	const struct props_entry *found[PROPS_BATCH];
+	size_t count = 0;
+
+	for (size_t b = 0; b < n; b += PROPS_BATCH) {
+		size_t m = n - b < PROPS_BATCH ? n - b : PROPS_BATCH;
+
+		count += props_lookup_many(s, keys + b, m, found);
+		for (size_t j = 0; j < m; j++)
+			values[b + j] = found[j] ?
+				(struct props_view){ found[j]->value,
+						     found[j]->value_len } :
+				(struct props_view){ NULL, 0 };
+	}
+	return count;
+}
+
+char *props_view_dup(struct props_view v)
+{
+	char *s = malloc(v.len + 1);
+
+	if (!s)
+		return NULL;
+	memcpy(s, v.data, v.len);
+	s[v.len] = '\0';
+	return s;
 }
@@ -0,0 +1,98 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define MAX_LINE_SIZE 1024
+#define MAX_VALUE_SIZE 512
+
+struct parse_ctx {
+	const char *white_space;
+	const char *comment_prefix;
+	const char *key_val_separator;
+	const char *value_wrapper;
+};
+
+void init_parse_ctx(struct parse_ctx *ctx);
+char *parse_key_value_from_line(char *line, ssize_t len, const char *key,
+				const struct parse_ctx *pctx);
+int parse_key_value_from_file(const char *file, const char *key,
+			      char value[MAX_VALUE_SIZE],
+			      const struct parse_ctx *pctx);
+
+/* All the key value pairs of a file, parsed once with the rules of
+ * parse_key_value_from_line(). Keys must match exactly. If a key is
+ * there more than once, the first value wins, as with
+ * parse_key_value_from_file().
+ *
+ * The arena holds the whole file and entries[] points into it in file
+ * order. index[] is an open addressing table over entries[]. There are no
+ * limits on the length of lines, keys or values.
+ */
+struct props_entry {
+	const char *key;
+	const char *value;
+	size_t key_len;
+	size_t value_len;
+};
+
+struct props_store {
+	char *arena;
+	size_t size;
+	struct props_entry *entries;
+	size_t count;
+	size_t cap;
+	uint32_t *index; /* entry of every slot, or UINT32_MAX if free */
+	size_t mask;
+	bool mapped; /* arena is the file mmap()ed, not a copy */
+};
+
+/* A string in the arena, not NUL terminated */
+struct props_view {
+	const char *data;
+	size_t len;
+};
+
+/* Reads the file into a malloc()ed arena, with keys and values NUL
+ * terminated in place for props_store_get(). Returns 0, or -1 with errno
+ * set if the file can't be read.
+ */
+int props_store_load(struct props_store *s, const char *file,
+		     const struct parse_ctx *pctx);
+/* Maps the file read only instead and indexes it where it is: nothing is
+ * copied or modified. Values are only available as views.
+ */
+int props_store_map(struct props_store *s, const char *file,
+		    const struct parse_ctx *pctx);
+void props_store_free(struct props_store *s);
+
+/* The value of `key`, or NULL. Loaded stores only. */
+const char *props_store_get(const struct props_store *s, const char *key);
+/* Looks up n keys at once, values[i] is NULL for a missing one. Returns
+ * the number of keys found. Loaded stores only.
+ */
+size_t props_store_get_many(const struct props_store *s,
+			    const char *const keys[], size_t n,
+			    const char *values[]);
+
+/* The value of the key [key, key + len) as a view, for either kind of
+ * store. Returns 0, or -1 and an empty view if the key is missing.
+ */
+int props_store_view(const struct props_store *s, const char *key,
+		     size_t len, struct props_view *value);
+/* props_store_get_many() with views, { NULL, 0 } for a missing key */
+size_t props_store_view_many(const struct props_store *s,
+			     const char *const keys[], size_t n,
+			     struct props_view values[]);
+/* A malloc()ed, NUL terminated copy of a view, for when one is needed */
+char *props_view_dup(struct props_view v);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,283 @@
+#define _DEFAULT_SOURCE
+#include "properties-reload.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/* The epoch a reader saw when it began its read, 0 while it is outside
+ * one. One cache line each, so that readers don't slow each other down.
+ */
+struct reader_slot {
+	alignas(64) atomic_uint_fast64_t epoch;
+	atomic_bool used;
+};
+
+struct props_reloader {
+	_Atomic(struct props_snapshot *) current;
+	atomic_uint_fast64_t epoch;
+	struct reader_slot slots[PROPS_MAX_READERS];
+
+	char *file;
+	const char *name; /* of the file in its directory */
+	struct parse_ctx pctx;
+	pthread_mutex_t reload_lock; /* one reload at a time */
+	uint64_t generation;
+	atomic_uint_fast64_t reloads;
+	atomic_uint_fast64_t errors;
+
+	pthread_t watcher;
+	int inotify_fd;
+	int stop_pipe[2];
+};
+
+static struct props_snapshot *load_snapshot(struct props_reloader *r)
+{
+	struct props_snapshot *snap = malloc(sizeof(*snap));
+
+	if (!snap)
+		return NULL;
+	if (props_store_load(&snap->store, r->file, &r->pctx) != 0) {
+		free(snap);
+		return NULL;
+	}
+	snap->generation = ++r->generation;
+	return snap;
+}
+
+static void free_snapshot(struct props_snapshot *snap)
+{
+	props_store_free(&snap->store);
+	free(snap);
+}
+
+/* Waits until no reader can still hold a snapshot that was replaced
+ * before the epoch was bumped to `epoch`: every reader is either outside
+ * a read or began its read at `epoch` or later, after the swap.
+ */
+static void wait_for_readers(struct props_reloader *r, uint64_t epoch)
+{
+	for (int i = 0; i < PROPS_MAX_READERS; i++) {
+		struct reader_slot *slot = &r->slots[i];
+
+		for (;;) {
+			uint64_t e = atomic_load(&slot->epoch);
+
+			if (e == 0 || e >= epoch)
+				break;
+			sched_yield();
+		}
+	}
+}
+
+int props_reload(struct props_reloader *r)
+{
+	struct props_snapshot *snap, *old;
+
+	pthread_mutex_lock(&r->reload_lock);
+	snap = load_snapshot(r);
+	if (!snap) {
+		atomic_fetch_add(&r->errors, 1);
+		pthread_mutex_unlock(&r->reload_lock);
+		return -1;
+	}
+	old = atomic_exchange(&r->current, snap);
+	wait_for_readers(r, atomic_fetch_add(&r->epoch, 1) + 1);
+	free_snapshot(old);
+	atomic_fetch_add(&r->reloads, 1);
+	pthread_mutex_unlock(&r->reload_lock);
+	return 0;
+}
+
+/* Whether a batch of inotify events has one for the file */
+static bool touches_file(struct props_reloader *r, const char *buf,
+			 ssize_t len)
+{
+	const char *p = buf;
+
+	while (p < buf + len) {
+		const struct inotify_event *ev = (const void *)p;
+
+		if (ev->len > 0 && strcmp(ev->name, r->name) == 0)
+			return true;
+		p += sizeof(*ev) + ev->len;
+	}
+	return false;
+}
+
+/* Events that come in a burst, like an editor's write, close and
+ * rename, are read together and cause one reload.
+ */
+static void *watch(void *arg)
+{
+	struct props_reloader *r = arg;
+	alignas(struct inotify_event) char buf[4096 + NAME_MAX + 1];
+	struct pollfd fds[2] = {
+		{ .fd = r->inotify_fd, .events = POLLIN },
+		{ .fd = r->stop_pipe[0], .events = POLLIN },
+	};
+
+	for (;;) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (fds[1].revents)
+			break;
+
+		bool changed = false;
+		ssize_t n;
+
+		while ((n = read(r->inotify_fd, buf, sizeof(buf))) > 0)
+			changed |= touches_file(r, buf, n);
+		if (changed)
+			props_reload(r);
+	}
+	return NULL;
+}
+
+static int start_watcher(struct props_reloader *r)
+{
+	const char *slash = strrchr(r->file, '/');
+	char *dir;
+	int err;
+
+	r->name = slash ? slash + 1 : r->file;
+	dir = slash ? strndup(r->file, slash - r->file + 1) : strdup(".");
+	if (!dir)
+		return -1;
+	r->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (r->inotify_fd < 0 ||
+	    inotify_add_watch(r->inotify_fd, dir,
+			      IN_CLOSE_WRITE | IN_MOVED_TO) < 0 ||
+	    pipe(r->stop_pipe) != 0) {
+		free(dir);
+		return -1;
+	}
+	free(dir);
+	err = pthread_create(&r->watcher, NULL, watch, r);
+	if (err) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+struct props_reloader *props_reloader_open(const char *file,
+					   const struct parse_ctx *pctx)
+{
+	/* Aligned for the reader slots */
+	struct props_reloader *r = aligned_alloc(alignof(*r), sizeof(*r));
+	struct props_snapshot *snap;
+
+	if (!r)
+		return NULL;
+	memset(r, 0, sizeof(*r));
+	r->inotify_fd = r->stop_pipe[0] = r->stop_pipe[1] = -1;
+	r->file = strdup(file);
+	if (pctx)
+		r->pctx = *pctx;
+	else
+		init_parse_ctx(&r->pctx);
+	pthread_mutex_init(&r->reload_lock, NULL);
+	atomic_init(&r->epoch, 1);
+	for (int i = 0; i < PROPS_MAX_READERS; i++) {
+		atomic_init(&r->slots[i].epoch, 0);
+		atomic_init(&r->slots[i].used, false);
+	}
+	if (!r->file || !(snap = load_snapshot(r)))
+		goto err;
+	atomic_init(&r->current, snap);
+	if (start_watcher(r) != 0) {
+		free_snapshot(snap);
+		goto err;
+	}
+	return r;
+err:
+	if (r->inotify_fd >= 0)
+		close(r->inotify_fd);
+	if (r->stop_pipe[0] >= 0) {
+		close(r->stop_pipe[0]);
+		close(r->stop_pipe[1]);
+	}
+	pthread_mutex_destroy(&r->reload_lock);
+	free(r->file);
+	free(r);
+	return NULL;
+}
+
+void props_reloader_close(struct props_reloader *r)
+{
+	ssize_t n;
+
+	do
+		n = write(r->stop_pipe[1], "", 1);
+	while (n < 0 && errno == EINTR);
+	pthread_join(r->watcher, NULL);
+	close(r->inotify_fd);
+	close(r->stop_pipe[0]);
+	close(r->stop_pipe[1]);
+	free_snapshot(atomic_load(&r->current));
+	pthread_mutex_destroy(&r->reload_lock);
+	free(r->file);
+	free(r);
+}
+
+void props_reload_stats(struct props_reloader *r, uint64_t *reloads,
+			uint64_t *errors)
+{
+	*reloads = atomic_load(&r->reloads);
+	*errors = atomic_load(&r->errors);
+}
+
+int props_reader_register(struct props_reloader *r, struct props_reader *rd)
+{
+	for (int i = 0; i < PROPS_MAX_READERS; i++) {
+		bool free_slot = false;
+
+		if (atomic_compare_exchange_strong(&r->slots[i].used,
+						   &free_slot, true)) {
+			rd->r = r;
+			rd->slot = i;
+			return 0;
+		}
+	}
+	errno = EAGAIN;
+	return -1;
+}
+
+void props_reader_unregister(struct props_reader *rd)
+{
+	atomic_store(&rd->r->slots[rd->slot].epoch, 0);
+	atomic_store(&rd->r->slots[rd->slot].used, false);
+	rd->r = NULL;
+}
+
+/* The sequentially consistent store of the epoch is ordered before the
+ * load of the pointer. A reloader that swaps the pointer and then bumps
+ * the epoch either sees this reader's epoch and waits for it, or this
+ * reader already loads the new pointer.
+ */
+const struct props_snapshot *props_read_begin(struct props_reader *rd)
+{
+	struct props_reloader *r = rd->r;
+
+	atomic_store(&r->slots[rd->slot].epoch, atomic_load(&r->epoch));
+	return atomic_load(&r->current);
+}
+
+void props_read_end(struct props_reader *rd)
+{
+	atomic_store_explicit(&rd->r->slots[rd->slot].epoch, 0,
+			      memory_order_release);
+}
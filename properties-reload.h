@@ -0,0 +1,64 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "properties-parser.h"
+
+/* A properties file that is reloaded whenever it changes. A background
+ * thread watches the directory of the file with inotify: writing the file
+ * and closing it, or renaming another file over it, both trigger a
+ * reload. The new version is parsed into a fresh store and published as
+ * an immutable snapshot by swapping one atomic pointer, so a reader sees
+ * either the old file or the new one, never a mix.
+ *
+ * Readers take no lock. Each one registers once, then brackets its
+ * lookups with props_read_begin() and props_read_end(). A replaced
+ * snapshot is freed after every reader that may still use it has ended
+ * its read: the reloader bumps an epoch and waits for the readers that
+ * began before the bump. Only the reloading thread ever waits.
+ */
+struct props_snapshot {
+	struct props_store store; /* loaded, so props_store_get() works */
+	uint64_t generation; /* 1 for the first load, +1 per reload */
+};
+
+struct props_reloader;
+
+#define PROPS_MAX_READERS 64
+
+struct props_reader {
+	struct props_reloader *r;
+	int slot;
+};
+
+/* Loads the file and starts watching it. Returns NULL with errno set if
+ * the first load fails. The strings of pctx must outlive the reloader.
+ */
+struct props_reloader *props_reloader_open(const char *file,
+					   const struct parse_ctx *pctx);
+/* Stops the watcher. Every reader must have been unregistered. */
+void props_reloader_close(struct props_reloader *r);
+/* Parses the file and publishes it now, as the watcher does. Returns 0,
+ * or -1 if it can't be read, in which case the current snapshot stays.
+ */
+int props_reload(struct props_reloader *r);
+/* Successful reloads and failed ones, not counting the first load */
+void props_reload_stats(struct props_reloader *r, uint64_t *reloads,
+			uint64_t *errors);
+
+/* Claims one of PROPS_MAX_READERS slots for the calling thread. Returns
+ * 0, or -1 if they are all taken.
+ */
+int props_reader_register(struct props_reloader *r, struct props_reader *rd);
+void props_reader_unregister(struct props_reader *rd);
+/* The current snapshot, valid until props_read_end(). Reads don't nest. */
+const struct props_snapshot *props_read_begin(struct props_reader *rd);
+void props_read_end(struct props_reader *rd);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "heap.hh"
+
+// A hierarchical timing wheel for timeouts which are mostly cancelled before
+// they fire. Insert and cancel are O(1); advance() expires a whole slot at a
+// time. Deadlines are in abstract ticks.
+//
+// There are kLevels wheels of kSlots slots each. A timer lives in the lowest
+// level whose span covers its distance from now. When the lower wheel wraps
+// around, the next slot of the level above is cascaded down. Deadlines beyond
+// the span of the top level are parked in a heap::MinHeap and pulled into the
+// wheel once they come within range.
+
+namespace timing {
+template <typename T>
+class TimingWheel {
+ public:
+  // Opaque timer id: generation in the high 32 bits, node index in the low.
+  using handle = uint64_t;
+
+  static constexpr int kBits = 6;
+  static constexpr int kSlots = 1 << kBits;
+  static constexpr int kLevels = 4;
+  static constexpr uint64_t kSpan = uint64_t(1) << (kBits * kLevels);
+
+ private:
+  static constexpr uint32_t kNil = UINT32_MAX;
+  static constexpr uint16_t kFree = UINT16_MAX;
+  static constexpr uint16_t kFar = kLevels * kSlots;
+
+  struct Node {
+    uint64_t deadline;
+    T data;
+    uint32_t prev, next;
+    uint32_t gen;
+    uint16_t list;  // kLevels * kSlots wheel lists, kFar, or kFree
+  };
+
+  std::vector<Node> nodes;
+  uint32_t free_head;
+  uint32_t lists[kLevels * kSlots + 1];
+  // Far-future timers, also chained on lists[kFar]. Cancelled entries are
+  // left in the heap and skipped when they reach the top.
+  heap::MinHeap<std::pair<uint64_t, handle>> far;
+  size_t far_live;
+  size_t live;
+  uint64_t now_;
+
+  static handle make_handle(uint32_t gen, uint32_t index) {
+    return (uint64_t(gen) << 32) | index;
+  }
+
+  void link(uint32_t index, uint16_t list) {
+    Node& n = nodes[index];
+    n.list = list;
+    n.prev = kNil;
+    n.next = lists[list];
+    if (n.next != kNil)
+      nodes[n.next].prev = index;
+    lists[list] = index;
+  }
+
+  void unlink(uint32_t index) {
+    Node& n = nodes[index];
+    if (n.prev != kNil)
+      nodes[n.prev].next = n.next;
+    else
+      lists[n.list] = n.next;
+    if (n.next != kNil)
+      nodes[n.next].prev = n.prev;
+  }
+
+  void release(uint32_t index) {
+    Node& n = nodes[index];
+    n.list = kFree;
+    n.gen++;
+    n.next = free_head;
+    free_head = index;
+    live--;
+  }
+
+  // Files the node under the wheel slot (or the far heap) for its deadline,
+  // but no earlier than the `earliest` tick. A cascade runs before the slot
+  // of the current tick is expired, so it may still file into that slot.
+  void place(uint32_t index, uint64_t earliest) {
+    uint64_t deadline = nodes[index].deadline;
+    if (deadline < earliest)
+      deadline = earliest;
+    uint64_t delta = deadline - now_;
+    for (int level = 0; level < kLevels; level++) {
+      if (delta < (uint64_t(1) << (kBits * (level + 1)))) {
+        int slot = (deadline >> (kBits * level)) & (kSlots - 1);
+        link(index, level * kSlots + slot);
+        return;
+      }
+    }
+    link(index, kFar);
+    far.push(std::make_pair(deadline, make_handle(nodes[index].gen, index)));
+    far_live++;
+  }
+
+  // Re-files every timer of a higher level slot one level down.
+  void cascade(int level, int slot) {
+    uint16_t list = level * kSlots + slot;
+    uint32_t index = lists[list];
+    lists[list] = kNil;
+    while (index != kNil) {
+      uint32_t next = nodes[index].next;
+      place(index, now_);
+      index = next;
+    }
+  }
+
+  bool valid(handle h) const {
+    uint32_t index = uint32_t(h);
+    return index < nodes.size() && nodes[index].gen == uint32_t(h >> 32) &&
+           nodes[index].list != kFree;
+  }
+
+  // Pulls the far timers which are now within the span of the wheel.
+  void refill() {
+    while (!far.empty() && far.top().first - now_ < kSpan) {
+      handle h = far.top().second;
+      far.pop();
+      if (!valid(h) || nodes[uint32_t(h)].list != kFar)
+        continue;
+      unlink(uint32_t(h));
+      far_live--;
+      place(uint32_t(h), now_);
+    }
+  }
+
+  // Drops the cancelled entries once they make up most of the far heap.
+  void compact_far() {
+    if (far.size() < 64 || size_t(far.size()) < 2 * far_live)
+      return;
+    std::vector<std::pair<uint64_t, handle>> v;
+    v.reserve(far_live);
+    for (uint32_t i = lists[kFar]; i != kNil; i = nodes[i].next)
+      v.push_back(
+              std::make_pair(nodes[i].deadline, make_handle(nodes[i].gen, i)));
+    far.assign(v.begin(), v.end());
+  }
+
+ public:
+  explicit TimingWheel(uint64_t now = 0)
+      : free_head(kNil), far_live(0), live(0), now_(now) {
+    for (auto& l : lists) l = kNil;
+  }
+
+  uint64_t now() const {
+    return now_;
+  }
+
+  size_t size() const {
+    return live;
+  }
+
+  // Deadlines at or before now() fire on the next tick.
+  handle insert(uint64_t deadline, const T& data) {
+    uint32_t index;
+    if (free_head != kNil) {
+      index = free_head;
+      free_head = nodes[index].next;
+      nodes[index].data = data;
+    } else {
+      index = nodes.size();
+      nodes.push_back(Node{ 0, data, kNil, kNil, 0, kFree });
+    }
+    nodes[index].deadline = deadline;
+    live++;
+    place(index, now_ + 1);
+    return make_handle(nodes[index].gen, index);
+  }
+
+  // Returns false if the timer has already fired or been cancelled.
+  bool cancel(handle h) {
+    if (!valid(h))
+      return false;
+    uint32_t index = uint32_t(h);
+    bool is_far = nodes[index].list == kFar;
+    unlink(index);
+    release(index);
+    if (is_far) {
+      far_live--;
+      compact_far();
+    }
+    return true;
+  }
+
+  // Moves the clock forward to `now`, calling expire(data, deadline) for
+  // every timer whose deadline has passed. Callbacks may insert and cancel
+  // timers. Returns the number of expired timers.
+  template <typename F>
+  size_t advance(uint64_t now, F&& expire) {
+    size_t expired = 0;
+    while (now_ < now) {
+      // Nothing on the wheel: jump straight to the next far deadline.
+      if (live == far_live) {
+        uint64_t next = now;
+        if (!far.empty() && far.top().first - kSpan + 1 < next)
+          next = far.top().first - kSpan + 1;
+        if (next > now_) {
+          now_ = next;
+          refill();
+          continue;
+        }
+      }
+
+      uint64_t tick = ++now_;
+      for (int level = 1; level < kLevels; level++) {
+        if (tick & ((uint64_t(1) << (kBits * level)) - 1))
+          break;
+        cascade(level, (tick >> (kBits * level)) & (kSlots - 1));
+      }
+      if ((tick & (kSlots - 1)) == 0)
+        refill();
+
+      uint16_t list = tick & (kSlots - 1);
+      while (lists[list] != kNil) {
+        uint32_t index = lists[list];
+        unlink(index);
+        uint64_t deadline = nodes[index].deadline;
+        T data = std::move(nodes[index].data);
+        release(index);
+        expire(data, deadline);
+        expired++;
+      }
+    }
+    return expired;
+  }
+};
+
+}  // namespace timing
@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "basenc.h"
+
+// RFC 4648 section 10
+std::vector<std::tuple<const char *, const char *, const char *>> vectors{
+    {"", "", ""},
+    {"f", "Zg==", "MY======"},
+    {"fo", "Zm8=", "MZXQ===="},
+    {"foo", "Zm9v", "MZXW6==="},
+    {"foob", "Zm9vYg==", "MZXW6YQ="},
+    {"fooba", "Zm9vYmE=", "MZXW6YTB"},
+    {"foobar", "Zm9vYmFy", "MZXW6YTBOI======"}};
+
+static std::string encode(int codec, const std::string &bin) {
+  std::string out(basenc_encoded_len(codec, bin.size()), '\0');
+  out.resize(encode_basenc(codec, bin.data(), bin.size(), out.data()));
+  return out;
+}
+
+static std::string decode(int codec, const std::string &text, int *error) {
+  std::string out(basenc_decoded_max(codec, text.size()), '\0');
+  out.resize(decode_basenc_to_binary(codec, text.data(), text.size(),
+                                     out.data(), out.size(), error));
+  return out;
+}
+
+TEST(TestBasenc, RfcVectors) {
+  for (auto [bin, b64, b32] : vectors) {
+    int error;
+    EXPECT_EQ(encode(BASE64, bin), b64);
+    EXPECT_EQ(encode(BASE32, bin), b32);
+    EXPECT_EQ(decode(BASE64, b64, &error), bin);
+    EXPECT_EQ(error, 0);
+    EXPECT_EQ(decode(BASE32, b32, &error), bin);
+    EXPECT_EQ(error, 0);
+  }
+}
+
+// Straightforward bit at a time encoder to check the vector kernels against
+static std::string reference_encode(int codec, const std::string &bin) {
+  std::string alphabet =
+      codec == BASE32 ? "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567"
+                      : "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+                        "0123456789";
+  if (codec == BASE64) alphabet += "+/";
+  if (codec == BASE64URL) alphabet += "-_";
+  int bits = codec == BASE32 ? 5 : 6, group = codec == BASE32 ? 8 : 4;
+  std::string out;
+  for (size_t i = 0; i < bin.size() * 8; i += bits) {
+    int v = 0;
+    for (int b = 0; b < bits; b++) {
+      size_t k = i + b;
+      int bit = k < bin.size() * 8 ? (bin[k / 8] >> (7 - k % 8)) & 1 : 0;
+      v = v << 1 | bit;
+    }
+    out += alphabet[v];
+  }
+  while (out.size() % group) out += '=';
+  return out;
+}
+
+static std::string random_bytes(size_t len, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::string s(len, '\0');
+  for (auto &c : s) c = rng();
+  return s;
+}
+
+TEST(TestBasenc, AllLengths) {
+  for (int codec : {BASE64, BASE64URL, BASE32}) {
+    for (size_t len = 0; len < 300; len++) {
+      std::string bin = random_bytes(len, len);
+      std::string text = reference_encode(codec, bin);
+      int error;
+      ASSERT_EQ(encode(codec, bin), text) << codec << ' ' << len;
+      ASSERT_EQ(decode(codec, text, &error), bin) << codec << ' ' << len;
+      ASSERT_EQ(error, 0);
+      // Without the padding
+      text.erase(text.find_last_not_of('=') + 1);
+      ASSERT_EQ(decode(codec, text, &error), bin) << codec << ' ' << len;
+    }
+  }
+}
+
+TEST(TestBasenc, InvalidCharAtAnyOffset) {
+  for (int codec : {BASE64, BASE64URL, BASE32}) {
+    std::string bin = random_bytes(300, 1);
+    std::string good = reference_encode(codec, bin);
+    for (size_t i = 0; i < good.size() - 8; i++) {
+      std::string bad = good;
+      bad[i] = codec == BASE64 ? '-' : '+';
+      int error;
+      std::string out = decode(codec, bad, &error);
+      ASSERT_EQ(error, -1) << i;
+      // Everything in the groups before the bad char is there
+      size_t group = codec == BASE32 ? 8 : 4, bytes = codec == BASE32 ? 5 : 3;
+      ASSERT_GE(out.size(), i / group * bytes);
+      ASSERT_EQ(out.substr(0, i / group * bytes), bin.substr(0, i / group * bytes));
+    }
+  }
+}
+
+TEST(TestBasenc, ShortOutput) {
+  std::string bin = random_bytes(100, 2);
+  std::string text = reference_encode(BASE64, bin);
+  for (size_t n = 0; n <= bin.size(); n++) {
+    std::vector<char> out(n + 1, '!');
+    int error;
+    size_t s = decode_basenc_to_binary(BASE64, text.data(), text.size(),
+                                       out.data(), n, &error);
+    ASSERT_EQ(s, n);
+    EXPECT_EQ(error, 0);
+    EXPECT_EQ(std::string(out.data(), n), bin.substr(0, n));
+    EXPECT_EQ(out[n], '!');
+  }
+}
+
+TEST(TestBasencStream, SplitAnywhere) {
+  for (int codec : {BASE64, BASE32}) {
+    std::string bin = random_bytes(200, 3);
+    std::string encoded = reference_encode(codec, bin);
+    std::string text;
+    for (size_t i = 0; i < encoded.size(); i += 76)
+      text += encoded.substr(i, 76) + "\r\n";
+    for (size_t cut = 0; cut <= text.size(); cut++) {
+      struct basenc_stream s;
+      std::vector<char> buf(basenc_decoded_max(codec, text.size()) + 4);
+      int error;
+      basenc_stream_init(&s, codec);
+      size_t n = basenc_stream_decode(&s, text.data(), cut, buf.data(), &error);
+      ASSERT_EQ(error, 0);
+      n += basenc_stream_decode(&s, text.data() + cut, text.size() - cut,
+                                buf.data() + n, &error);
+      ASSERT_EQ(error, 0);
+      int k = basenc_stream_finish(&s, buf.data() + n);
+      ASSERT_EQ(k, 0);
+      ASSERT_EQ(std::string(buf.data(), n), bin) << codec << ' ' << cut;
+    }
+  }
+}
+
+TEST(TestBasencStream, UnpaddedAndErrors) {
+  struct basenc_stream s;
+  char buf[16];
+  int error;
+
+  // Unpadded URL safe base64 ends in finish()
+  basenc_stream_init(&s, BASE64URL);
+  size_t n = basenc_stream_decode(&s, "-_-_-_\n", 7, buf, &error);
+  EXPECT_EQ(error, 0);
+  EXPECT_EQ(n, 3u);
+  EXPECT_EQ(basenc_stream_finish(&s, buf + n), 1);
+  EXPECT_EQ(std::string(buf, 4), "\xfb\xff\xbf\xfb");
+
+  // Nothing but padding after the padding
+  basenc_stream_init(&s, BASE64);
+  basenc_stream_decode(&s, "Zg==\nZg==", 9, buf, &error);
+  EXPECT_EQ(error, -1);
+  EXPECT_EQ(s.offset, 5u);
+
+  // A group can't end after one char
+  basenc_stream_init(&s, BASE64);
+  basenc_stream_decode(&s, "Zm9vY", 5, buf, &error);
+  EXPECT_EQ(error, 0);
+  EXPECT_EQ(basenc_stream_finish(&s, buf), -1);
+
+  basenc_stream_init(&s, BASE32);
+  basenc_stream_decode(&s, "MZXW6YTB\nMZXw", 13, buf, &error);
+  EXPECT_EQ(error, -1);
+  EXPECT_EQ(s.offset, 12u);
+}
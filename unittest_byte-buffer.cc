@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <utility>
+
+#include "byte-buffer.hh"
+
+using bytes::ByteBuffer;
+
+static std::string contents(const ByteBuffer& b) {
+  return std::string(b.data(), b.size());
+}
+
+TEST(ByteBuffer, AppendConsume) {
+  ByteBuffer b;
+  std::string expected;
+  for (int i = 0; i < 1000; i++) {
+    std::string s(i % 37, 'a' + i % 26);
+    b.append(s.data(), s.size());
+    expected += s;
+    if (i % 3 == 0) {
+      size_t n = std::min<size_t>(expected.size(), 50);
+      b.consume(n);
+      expected.erase(0, n);
+    }
+    ASSERT_EQ(contents(b), expected);
+  }
+}
+
+TEST(ByteBuffer, GrowsGeometrically) {
+  ByteBuffer b;
+  int grows = 0;
+  size_t cap = b.capacity();
+  for (int i = 0; i < 100000; i++) {
+    b.append("x", 1);
+    if (b.capacity() != cap) grows++;
+    cap = b.capacity();
+  }
+  EXPECT_LT(grows, 20);
+}
+
+TEST(ByteBuffer, ReserveCommitReset) {
+  ByteBuffer b(16);
+  b.reserve(100);
+  ASSERT_GE(b.writable(), 100u);
+  memset(b.write_ptr(), 'z', 100);
+  b.commit(100);
+  EXPECT_EQ(contents(b), std::string(100, 'z'));
+  char* p = b.data();
+  size_t cap = b.capacity();
+  b.reset();
+  EXPECT_TRUE(b.empty());
+  b.reserve(100);
+  // Same memory the second time around
+  EXPECT_EQ(b.write_ptr(), p);
+  EXPECT_EQ(b.capacity(), cap);
+}
+
+TEST(ByteBuffer, CopyAndMove) {
+  ByteBuffer a;
+  a.append("hello world", 11);
+  a.consume(6);
+  ByteBuffer b(a);
+  EXPECT_EQ(contents(b), "world");
+  ByteBuffer c(std::move(a));
+  EXPECT_EQ(contents(c), "world");
+  EXPECT_EQ(a.capacity(), 0u);
+  a = std::move(c);
+  EXPECT_EQ(contents(a), "world");
+  b = a;
+  b.append("!", 1);
+  EXPECT_EQ(contents(b), "world!");
+  EXPECT_EQ(contents(a), "world");
+}
+
+TEST(ByteBuffer, HugePages) {
+  ByteBuffer b(1024, true);
+  std::string s(1 << 20, 'q');
+  for (int i = 0; i < 5; i++) b.append(s.data(), s.size());
+  EXPECT_GE(b.capacity(), 5u << 20);
+  EXPECT_EQ(b.capacity() % ByteBuffer::kHugeSize, 0u);
+  b.consume(4 << 20);
+  EXPECT_EQ(contents(b), s);
+}
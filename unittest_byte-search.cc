@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "byte-search.h"
+
+// Bytes that end right before a page that can't be read, so that a kernel
+// that loads past the end of its input crashes the test
+class GuardedBuf {
+ public:
+  explicit GuardedBuf(const std::string &data) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_ = (data.size() + page - 1) / page * page + page;
+    base_ = static_cast<uint8_t *>(mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    EXPECT_NE(base_, MAP_FAILED);
+    mprotect(base_ + size_ - page, page, PROT_NONE);
+    data_ = base_ + size_ - page - data.size();
+    memcpy(data_, data.data(), data.size());
+  }
+  ~GuardedBuf() { munmap(base_, size_); }
+
+  const uint8_t *data() const { return data_; }
+
+ private:
+  uint8_t *base_, *data_;
+  size_t size_;
+};
+
+// Bytes from a small alphabet, so that partial matches are everywhere
+static std::string random_bytes(size_t len, std::mt19937 &rng) {
+  std::string s(len, '\0');
+  for (auto &c : s) c = "abcd"[rng() % 4];
+  return s;
+}
+
+// Every match start, one search after the other as search_window() does
+static std::vector<size_t> all_matches(const struct byte_pattern &p,
+                                       const uint8_t *buf, size_t len) {
+  std::vector<size_t> out;
+  const uint8_t *end = buf + len;
+  for (const uint8_t *m = buf; (m = byte_search(&p, m, end - m)); m++)
+    out.push_back(m - buf);
+  return out;
+}
+
+static std::vector<size_t> memmem_matches(const std::string &hay,
+                                          const std::string &needle) {
+  std::vector<size_t> out;
+  const char *p = hay.data(), *end = hay.data() + hay.size();
+  while (const void *m = memmem(p, end - p, needle.data(), needle.size())) {
+    out.push_back(static_cast<const char *>(m) - hay.data());
+    p = static_cast<const char *>(m) + 1;
+  }
+  return out;
+}
+
+static std::string to_hex(const std::string &s) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  for (unsigned char c : s) {
+    hex += digits[c >> 4];
+    hex += digits[c & 15];
+  }
+  return hex;
+}
+
+TEST(TestBytePattern, Parse) {
+  struct byte_pattern p;
+  ASSERT_EQ(byte_pattern_parse(&p, "de ad ?? e?"), 0);
+  ASSERT_EQ(p.len, 4u);
+  EXPECT_EQ(p.val[0], 0xde);
+  EXPECT_EQ(p.mask[0], 0xff);
+  EXPECT_EQ(p.mask[2], 0x00);
+  EXPECT_EQ(p.val[3], 0xe0);
+  EXPECT_EQ(p.mask[3], 0xf0);
+  EXPECT_EQ(p.first, 0u);
+  EXPECT_EQ(p.last, 3u);
+  EXPECT_EQ(p.exact, 0);
+  byte_pattern_free(&p);
+
+  ASSERT_EQ(byte_pattern_parse(&p, "0x7f454C46"), 0);
+  EXPECT_EQ(p.len, 4u);
+  EXPECT_EQ(p.exact, 1);
+  EXPECT_EQ(memcmp(p.val, "\x7f" "ELF", 4), 0);
+  byte_pattern_free(&p);
+
+  ASSERT_EQ(byte_pattern_parse(&p, "?? 41 ?2 ??"), 0);
+  EXPECT_EQ(p.first, 1u);
+  EXPECT_EQ(p.last, 2u);
+  byte_pattern_free(&p);
+
+  ASSERT_EQ(byte_pattern_parse(&p, "????"), 0);
+  EXPECT_EQ(p.first, 0u);
+  byte_pattern_free(&p);
+
+  for (const char *bad : {"", "  ", "abc", "zz", "0x", "de ad g0"}) {
+    EXPECT_NE(byte_pattern_parse(&p, bad), 0) << bad;
+    EXPECT_EQ(p.val, nullptr) << bad;
+  }
+}
+
+// A pattern at every offset of buffers of every length around the 16 and
+// 32 byte vectors, so matches straddle vector blocks and fall into the
+// scalar tail
+TEST(TestByteSearch, SameAsMemmem) {
+  std::mt19937 rng(1);
+  for (size_t plen : {1, 2, 3, 4, 7, 15, 16, 17, 31, 32, 33, 40}) {
+    std::string needle = random_bytes(plen, rng);
+    struct byte_pattern p;
+    ASSERT_EQ(byte_pattern_parse(&p, to_hex(needle).c_str()), 0);
+    for (size_t len = 0; len < 140; len++) {
+      std::string hay = random_bytes(len, rng);
+      for (size_t at = 0; at + plen <= len; at += 1 + at / 8) {
+        std::string h = hay;
+        h.replace(at, plen, needle);
+        GuardedBuf buf(h);
+        ASSERT_EQ(all_matches(p, buf.data(), h.size()),
+                  memmem_matches(h, needle))
+            << plen << " " << len << " " << at;
+      }
+    }
+    byte_pattern_free(&p);
+  }
+}
+
+// Wildcards at the ends move the bytes the vector filter looks at away
+// from the start of the pattern
+TEST(TestByteSearch, Wildcards) {
+  std::mt19937 rng(2);
+  for (const char *pat :
+       {"?1 62", "61 ?? ?? 64", "?? 6? 63", "61 ?? ??", "?? ?? ?? 62 ??",
+        "????"}) {
+    struct byte_pattern p;
+    ASSERT_EQ(byte_pattern_parse(&p, pat), 0);
+    for (size_t len = 0; len < 200; len += 3) {
+      std::string h = random_bytes(len, rng);
+      GuardedBuf buf(h);
+      std::vector<size_t> want;
+      for (size_t i = 0; i + p.len <= len; i++) {
+        bool ok = true;
+        for (size_t j = 0; j < p.len; j++)
+          ok &= ((uint8_t)h[i + j] & p.mask[j]) == p.val[j];
+        if (ok) want.push_back(i);
+      }
+      ASSERT_EQ(all_matches(p, buf.data(), len), want) << pat << " " << len;
+    }
+    byte_pattern_free(&p);
+  }
+}
+
+TEST(TestByteSearch, Mismatch) {
+  std::mt19937 rng(3);
+  for (size_t len = 0; len < 300; len++) {
+    std::string a = random_bytes(len, rng);
+    GuardedBuf ga(a), same(a);
+    EXPECT_EQ(byte_mismatch(ga.data(), same.data(), len), len);
+    for (size_t at = 0; at < len; at++) {
+      std::string b = a;
+      b[at] = 'x';
+      GuardedBuf gb(b);
+      ASSERT_EQ(byte_mismatch(ga.data(), gb.data(), len), at)
+          << len << " " << at;
+    }
+  }
+}
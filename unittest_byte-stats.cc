@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+
+#include <math.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "byte-stats.h"
+
+// Random bytes with runs of zeroes of every length, some far longer than
+// the 64 bytes scan_mask() looks at
+static std::string test_data(size_t len, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::string s;
+  while (s.size() < len) {
+    switch (rng() % 4) {
+      case 0:
+        s.append(rng() % 200, '\0');
+        break;
+      case 1:
+        s.append(rng() % 3, '\0');
+        break;
+      default:
+        for (int i = rng() % 100; i > 0; i--) s += (char)(rng() % 8);
+    }
+  }
+  s.resize(len);
+  return s;
+}
+
+// The statistics computed a byte at a time
+struct Reference {
+  uint64_t hist[256] = {};
+  uint64_t zero_runs = 0, longest_run = 0, lead = 0, run = 0;
+  bool seen_nonzero = false;
+  std::vector<double> entropy;
+
+  Reference(const std::string &s, size_t block_size) {
+    for (size_t i = 0; i < s.size(); i++) {
+      uint8_t b = s[i];
+      hist[b]++;
+      if (b == 0) {
+        if (run++ == 0) zero_runs++;
+        longest_run = std::max(longest_run, run);
+      } else {
+        if (!seen_nonzero) lead = run;
+        seen_nonzero = true;
+        run = 0;
+      }
+    }
+    for (size_t i = 0; block_size && i < s.size(); i += block_size) {
+      uint64_t h[256] = {};
+      size_t n = std::min(block_size, s.size() - i);
+      for (size_t j = 0; j < n; j++) h[(uint8_t)s[i + j]]++;
+      entropy.push_back(byte_entropy(h, n));
+    }
+  }
+};
+
+static void expect_same(const struct byte_stats &s, const Reference &r,
+                        size_t total) {
+  EXPECT_EQ(s.total, total);
+  for (int i = 0; i < 256; i++) EXPECT_EQ(s.hist[i], r.hist[i]) << i;
+  EXPECT_EQ(s.zero_runs, r.zero_runs);
+  EXPECT_EQ(s.longest_run, r.longest_run);
+  EXPECT_EQ(s.seen_nonzero, r.seen_nonzero);
+  if (r.seen_nonzero) {
+    EXPECT_EQ(s.lead, r.lead);
+  }
+  EXPECT_EQ(s.run, r.run);
+  ASSERT_EQ(s.nentropy, r.entropy.size());
+  for (size_t i = 0; i < s.nentropy; i++)
+    EXPECT_NEAR(s.entropy[i], r.entropy[i], 1e-9) << i;
+}
+
+TEST(TestByteStats, Entropy) {
+  uint64_t hist[256] = {};
+  EXPECT_EQ(byte_entropy(hist, 0), 0);
+  hist['a'] = 100;
+  EXPECT_EQ(byte_entropy(hist, 100), 0);
+  hist['b'] = 100;
+  EXPECT_NEAR(byte_entropy(hist, 200), 1.0, 1e-12);
+  for (int i = 0; i < 256; i++) hist[i] = 3;
+  EXPECT_NEAR(byte_entropy(hist, 768), 8.0, 1e-12);
+}
+
+// Fed in pieces of every size, so the zero runs start and end at every
+// position of the 64 byte masks and cross the pieces
+TEST(TestByteStats, SameAsReference) {
+  std::string data = test_data(100000, 1);
+  for (size_t block : {0, 1000, 4096}) {
+    Reference ref(data, block);
+    std::mt19937 rng(block);
+    struct byte_stats s;
+    byte_stats_init(&s, block);
+    for (size_t pos = 0; pos < data.size();) {
+      size_t n = std::min<size_t>(rng() % 300, data.size() - pos);
+      ASSERT_EQ(byte_stats_update(&s, data.data() + pos, n), 0);
+      pos += n;
+    }
+    ASSERT_EQ(byte_stats_finish(&s), 0);
+    expect_same(s, ref, data.size());
+    byte_stats_free(&s);
+  }
+}
+
+TEST(TestByteStats, AllZeroes) {
+  std::string data(1000, '\0');
+  struct byte_stats s;
+  byte_stats_init(&s, 256);
+  ASSERT_EQ(byte_stats_update(&s, data.data(), data.size()), 0);
+  ASSERT_EQ(byte_stats_finish(&s), 0);
+  expect_same(s, Reference(data, 256), data.size());
+  EXPECT_EQ(s.zero_runs, 1u);
+  EXPECT_EQ(s.longest_run, 1000u);
+  byte_stats_free(&s);
+}
+
+// Holes that are never read count like zeroes that are
+TEST(TestByteStats, Zeros) {
+  std::string head = test_data(5000, 2), tail = test_data(3000, 3);
+  for (size_t hole : {1, 63, 64, 1000, 10000}) {
+    std::string data = head + std::string(hole, '\0') + tail;
+    struct byte_stats s;
+    byte_stats_init(&s, 1024);
+    ASSERT_EQ(byte_stats_update(&s, head.data(), head.size()), 0);
+    ASSERT_EQ(byte_stats_zeros(&s, hole), 0);
+    ASSERT_EQ(byte_stats_update(&s, tail.data(), tail.size()), 0);
+    ASSERT_EQ(byte_stats_finish(&s), 0);
+    expect_same(s, Reference(data, 1024), data.size());
+    byte_stats_free(&s);
+  }
+}
+
+// Parts of the input counted on their own, as the -j workers do, then
+// merged in order
+static void merge_parts(const std::string &data,
+                        const std::vector<size_t> &cuts, size_t block) {
+  struct byte_stats all;
+  byte_stats_init(&all, block);
+  size_t start = 0;
+  for (size_t i = 0; i <= cuts.size(); i++) {
+    size_t end = i < cuts.size() ? cuts[i] : data.size();
+    struct byte_stats part;
+    byte_stats_init(&part, block);
+    ASSERT_EQ(byte_stats_update(&part, data.data() + start, end - start), 0);
+    ASSERT_EQ(byte_stats_finish(&part), 0);
+    if (i == 0)
+      all = part;
+    else {
+      ASSERT_EQ(byte_stats_merge(&all, &part), 0);
+      byte_stats_free(&part);
+    }
+    start = end;
+  }
+  expect_same(all, Reference(data, block), data.size());
+  byte_stats_free(&all);
+}
+
+TEST(TestByteStats, Merge) {
+  std::string data = test_data(64 * 1024, 4);
+  merge_parts(data, {16384, 32768, 49152}, 4096);
+  merge_parts(data, {1000, 1001, 30000, 64000}, 0);
+}
+
+// A zero run that crosses from one part into the next, and a part that
+// is nothing but zeroes in the middle of a run
+TEST(TestByteStats, MergeRunAcrossBlocks) {
+  const size_t block = 1024;
+  std::string data = test_data(4 * block, 5);
+  for (size_t i = block - 100; i < 3 * block + 50; i++) data[i] = '\0';
+  merge_parts(data, {block, 2 * block, 3 * block}, block);
+
+  std::string zeroes(3 * block, '\0');
+  merge_parts(zeroes, {block, 2 * block}, block);
+  merge_parts(zeroes + "x", {block, 2 * block}, block);
+  merge_parts("x" + zeroes, {block, 2 * block}, block);
+}
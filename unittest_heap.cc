@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <climits>
+#include <random>
+#include <vector>
+
+#include "heap.hh"
+#include "pairing-heap.hh"
+
+static std::vector<int> random_ints(size_t n, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> dist(-1000, 1000);
+  std::vector<int> v(n);
+  for (auto& x : v) x = dist(gen);
+  return v;
+}
+
+template <typename H>
+static std::vector<int> drain(H& h) {
+  std::vector<int> out;
+  while (!h.empty()) {
+    out.push_back(h.top());
+    h.pop();
+  }
+  return out;
+}
+
+TEST(Heap, RangeConstructor) {
+  auto v = random_ints(1000, 1);
+  heap::MinHeap<int> h(v.begin(), v.end());
+  EXPECT_EQ(h.size(), 1000);
+  std::sort(v.begin(), v.end());
+  EXPECT_EQ(drain(h), v);
+}
+
+TEST(Heap, Assign) {
+  auto v = random_ints(500, 2);
+  heap::MaxHeap<int> h;
+  h.push(5000);
+  h.assign(v.begin(), v.end());
+  EXPECT_EQ(h.size(), 500);
+  std::sort(v.begin(), v.end(), std::greater<int>());
+  EXPECT_EQ(drain(h), v);
+}
+
+TEST(Heap, Meld) {
+  for (size_t m : {0, 1, 3, 400}) {
+    auto a = random_ints(400, 3);
+    auto b = random_ints(m, 4);
+    heap::MinHeap<int> ha(a.begin(), a.end());
+    heap::MinHeap<int> hb(b.begin(), b.end());
+    ha.meld(hb);
+    EXPECT_TRUE(hb.empty());
+    a.insert(a.end(), b.begin(), b.end());
+    std::sort(a.begin(), a.end());
+    EXPECT_EQ(drain(ha), a);
+  }
+}
+
+TEST(Heap, TopK) {
+  auto v = random_ints(1000, 5);
+  heap::MaxHeap<int> h(v.begin(), v.end());
+  std::sort(v.begin(), v.end(), std::greater<int>());
+  for (size_t k : {0, 1, 2, 17, 1000, 2000}) {
+    auto top = h.top_k(k);
+    std::vector<int> exp(v.begin(), v.begin() + std::min(k, v.size()));
+    EXPECT_EQ(top, exp);
+  }
+  EXPECT_EQ(h.size(), 1000);
+}
+
+TEST(IndexedHeap, Update) {
+  auto v = random_ints(300, 6);
+  heap::IndexedMinHeap<int> h(v.size());
+  for (size_t i = 0; i < v.size(); i++) h.push(i, v[i]);
+  std::mt19937 gen(6);
+  for (int i = 0; i < 1000; i++) {
+    size_t id = gen() % v.size();
+    v[id] += int(gen() % 200) - 100;
+    h.update(id, v[id]);
+  }
+  h.remove(7);
+  v[7] = INT_MAX;
+  std::vector<int> out;
+  while (!h.empty()) {
+    EXPECT_EQ(h.key(h.top_id()), h.top());
+    out.push_back(h.top());
+    h.pop();
+  }
+  std::sort(v.begin(), v.end());
+  v.pop_back();
+  EXPECT_EQ(out, v);
+}
+
+TEST(PairingHeap, DecreaseKeyAndMeld) {
+  auto a = random_ints(500, 7);
+  auto b = random_ints(300, 8);
+  heap::PairingMinHeap<int> ha, hb;
+  std::vector<heap::PairingMinHeap<int>::node*> na, nb;
+  for (int x : a) na.push_back(ha.push(x));
+  for (int x : b) nb.push_back(hb.push(x));
+  // Pop a few so the trees are properly paired before decreasing keys.
+  std::sort(a.begin(), a.end());
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(ha.top(), a[i]);
+    ha.pop();
+  }
+  a.erase(a.begin(), a.begin() + 10);
+  ha.meld(hb);
+  EXPECT_TRUE(hb.empty());
+  EXPECT_EQ(ha.size(), 790u);
+  for (size_t i = 0; i < nb.size(); i += 3) {
+    int val = nb[i]->value() - 500;
+    ha.decrease_key(nb[i], val);
+    b[i] = val;
+  }
+  a.insert(a.end(), b.begin(), b.end());
+  std::sort(a.begin(), a.end());
+  EXPECT_EQ(drain(ha), a);
+}
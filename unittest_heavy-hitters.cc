@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "heavy-hitters.hh"
+
+using sketch::Addr;
+using sketch::AddrHash;
+using sketch::SpaceSaving;
+
+static Addr make_addr(uint64_t i) {
+  Addr a = {};
+  memcpy(a.bytes + 8, &i, 8);
+  return a;
+}
+
+// Addresses whose home slot in a sketch of capacity 8 (an index of 16
+// slots) is 14, 15 or 0, so their probe chains wrap around the end
+static std::vector<Addr> wrapping_addrs(size_t n) {
+  std::vector<Addr> out;
+  for (uint64_t i = 0; out.size() < n; i++) {
+    Addr a = make_addr(i);
+    size_t home = AddrHash()(a) & 15;
+    if (home >= 14 || home == 0) out.push_back(a);
+  }
+  return out;
+}
+
+// The guarantees of Space-Saving against the true counts, truth[k] being
+// the count of addrs[k]. They hold for merged sketches too, whose counters
+// no longer add up to the total.
+static void check_bounds(const SpaceSaving &ss,
+                         const std::map<size_t, uint64_t> &truth,
+                         const std::vector<Addr> &addrs) {
+  std::vector<SpaceSaving::Counter> counters = ss.counters();
+  std::set<std::vector<uint8_t>> seen;
+  for (const auto &c : counters) {
+    EXPECT_TRUE(
+        seen.insert(std::vector<uint8_t>(c.addr.bytes, c.addr.bytes + 16))
+            .second)
+        << "address counted twice";
+    size_t k = std::find(addrs.begin(), addrs.end(), c.addr) - addrs.begin();
+    auto it = truth.find(k);
+    uint64_t real = it == truth.end() ? 0 : it->second;
+    EXPECT_GE(c.count, real);
+    EXPECT_LE(c.count - c.error, real);
+  }
+  for (const auto &kv : truth) {
+    if (kv.second * ss.capacity() <= ss.total()) continue;
+    bool found = false;
+    for (const auto &c : counters) found |= c.addr == addrs[kv.first];
+    EXPECT_TRUE(found) << "heavy hitter " << kv.first << " missing";
+  }
+}
+
+// Recycled counters are removed from the index with backward shift
+// deletion. With every address crowded around the end of the table, the
+// probe chains wrap, and a broken shift would leave an address unfindable:
+// it would then be counted twice.
+TEST(SpaceSaving, EraseWrappedChains) {
+  std::vector<Addr> addrs = wrapping_addrs(40);
+  SpaceSaving ss(8);
+  std::map<size_t, uint64_t> truth;
+  std::mt19937 rng(1);
+  for (int i = 0; i < 20000; i++) {
+    // A few heavy ones and a long tail that keeps recycling counters
+    size_t k = rng() % 4 == 0 ? rng() % 3 : rng() % addrs.size();
+    ss.add(addrs[k]);
+    truth[k]++;
+  }
+  check_bounds(ss, truth, addrs);
+  // Built by add() alone, every item is in exactly one counter
+  uint64_t sum = 0;
+  for (const auto &c : ss.counters()) sum += c.count;
+  EXPECT_EQ(sum, ss.total());
+
+  // Every address in the sketch is found again: adding it bumps its own
+  // counter and recycles nothing.
+  for (const auto &c : ss.counters()) {
+    std::vector<SpaceSaving::Counter> before = ss.counters();
+    ss.add(c.addr, 5);
+    std::vector<SpaceSaving::Counter> after = ss.counters();
+    ASSERT_EQ(after.size(), before.size());
+    for (const auto &b : before) {
+      bool found = false;
+      for (const auto &a : after)
+        if (a.addr == b.addr) {
+          found = true;
+          EXPECT_EQ(a.count, b.count + (b.addr == c.addr ? 5 : 0));
+          EXPECT_EQ(a.error, b.error);
+        }
+      EXPECT_TRUE(found);
+    }
+  }
+}
+
+// Two sketches over different parts of a stream, merged, keep the error
+// bounds of one sketch over all of it
+static void merge_bounds(unsigned seed) {
+  const size_t n = 2000;
+  std::vector<Addr> addrs;
+  for (uint64_t i = 0; i < n; i++) addrs.push_back(make_addr(i));
+  std::mt19937 rng(seed);
+  // Roughly Zipf: address i with weight 1 / (i + 1)
+  std::vector<double> w;
+  for (size_t i = 0; i < n; i++) w.push_back(1.0 / (i + 1));
+  std::discrete_distribution<size_t> zipf(w.begin(), w.end());
+
+  SpaceSaving a(64), b(64);
+  std::map<size_t, uint64_t> truth;
+  for (int i = 0; i < 100000; i++) {
+    size_t k = zipf(rng);
+    // The second half of the stream prefers other addresses
+    if (i >= 50000) k = (k + 7) % n;
+    (i < 50000 ? a : b).add(addrs[k]);
+    truth[k]++;
+  }
+  EXPECT_GT(a.min_count(), 0u);
+  EXPECT_GT(b.min_count(), 0u);
+  a.merge(b);
+  EXPECT_EQ(a.total(), 100000u);
+  EXPECT_EQ(a.counters().size(), 64u);
+  check_bounds(a, truth, addrs);
+
+  // The merged sketch keeps working: its index finds every address
+  for (const auto &c : a.counters()) {
+    size_t before = a.counters().size();
+    a.add(c.addr);
+    EXPECT_EQ(a.counters().size(), before);
+  }
+}
+
+TEST(SpaceSaving, MergeBounds) {
+  for (unsigned seed = 1; seed <= 20; seed++) {
+    SCOPED_TRACE(seed);
+    merge_bounds(seed);
+  }
+}
+
+// Merging with an empty or a partly filled sketch adds no error
+TEST(SpaceSaving, MergeNotFull) {
+  SpaceSaving a(16), b(16), empty(16);
+  for (uint64_t i = 0; i < 5; i++) a.add(make_addr(i), i + 1);
+  for (uint64_t i = 3; i < 8; i++) b.add(make_addr(i), 10);
+  a.merge(empty);
+  EXPECT_EQ(a.total(), 15u);
+  a.merge(b);
+  EXPECT_EQ(a.total(), 65u);
+  std::vector<SpaceSaving::Counter> c = a.counters();
+  ASSERT_EQ(c.size(), 8u);
+  for (const auto &x : c) {
+    uint64_t id;
+    memcpy(&id, x.addr.bytes + 8, 8);
+    uint64_t want = (id < 5 ? id + 1 : 0) + (id >= 3 ? 10 : 0);
+    EXPECT_EQ(x.count, want) << id;
+    EXPECT_EQ(x.error, 0u) << id;
+  }
+}
@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+
+// hex-dump is a program, not a library: these tests run the binary next
+// to them and check what it prints.
+
+// A file in /tmp for the length of a test
+class TempFile {
+ public:
+  explicit TempFile(const std::string &data) {
+    char name[] = "/tmp/unittest-hex-dump-XXXXXX";
+    int fd = mkstemp(name);
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ(write(fd, data.data(), data.size()), (ssize_t)data.size());
+    close(fd);
+    path = name;
+  }
+  ~TempFile() { unlink(path.c_str()); }
+
+  std::string path;
+};
+
+struct Result {
+  int status;
+  std::string out;
+};
+
+static Result run(const std::string &args) {
+  std::string cmd = "timeout 10 ./hex-dump " + args + " 2>&1";
+  FILE *p = popen(cmd.c_str(), "r");
+  Result r = { -1, "" };
+  if (!p) return r;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), p)) > 0) r.out.append(buf, n);
+  int st = pclose(p);
+  r.status = WIFEXITED(st) ? WEXITSTATUS(st) : -1;
+  return r;
+}
+
+static std::string bytes(size_t len) {
+  std::string s;
+  for (size_t i = 0; i < len; i++) s += (char)i;
+  return s;
+}
+
+// A difference on the short last line covers only the bytes that differ
+TEST(TestHexDumpDiff, ShortLastLine) {
+  std::string a = bytes(20), b = a;
+  b[0x13] = (char)0xff;
+  TempFile fa(a), fb(b);
+  Result r = run("-d " + fb.path + " " + fa.path);
+  EXPECT_EQ(r.status, 1);
+  EXPECT_NE(r.out.find("0x00000013-0x00000014 differ (1 bytes)"),
+            std::string::npos)
+      << r.out;
+  EXPECT_NE(r.out.find("1 bytes in 1 ranges differ"), std::string::npos);
+}
+
+TEST(TestHexDumpDiff, Identical) {
+  for (size_t len : {0, 1, 16, 20, 4096, 4099}) {
+    TempFile fa(bytes(len)), fb(bytes(len));
+    Result r = run("-d " + fb.path + " " + fa.path);
+    EXPECT_EQ(r.status, 0) << len;
+    EXPECT_EQ(r.out, "0 bytes in 0 ranges differ\n") << len;
+  }
+}
+
+TEST(TestHexDumpDiff, Ranges) {
+  std::string a = bytes(100), b = a;
+  b[3] = b[4] = 0;  // one range across two bytes
+  b[15] = b[16] = 0;  // one range across a line boundary
+  b[99] = 0;  // the last byte
+  TempFile fa(a), fb(b), shorter(a.substr(0, 90));
+  Result r = run("-d " + fb.path + " " + fa.path);
+  EXPECT_EQ(r.status, 1);
+  EXPECT_NE(r.out.find("0x00000003-0x00000005 differ (2 bytes)"),
+            std::string::npos)
+      << r.out;
+  EXPECT_NE(r.out.find("0x0000000f-0x00000011 differ (2 bytes)"),
+            std::string::npos)
+      << r.out;
+  EXPECT_NE(r.out.find("0x00000063-0x00000064 differ (1 bytes)"),
+            std::string::npos)
+      << r.out;
+  EXPECT_NE(r.out.find("5 bytes in 3 ranges differ"), std::string::npos);
+
+  r = run("-d " + shorter.path + " " + fa.path);
+  EXPECT_EQ(r.status, 1);
+  EXPECT_NE(r.out.find("0x0000005a-0x00000064 only in " + fa.path +
+                       " (10 bytes)"),
+            std::string::npos)
+      << r.out;
+}
+
+// A match must lie entirely in the window, and its context lines are
+// those of the lines it touches
+TEST(TestHexDumpPattern, Window) {
+  std::string data(72, 'x');
+  data += "ABCDyyyy";
+  TempFile f(data);
+  Result r = run("-p 41424344 " + f.path);
+  EXPECT_EQ(r.status, 0);
+  EXPECT_EQ(r.out,
+            "match 0x00000048\n"
+            "0x00000030 : 7878 7878 7878 7878 7878 7878 7878 7878 "
+            "xxxxxxxxxxxxxxxx\n"
+            "0x00000040 : 7878 7878 7878 7878 4142 4344 7979 7979 "
+            "xxxxxxxxABCDyyyy\n");
+  // Cut off by the end of the window
+  r = run("-p 41424344 -n 74 " + f.path);
+  EXPECT_EQ(r.status, 1);
+  EXPECT_EQ(r.out, "");
+  r = run("-p 41424344 -n 76 -C 0 " + f.path);
+  EXPECT_EQ(r.status, 0);
+  EXPECT_NE(r.out.find("match 0x00000048"), std::string::npos);
+}
+
+// Matches across line, vector and page boundaries, each one found. The
+// first three are close enough to share one group.
+TEST(TestHexDumpPattern, Boundaries) {
+  std::string data(8192, '.');
+  for (size_t pos : {0, 14, 31, 4094, 8188})
+    data.replace(pos, 4, "\x7f" "ELF");
+  TempFile f(data);
+  Result r = run("-p 7f454c46 -C 0 " + f.path);
+  EXPECT_EQ(r.status, 0);
+  for (const char *want : {"match 0x00000000 (+2 more)\n",
+                           "0x00000010 : 4c46 ", "0x00000020 : 454c 462e ",
+                           "--\nmatch 0x00000ffe\n", "0x00001000 : 4c46 ",
+                           "--\nmatch 0x00001ffc\n"})
+    EXPECT_NE(r.out.find(want), std::string::npos) << want << r.out;
+}
+
+// Names longer than any buffer are written whole, and nothing else
+TEST(TestHexDumpC, LongName) {
+  TempFile f("ab");
+  std::string name(700, 'a');
+  Result r = run("-f c -N " + name + " " + f.path);
+  EXPECT_EQ(r.status, 0);
+  EXPECT_EQ(r.out, "unsigned char " + name + "[] = {\n  0x61, 0x62,\n};\n" +
+                       "unsigned long long " + name + "_len = 2;\n");
+}
+
+// Squeezing would leave out bytes and put a '*' in the initializer
+TEST(TestHexDumpC, NoSqueeze) {
+  TempFile f(std::string(48, '\0'));
+  Result r = run("-z -f c -N z " + f.path);
+  EXPECT_EQ(r.status, 0);
+  std::string row = "  ";
+  for (int i = 0; i < 16; i++) row += "0x00, ";
+  row.back() = '\n';
+  EXPECT_EQ(r.out, "unsigned char z[] = {\n" + row + row + row + "};\n" +
+                       "unsigned long long z_len = 48;\n");
+}
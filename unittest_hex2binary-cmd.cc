@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// Runs the hex2binary-cmd binary next to the tests, for what depends on
+// where its output goes.
+
+// A file in /tmp for the length of a test
+class TempFile {
+ public:
+  explicit TempFile(const std::string &data) {
+    char name[] = "/tmp/unittest-hex2binary-cmd-XXXXXX";
+    int fd = mkstemp(name);
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ(write(fd, data.data(), data.size()), (ssize_t)data.size());
+    close(fd);
+    path = name;
+  }
+  ~TempFile() { unlink(path.c_str()); }
+
+  std::string contents() const {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream s;
+    s << in.rdbuf();
+    return s.str();
+  }
+
+  std::string path;
+};
+
+// Exit status of the command, with its output appended to `out`
+static int run_appending(const std::string &args, const TempFile &out) {
+  std::string cmd = "timeout 10 ./hex2binary-cmd " + args + " >> " +
+                    out.path + " 2>/dev/null";
+  int st = system(cmd.c_str());
+  return WIFEXITED(st) ? WEXITSTATUS(st) : -1;
+}
+
+static std::string test_bytes(size_t len) {
+  std::string s;
+  for (size_t i = 0; i < len; i++) s += (char)(i * 131 + i / 1000);
+  return s;
+}
+
+static std::string to_hex(const std::string &s) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  for (size_t i = 0; i < s.size(); i++) {
+    unsigned char c = s[i];
+    hex += digits[c >> 4];
+    hex += digits[c & 15];
+    if (i % 32 == 31) hex += '\n';
+  }
+  return hex;
+}
+
+// The threads write their parts at offsets, which an appending stdout
+// would ignore
+TEST(TestHex2BinaryCmd, ParallelAppend) {
+  std::string bytes = test_bytes(100000);
+  TempFile in(to_hex(bytes)), out("head");
+  EXPECT_EQ(run_appending("-j 4 " + in.path, out), 0);
+  EXPECT_EQ(out.contents(), "head" + bytes);
+}
+
+// Squeezed zeroes are left as holes by seeking, which an appending stdout
+// would ignore too
+TEST(TestHex2BinaryCmd, ReverseAppend) {
+  TempFile in(
+      "0x00000000 : 0000 0000 0000 0000 0000 0000 0000 0000 "
+      "................\n"
+      "*\n"
+      "0x00002000 : 6162                                    ab\n"
+      "0x00002002 :\n"),
+      out("head");
+  EXPECT_EQ(run_appending("-r " + in.path, out), 0);
+  EXPECT_EQ(out.contents(), "head" + std::string(8192, '\0') + "ab");
+}
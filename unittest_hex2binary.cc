@@ -1,8 +1,11 @@
 #include <gtest/gtest.h>
 
-extern "C" {
-#include "hex2binary.c"
-}
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "hex2binary.h"
 
 std::vector<std::tuple<const char *, const char *>> test_strings{
     {"", ""},
@@ -25,3 +28,286 @@ TEST(TestHex2Binary, Test1) {
     // EXPECT_EQ(error, 0);
   }
 }
+
+// Straightforward decoder to check the vector kernels against
+static std::string reference_decode(const std::string &hex) {
+  auto val = [](char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return c - 'A' + 10;
+  };
+  std::string out;
+  size_t i = 0;
+  if (hex.size() % 2) out += char(val(hex[i++]));
+  for (; i < hex.size(); i += 2)
+    out += char(val(hex[i]) << 4 | val(hex[i + 1]));
+  return out;
+}
+
+static std::string random_hex(size_t len, unsigned seed) {
+  static const char digits[] = "0123456789abcdefABCDEF";
+  std::string s;
+  srand(seed);
+  for (size_t i = 0; i < len; i++) s += digits[rand() % 22];
+  return s;
+}
+
+TEST(TestHex2Binary, LongInputs) {
+  std::vector<char> buf(1024);
+  for (size_t len = 1; len < 2 * buf.size(); len += len < 200 ? 1 : 37) {
+    std::string hex = random_hex(len, len);
+    int error;
+    size_t s = decode_hex_to_binary(hex.data(), hex.size(), buf.data(),
+                                    buf.size(), &error);
+    ASSERT_EQ(error, 0) << len;
+    ASSERT_EQ(std::string(buf.data(), s), reference_decode(hex)) << len;
+  }
+}
+
+TEST(TestHex2Binary, InvalidCharAtAnyOffset) {
+  std::vector<char> buf(256);
+  std::string good = random_hex(400, 7);
+  for (size_t pos = 0; pos < good.size(); pos++) {
+    for (char bad : {'g', 'G', ' ', '/', ':', '@', '`', '\x80'}) {
+      std::string hex = good;
+      hex[pos] = bad;
+      int error;
+      size_t s = decode_hex_to_binary(hex.data(), hex.size(), buf.data(),
+                                      buf.size(), &error);
+      EXPECT_EQ(error, -1);
+      // Everything before the offending pair is decoded
+      ASSERT_EQ(s, pos / 2) << pos;
+      ASSERT_EQ(std::string(buf.data(), s),
+                reference_decode(good.substr(0, pos & ~size_t(1))));
+    }
+  }
+}
+
+TEST(TestHex2Binary, OddLengthAndShortOutput) {
+  std::string hex = "f" + random_hex(200, 3);
+  std::vector<char> buf(64);
+  int error;
+  size_t s = decode_hex_to_binary(hex.data(), hex.size(), buf.data(),
+                                  buf.size(), &error);
+  EXPECT_EQ(error, 0);
+  ASSERT_EQ(s, buf.size());
+  EXPECT_EQ(buf[0], '\x0f');
+  EXPECT_EQ(std::string(buf.data(), s), reference_decode(hex).substr(0, 64));
+}
+
+TEST(TestHexStream, SplitAnywhere) {
+  std::string digits = random_hex(301, 11);
+  std::string text;
+  for (size_t i = 0; i < digits.size(); i++) {
+    text += digits[i];
+    if (i % 61 == 60) text += "\r\n";
+    if (i % 7 == 3) text += ' ';
+  }
+  std::string expected = reference_decode(digits.substr(0, 300));
+  for (size_t cut = 0; cut <= text.size(); cut++) {
+    struct hex_stream hs;
+    std::vector<char> buf(text.size() / 2 + 2);
+    int error;
+    hex_stream_init(&hs);
+    size_t n = hex_stream_decode(&hs, text.data(), cut, buf.data(), &error);
+    ASSERT_EQ(error, 0);
+    n += hex_stream_decode(&hs, text.data() + cut, text.size() - cut,
+                           buf.data() + n, &error);
+    ASSERT_EQ(error, 0);
+    // 301 digits: the last one is still waiting for its pair
+    EXPECT_EQ(hex_stream_finish(&hs, buf.data() + n), -1);
+    ASSERT_EQ(std::string(buf.data(), n), expected) << cut;
+  }
+}
+
+TEST(TestHexStream, ErrorOffset) {
+  std::string text = "0011\n22x3\n";
+  struct hex_stream hs;
+  char buf[8];
+  int error;
+  hex_stream_init(&hs);
+  size_t n = hex_stream_decode(&hs, text.data(), text.size(), buf, &error);
+  EXPECT_EQ(error, -1);
+  EXPECT_EQ(n, 3u);
+  EXPECT_EQ(hs.offset, 7u);
+}
+
+// Megabytes of separated pairs on one line: each pair is decoded on its
+// own, which must not look for the end of the line each time
+TEST(TestHexStream, LongSeparatedLine) {
+  std::string digits = random_hex(4 << 20, 12);
+  std::string text;
+  for (size_t i = 0; i < digits.size(); i += 2) {
+    text += digits.substr(i, 2);
+    text += ' ';
+  }
+  struct hex_stream hs;
+  std::vector<char> buf(digits.size() / 2);
+  int error;
+  hex_stream_init(&hs);
+  size_t n = hex_stream_decode(&hs, text.data(), text.size(), buf.data(),
+                               &error);
+  ASSERT_EQ(error, 0);
+  EXPECT_EQ(hex_stream_finish(&hs, buf.data() + n), 0);
+  EXPECT_EQ(std::string(buf.data(), n), reference_decode(digits));
+}
+
+// Every cut also splits the "0x" prefixes and the ':' separated bytes in
+// all possible places. Long enough for the vector loops to run.
+TEST(TestHexStream, TolerantSplitAnywhere) {
+  std::string digits = random_hex(400, 5);
+  std::string text;
+  for (size_t i = 0; i < digits.size(); i += 2) {
+    switch (i / 2 % 5) {
+      case 0: text += "0x"; break;
+      case 1: text += "0X"; break;
+      case 2: text += ':'; break;
+      case 3: text += " - "; break;
+      default: text += "\r\n"; break;
+    }
+    text += digits.substr(i, 2);
+  }
+  text += "\n00";  // a last byte that is all '0'
+  std::string expected = reference_decode(digits) + '\0';
+  for (size_t cut = 0; cut <= text.size(); cut++) {
+    struct hex_stream hs;
+    std::vector<char> buf(text.size() / 2 + 2);
+    int error;
+    hex_stream_init(&hs);
+    hs.mode = HEX_TOLERANT;
+    size_t n = hex_stream_decode(&hs, text.data(), cut, buf.data(), &error);
+    ASSERT_EQ(error, 0);
+    n += hex_stream_decode(&hs, text.data() + cut, text.size() - cut,
+                           buf.data() + n, &error);
+    ASSERT_EQ(error, 0);
+    int k = hex_stream_finish(&hs, buf.data() + n);
+    ASSERT_GE(k, 0) << cut;
+    ASSERT_EQ(std::string(buf.data(), n + k), expected) << cut;
+  }
+}
+
+TEST(TestHexStream, TolerantErrorOffset) {
+  std::string text(200, ' ');
+  text.replace(3, 11, "0xde:ad-bef");
+  text[150] = 'g';
+  struct hex_stream hs;
+  std::vector<char> buf(text.size());
+  int error;
+  hex_stream_init(&hs);
+  hs.mode = HEX_TOLERANT;
+  size_t n = hex_stream_decode(&hs, text.data(), text.size(), buf.data(),
+                               &error);
+  EXPECT_EQ(error, -1);
+  EXPECT_EQ(hs.offset, 150u);
+  EXPECT_EQ(std::string(buf.data(), n), "\xde\xad\xbe");
+
+  // A strict stream rejects the separators
+  hex_stream_init(&hs);
+  hex_stream_decode(&hs, text.data(), text.size(), buf.data(), &error);
+  EXPECT_EQ(error, -1);
+  EXPECT_EQ(hs.offset, 4u);
+}
+
+// An 'x' only belongs right after the '0' of a prefix, anywhere else it is
+// invalid, whichever loop sees it
+TEST(TestHexStream, TolerantBareX) {
+  struct hex_stream hs;
+  char buf[16];
+  int error;
+  for (const char *bad : {"dexxad", "de x ad", "x0de", "0xxde", "de:x"}) {
+    hex_stream_init(&hs);
+    hs.mode = HEX_TOLERANT;
+    hex_stream_decode(&hs, bad, strlen(bad), buf, &error);
+    EXPECT_EQ(error, -1) << bad;
+  }
+
+  std::string digits = random_hex(300, 6);
+  std::string text;
+  for (size_t i = 0; i < digits.size(); i += 2)
+    text += (i / 2 % 3 ? " " : " 0x") + digits.substr(i, 2);
+  for (size_t at = 0; at < text.size(); at++) {
+    // After a digit '0' the 'x' makes a prefix
+    if (text[at] != ' ' || (at > 0 && text[at - 1] == '0')) continue;
+    std::string t = text;
+    t[at] = 'x';
+    std::vector<char> out(t.size());
+    hex_stream_init(&hs);
+    hs.mode = HEX_TOLERANT;
+    hex_stream_decode(&hs, t.data(), t.size(), out.data(), &error);
+    ASSERT_EQ(error, -1) << at;
+    EXPECT_EQ(hs.offset, at);
+  }
+}
+
+// A line the way hex-dump prints it
+static std::string dump_line(uint64_t offset, const std::string &bytes) {
+  char buf[128];
+  std::string hex, ascii;
+  int n = snprintf(buf, sizeof(buf), "0x%.8llx : ", (unsigned long long)offset);
+  for (size_t i = 0; i < bytes.size(); i++) {
+    snprintf(buf + n, sizeof(buf) - n, "%02x", (unsigned char)bytes[i]);
+    hex += buf + n;
+    if (i % 2 && i + 1 < bytes.size()) hex += ' ';
+    ascii += isprint((unsigned char)bytes[i]) ? bytes[i] : '.';
+  }
+  hex.resize(39, ' ');
+  return std::string(buf, n) + hex + ' ' + ascii;
+}
+
+TEST(TestHexDump, ParseLine) {
+  std::string digits = random_hex(64, 3);
+  std::string bytes = reference_decode(digits);
+  uint64_t offset;
+  char bin[16];
+  size_t n;
+  for (size_t len = 1; len <= 16; len++) {
+    std::string line = dump_line(0x1230 + len, bytes.substr(len, len));
+    ASSERT_EQ(hexdump_parse_line(line.data(), line.size(), &offset, bin, &n),
+              HEXDUMP_DATA)
+        << line;
+    EXPECT_EQ(offset, 0x1230 + len);
+    EXPECT_EQ(std::string(bin, n), bytes.substr(len, len));
+  }
+
+  std::string end = "0x100000040 :";
+  EXPECT_EQ(hexdump_parse_line(end.data(), end.size(), &offset, bin, &n),
+            HEXDUMP_END);
+  EXPECT_EQ(offset, 0x100000040u);
+  EXPECT_EQ(hexdump_parse_line("*", 1, &offset, bin, &n), HEXDUMP_REPEAT);
+
+  std::string line = dump_line(0, bytes.substr(0, 16));
+  std::vector<std::string> bad = {
+      line.substr(0, line.size() - 1),  // ascii column cut short
+      line.substr(0, 30),
+      "0x : 0011",
+      "00000000: 0011 2233  .\"3",  // xxd
+  };
+  line[20] = 'x';
+  bad.push_back(line);
+  line = dump_line(0, bytes.substr(0, 16));
+  line[17] = '0';  // no space between two groups
+  bad.push_back(line);
+  for (auto &b : bad)
+    EXPECT_EQ(hexdump_parse_line(b.data(), b.size(), &offset, bin, &n),
+              HEXDUMP_BAD)
+        << b;
+}
+
+TEST(TestHex2Binary, CountDigits) {
+  std::string digits = random_hex(1000, 9);
+  std::string text;
+  for (size_t i = 0; i < digits.size(); i++) {
+    text += digits[i];
+    if (i % 61 == 60) text += "\r\n";
+    if (i % 7 == 3) text += ' ';
+    if (i % 300 == 0) text += "\t\t";
+  }
+  for (size_t len = 0; len <= text.size(); len += 37) {
+    size_t expected = 0;
+    for (size_t i = 0; i < len; i++) expected += !isspace(text[i]);
+    ASSERT_EQ(hex_count_digits(text.data(), len), expected) << len;
+  }
+  // More than the 255 vectors an 8 bit counter holds
+  std::string spaces(100000, ' ');
+  EXPECT_EQ(hex_count_digits(spaces.data(), spaces.size()), 0u);
+}
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+
+#include "hexcodec.h"
+
+static std::string random_bytes(size_t len, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::string s(len, '\0');
+  for (auto &c : s) c = rng();
+  return s;
+}
+
+// printf at a byte at a time, to check the kernels against
+static std::string reference_encode(const std::string &bin, bool upper,
+                                    char sep, size_t group) {
+  std::string out;
+  for (size_t i = 0; i < bin.size(); i++) {
+    char digits[3];
+    snprintf(digits, sizeof(digits), upper ? "%02X" : "%02x",
+             (unsigned char)bin[i]);
+    if (i > 0 && sep && group && i % group == 0) out += sep;
+    out += digits;
+  }
+  return out;
+}
+
+static std::string encode(const std::string &bin, int flags, char sep,
+                          size_t group) {
+  // One more char than needed, to catch writes past the end
+  std::string out(hex_encoded_len(bin.size(), sep, group) + 1, '!');
+  size_t n = hex_encode(out.data(), bin.data(), bin.size(), flags, sep, group);
+  EXPECT_EQ(n, out.size() - 1);
+  EXPECT_EQ(out.back(), '!');
+  out.pop_back();
+  return out;
+}
+
+TEST(TestHexCodec, EncodeAllLengths) {
+  for (size_t len = 0; len < 300; len++) {
+    std::string bin = random_bytes(len, len);
+    for (int flags : {HEX_LOWER, HEX_UPPER}) {
+      for (auto [sep, group] : {std::pair<char, size_t>{0, 0}, {':', 0},
+                                {':', 1}, {' ', 2}, {'-', 3}, {' ', 16},
+                                {' ', 40}}) {
+        ASSERT_EQ(encode(bin, flags, sep, group),
+                  reference_encode(bin, flags & HEX_UPPER, sep, group))
+            << len << " '" << sep << "' " << group;
+      }
+    }
+  }
+}
+
+TEST(TestHexCodec, EncodeAllBytes) {
+  std::string bin;
+  for (int b = 0; b < 256; b++) bin += (char)b;
+  std::string hex = encode(bin, HEX_LOWER, 0, 0);
+  for (int b = 0; b < 256; b++) {
+    char digits[3];
+    snprintf(digits, sizeof(digits), "%02x", b);
+    ASSERT_EQ(hex.substr(2 * b, 2), digits);
+    ASSERT_EQ(std::string(&hex_pairs_lower[2 * b], 2), digits);
+    snprintf(digits, sizeof(digits), "%02X", b);
+    ASSERT_EQ(std::string(&hex_pairs_upper[2 * b], 2), digits);
+  }
+}
+
+TEST(TestHexCodec, DigitValues) {
+  for (int c = 0; c < 256; c++) {
+    int want = -1;
+    if (c >= '0' && c <= '9') want = c - '0';
+    if (c >= 'a' && c <= 'f') want = c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') want = c - 'A' + 10;
+    ASSERT_EQ(hex_digit_value((char)c), want) << c;
+  }
+}
+
+TEST(TestHexCodec, DecodeRoundTrip) {
+  for (size_t len = 0; len < 300; len++) {
+    std::string bin = random_bytes(len, len + 1000);
+    std::string hex = encode(bin, len % 2 ? HEX_UPPER : HEX_LOWER, 0, 0);
+    std::string out(len + 1, '!');
+    ASSERT_EQ(hex_decode_pairs(hex.data(), out.data(), len), len);
+    EXPECT_EQ(out.substr(0, len), bin);
+    EXPECT_EQ(out[len], '!');
+  }
+}
+
+// Every kernel has to stop at the exact pair, whether the bad char is the
+// first or the second digit of it
+TEST(TestHexCodec, DecodeStopsAtBadPair) {
+  std::string bin = random_bytes(100, 7);
+  std::string good = encode(bin, HEX_LOWER, 0, 0);
+  for (size_t i = 0; i < good.size(); i++) {
+    for (char bad : {'g', 'G', '/', ':', '@', '`', ' ', '\xff'}) {
+      std::string hex = good;
+      hex[i] = bad;
+      std::string out(bin.size(), '\0');
+      size_t n = hex_decode_pairs(hex.data(), out.data(), bin.size());
+      ASSERT_EQ(n, i / 2) << i << " '" << bad << "'";
+      ASSERT_EQ(out.substr(0, n), bin.substr(0, n));
+    }
+  }
+}
+
+TEST(TestHexCodec, Isa) {
+  std::string isa = hexcodec_isa();
+  EXPECT_TRUE(isa == "avx2" || isa == "ssse3" || isa == "scalar") << isa;
+}
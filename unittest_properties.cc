@@ -0,0 +1,512 @@
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "properties-image.h"
+#include "properties-parser.h"
+#include "properties-reload.h"
+
+// A properties file in /tmp for the length of a test
+class TempFile {
+ public:
+  explicit TempFile(const std::string &text) {
+    char name[] = "/tmp/unittest-properties-XXXXXX";
+    int fd = mkstemp(name);
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ(write(fd, text.data(), text.size()), (ssize_t)text.size());
+    close(fd);
+    path = name;
+  }
+  ~TempFile() { unlink(path.c_str()); }
+
+  std::string path;
+};
+
+static const char *lines =
+    "#ENV_CERT_CHAIN = 'radiology'\n"
+    "##ENV_CERT_CHAIN = 'radiology'\n"
+    "dENV_CERT_CHAINd=d' invalid0 'd\n"
+    " ENV_CERT_CHAINd=d' invalid1 'd\n"
+    " ENV_CERT_CHAINd= ' invalid2 'd\n"
+    " #ENV_CERT_CHAIN =\t ' correct1 '\n"
+    "ENV_CERT_CHAIN=' correct2 ' \n"
+    "\n"
+    "   \t\n"
+    "PLAIN='value'\n"
+    "  SPACED  =   'a b c'   \n"
+    "TABS\t=\t'x'\t\n"
+    "EMPTY=''\n"
+    "NO_QUOTES=value\n"
+    "ONE_QUOTE='value\n"
+    "TWO WORDS='v'\n"
+    "EXTRA='v' x\n"
+    "DOUBLE=='v'\n"
+    "FIRST='1'\n"
+    "FIRST='2'\n"
+    "EQUALS='a=b'\n"
+    "CR='v'\r\n"
+    "LAST_NO_NEWLINE='v'";
+
+static const std::vector<std::string> keys = {
+    "ENV_CERT_CHAIN", "#ENV_CERT_CHAIN", "PLAIN",      "SPACED",
+    "TABS",           "EMPTY",           "NO_QUOTES",  "ONE_QUOTE",
+    "TWO",            "TWO WORDS",       "EXTRA",      "DOUBLE",
+    "FIRST",          "EQUALS",          "CR",         "LAST_NO_NEWLINE",
+    "MISSING"};
+
+static struct parse_ctx test_ctx() {
+  struct parse_ctx pctx;
+  init_parse_ctx(&pctx);
+  pctx.white_space = " \t";
+  pctx.comment_prefix = "##";
+  return pctx;
+}
+
+// Every key has the value that scanning the file finds for it
+TEST(TestPropsStore, SameAsScanning) {
+  TempFile f(lines);
+  struct parse_ctx pctx = test_ctx();
+  struct props_store s;
+  ASSERT_EQ(props_store_load(&s, f.path.c_str(), &pctx), 0);
+  for (const auto &key : keys) {
+    char value[MAX_VALUE_SIZE];
+    int err = parse_key_value_from_file(f.path.c_str(), key.c_str(), value,
+                                        &pctx);
+    const char *v = props_store_get(&s, key.c_str());
+    if (err != 0) {
+      EXPECT_EQ(v, nullptr) << key;
+    } else {
+      ASSERT_NE(v, nullptr) << key;
+      EXPECT_STREQ(v, value) << key;
+    }
+  }
+  EXPECT_STREQ(props_store_get(&s, "ENV_CERT_CHAIN"), " correct2 ");
+  EXPECT_STREQ(props_store_get(&s, "#ENV_CERT_CHAIN"), "radiology");
+  EXPECT_STREQ(props_store_get(&s, "SPACED"), "a b c");
+  EXPECT_STREQ(props_store_get(&s, "EMPTY"), "");
+  EXPECT_STREQ(props_store_get(&s, "FIRST"), "1");
+  EXPECT_EQ(props_store_get(&s, "CR"), nullptr);
+  props_store_free(&s);
+}
+
+// The default context: no quirks of the one above
+TEST(TestPropsStore, DefaultContext) {
+  TempFile f("# comment = 'no'\n\vKEY\v=\v'v'\v\n");
+  struct props_store s;
+  ASSERT_EQ(props_store_load(&s, f.path.c_str(), nullptr), 0);
+  EXPECT_EQ(s.count, 1u);
+  EXPECT_STREQ(props_store_get(&s, "KEY"), "v");
+  EXPECT_EQ(props_store_get(&s, "# comment"), nullptr);
+  props_store_free(&s);
+}
+
+// Scanning matches any key that starts with the word of a line, the
+// store only the word itself
+TEST(TestPropsStore, ExactKeys) {
+  TempFile f("KEY='v'\n");
+  struct props_store s;
+  ASSERT_EQ(props_store_load(&s, f.path.c_str(), nullptr), 0);
+  EXPECT_STREQ(props_store_get(&s, "KEY"), "v");
+  EXPECT_EQ(props_store_get(&s, "KEY_LONGER"), nullptr);
+  EXPECT_EQ(props_store_get(&s, "KE"), nullptr);
+  EXPECT_EQ(props_store_get(&s, ""), nullptr);
+  props_store_free(&s);
+}
+
+TEST(TestPropsStore, ManyKeys) {
+  std::string text;
+  for (int i = 0; i < 10000; i++)
+    text += "key." + std::to_string(i) + " = '" + std::to_string(i * 7) +
+            "'\n";
+  TempFile f(text);
+  struct props_store s;
+  ASSERT_EQ(props_store_load(&s, f.path.c_str(), nullptr), 0);
+  EXPECT_EQ(s.count, 10000u);
+
+  std::vector<std::string> names;
+  for (int i = -50; i < 10050; i += 3)
+    names.push_back("key." + std::to_string(i));
+  std::vector<const char *> ptrs, values(names.size());
+  for (const auto &n : names) ptrs.push_back(n.c_str());
+  size_t found =
+      props_store_get_many(&s, ptrs.data(), ptrs.size(), values.data());
+
+  size_t want = 0;
+  for (size_t j = 0; j < names.size(); j++) {
+    int i = -50 + 3 * j;
+    if (i < 0 || i >= 10000) {
+      EXPECT_EQ(values[j], nullptr) << names[j];
+      continue;
+    }
+    want++;
+    ASSERT_NE(values[j], nullptr) << names[j];
+    EXPECT_EQ(values[j], std::to_string(i * 7));
+    EXPECT_EQ(values[j], props_store_get(&s, names[j].c_str()));
+  }
+  EXPECT_EQ(found, want);
+  props_store_free(&s);
+}
+
+TEST(TestPropsStore, Errors) {
+  struct props_store s;
+  EXPECT_EQ(props_store_load(&s, "/nonexistent/file", nullptr), -1);
+  EXPECT_EQ(errno, ENOENT);
+
+  TempFile f("");
+  ASSERT_EQ(props_store_load(&s, f.path.c_str(), nullptr), 0);
+  EXPECT_EQ(s.count, 0u);
+  EXPECT_EQ(props_store_get(&s, "KEY"), nullptr);
+  const char *key = "KEY", *value = "x";
+  EXPECT_EQ(props_store_get_many(&s, &key, 1, &value), 0u);
+  EXPECT_EQ(value, nullptr);
+  props_store_free(&s);
+}
+
+// The mapped store finds the same values as the loaded one
+TEST(TestPropsStore, MappedSameAsLoaded) {
+  TempFile f(lines);
+  struct parse_ctx pctx = test_ctx();
+  struct props_store loaded, mapped;
+  ASSERT_EQ(props_store_load(&loaded, f.path.c_str(), &pctx), 0);
+  ASSERT_EQ(props_store_map(&mapped, f.path.c_str(), &pctx), 0);
+  EXPECT_TRUE(mapped.mapped);
+  EXPECT_EQ(mapped.count, loaded.count);
+
+  std::vector<const char *> ptrs;
+  for (const auto &k : keys) ptrs.push_back(k.c_str());
+  std::vector<struct props_view> views(keys.size());
+  size_t found =
+      props_store_view_many(&mapped, ptrs.data(), ptrs.size(), views.data());
+  size_t want = 0;
+  for (size_t i = 0; i < keys.size(); i++) {
+    const char *v = props_store_get(&loaded, ptrs[i]);
+    struct props_view view;
+    int err = props_store_view(&mapped, ptrs[i], keys[i].size(), &view);
+    if (!v) {
+      EXPECT_EQ(err, -1) << keys[i];
+      EXPECT_EQ(views[i].data, nullptr) << keys[i];
+      continue;
+    }
+    want++;
+    EXPECT_EQ(err, 0) << keys[i];
+    EXPECT_EQ(std::string(view.data, view.len), v) << keys[i];
+    EXPECT_EQ(std::string(views[i].data, views[i].len), v) << keys[i];
+  }
+  EXPECT_EQ(found, want);
+
+  // Views point into the file, whose text is left as it was
+  struct props_view view;
+  ASSERT_EQ(props_store_view(&mapped, "PLAIN", 5, &view), 0);
+  EXPECT_EQ(view.data[-1], '\'');
+  EXPECT_EQ(view.data[view.len], '\'');
+  EXPECT_EQ(std::string(mapped.arena, mapped.size), lines);
+  props_store_free(&mapped);
+  props_store_free(&loaded);
+}
+
+// No limit on the length of a value: a certificate chain of a few KB, in
+// a line longer than MAX_LINE_SIZE
+TEST(TestPropsStore, LongValues) {
+  std::string chain;
+  for (int i = 0; i < 200; i++) chain += "MIIDdzCCAl+gAwIBAgIEAgAAuTANBgkq";
+  TempFile f("A='short'\nENV_CERT_CHAIN='" + chain + "'\nB='after'\n");
+  struct props_store s;
+  ASSERT_EQ(props_store_map(&s, f.path.c_str(), nullptr), 0);
+  struct props_view view;
+  ASSERT_EQ(props_store_view(&s, "ENV_CERT_CHAIN", 14, &view), 0);
+  EXPECT_EQ(view.len, chain.size());
+  char *copy = props_view_dup(view);
+  EXPECT_EQ(std::string(copy), chain);
+  free(copy);
+  ASSERT_EQ(props_store_view(&s, "B", 1, &view), 0);
+  EXPECT_EQ(std::string(view.data, view.len), "after");
+  props_store_free(&s);
+
+  // The old parser truncates it
+  char value[MAX_VALUE_SIZE];
+  ASSERT_EQ(parse_key_value_from_file(f.path.c_str(), "ENV_CERT_CHAIN", value,
+                                      nullptr),
+            0);
+  EXPECT_EQ(std::string(value), chain.substr(0, MAX_VALUE_SIZE - 1));
+}
+
+// Keys are any span, not only NUL terminated strings
+TEST(TestPropsStore, ViewKeySpans) {
+  TempFile f("KEY='v'\n");
+  struct props_store s;
+  ASSERT_EQ(props_store_map(&s, f.path.c_str(), nullptr), 0);
+  struct props_view view;
+  EXPECT_EQ(props_store_view(&s, "KEYS", 3, &view), 0);
+  EXPECT_EQ(std::string(view.data, view.len), "v");
+  EXPECT_EQ(props_store_view(&s, "KEYS", 4, &view), -1);
+  EXPECT_EQ(view.data, nullptr);
+  props_store_free(&s);
+
+  TempFile empty("");
+  ASSERT_EQ(props_store_map(&s, empty.path.c_str(), nullptr), 0);
+  EXPECT_EQ(props_store_view(&s, "KEY", 3, &view), -1);
+  props_store_free(&s);
+  EXPECT_EQ(props_store_map(&s, "/nonexistent/file", nullptr), -1);
+  EXPECT_EQ(errno, ENOENT);
+}
+
+// Replaces the file the way editors and deployment tools do: a new file
+// renamed over the old one
+static void replace_file(const std::string &path, const std::string &text) {
+  std::string tmp = path + ".new";
+  FILE *f = fopen(tmp.c_str(), "w");
+  ASSERT_NE(f, nullptr);
+  fwrite(text.data(), 1, text.size(), f);
+  fclose(f);
+  ASSERT_EQ(rename(tmp.c_str(), path.c_str()), 0);
+}
+
+static uint64_t wait_for_generation(struct props_reader *rd, uint64_t gen) {
+  for (int i = 0; i < 500; i++) {
+    const struct props_snapshot *snap = props_read_begin(rd);
+    uint64_t g = snap->generation;
+    props_read_end(rd);
+    if (g >= gen) return g;
+    usleep(10000);
+  }
+  return 0;
+}
+
+TEST(TestPropsReload, WatchesFile) {
+  TempFile f("KEY='1'\n");
+  struct props_reloader *r = props_reloader_open(f.path.c_str(), nullptr);
+  ASSERT_NE(r, nullptr);
+  struct props_reader rd;
+  ASSERT_EQ(props_reader_register(r, &rd), 0);
+
+  const struct props_snapshot *snap = props_read_begin(&rd);
+  EXPECT_EQ(snap->generation, 1u);
+  EXPECT_STREQ(props_store_get(&snap->store, "KEY"), "1");
+  props_read_end(&rd);
+
+  replace_file(f.path, "KEY='2'\nNEW='x'\n");
+  ASSERT_GE(wait_for_generation(&rd, 2), 2u);
+  snap = props_read_begin(&rd);
+  EXPECT_STREQ(props_store_get(&snap->store, "KEY"), "2");
+  EXPECT_STREQ(props_store_get(&snap->store, "NEW"), "x");
+  props_read_end(&rd);
+
+  // Written in place
+  FILE *out = fopen(f.path.c_str(), "w");
+  ASSERT_NE(out, nullptr);
+  fputs("KEY='3'\n", out);
+  fclose(out);
+  uint64_t gen = wait_for_generation(&rd, 3);
+  ASSERT_GE(gen, 3u);
+  snap = props_read_begin(&rd);
+  EXPECT_STREQ(props_store_get(&snap->store, "KEY"), "3");
+  EXPECT_EQ(props_store_get(&snap->store, "NEW"), nullptr);
+  props_read_end(&rd);
+
+  props_reader_unregister(&rd);
+  props_reloader_close(r);
+}
+
+// A reload waits for the reads that began before it, the snapshot they
+// hold stays intact until they end
+TEST(TestPropsReload, WaitsForReaders) {
+  TempFile f("KEY='old'\n");
+  struct props_reloader *r = props_reloader_open(f.path.c_str(), nullptr);
+  ASSERT_NE(r, nullptr);
+  struct props_reader rd;
+  ASSERT_EQ(props_reader_register(r, &rd), 0);
+
+  const struct props_snapshot *snap = props_read_begin(&rd);
+  std::atomic<bool> done{false};
+  std::thread reloader([&] {
+    EXPECT_EQ(props_reload(r), 0);
+    done = true;
+  });
+  usleep(50000);
+  EXPECT_FALSE(done);
+  EXPECT_EQ(snap->generation, 1u);
+  EXPECT_STREQ(props_store_get(&snap->store, "KEY"), "old");
+  props_read_end(&rd);
+  reloader.join();
+  EXPECT_TRUE(done);
+  snap = props_read_begin(&rd);
+  EXPECT_EQ(snap->generation, 2u);
+  props_read_end(&rd);
+  props_reader_unregister(&rd);
+  props_reloader_close(r);
+}
+
+TEST(TestPropsReload, FailedReloadKeepsSnapshot) {
+  TempFile f("KEY='v'\n");
+  struct props_reloader *r = props_reloader_open(f.path.c_str(), nullptr);
+  ASSERT_NE(r, nullptr);
+  struct props_reader rd;
+  ASSERT_EQ(props_reader_register(r, &rd), 0);
+  unlink(f.path.c_str());
+  EXPECT_EQ(props_reload(r), -1);
+  uint64_t reloads, errors;
+  props_reload_stats(r, &reloads, &errors);
+  EXPECT_EQ(reloads, 0u);
+  EXPECT_EQ(errors, 1u);
+  const struct props_snapshot *snap = props_read_begin(&rd);
+  EXPECT_STREQ(props_store_get(&snap->store, "KEY"), "v");
+  props_read_end(&rd);
+  props_reader_unregister(&rd);
+  props_reloader_close(r);
+
+  EXPECT_EQ(props_reloader_open("/nonexistent/file", nullptr), nullptr);
+  EXPECT_EQ(errno, ENOENT);
+}
+
+TEST(TestPropsReload, ReaderSlots) {
+  TempFile f("KEY='v'\n");
+  struct props_reloader *r = props_reloader_open(f.path.c_str(), nullptr);
+  ASSERT_NE(r, nullptr);
+  std::vector<struct props_reader> readers(PROPS_MAX_READERS + 1);
+  for (int i = 0; i < PROPS_MAX_READERS; i++)
+    ASSERT_EQ(props_reader_register(r, &readers[i]), 0);
+  EXPECT_EQ(props_reader_register(r, &readers.back()), -1);
+  props_reader_unregister(&readers[3]);
+  EXPECT_EQ(props_reader_register(r, &readers.back()), 0);
+  EXPECT_EQ(readers.back().slot, 3);
+  for (int i = 0; i < PROPS_MAX_READERS; i++)
+    if (i != 3) props_reader_unregister(&readers[i]);
+  props_reader_unregister(&readers.back());
+  props_reloader_close(r);
+}
+
+// Compiles the file into an image next to it
+static std::string compile(const TempFile &f, const struct parse_ctx *pctx) {
+  struct props_store s;
+  std::string image = f.path + ".img";
+  EXPECT_EQ(props_store_map(&s, f.path.c_str(), pctx), 0);
+  EXPECT_EQ(props_image_write(&s, image.c_str()), 0);
+  props_store_free(&s);
+  return image;
+}
+
+TEST(TestPropsImage, SameAsScanning) {
+  TempFile f(lines);
+  struct parse_ctx pctx = test_ctx();
+  std::string image = compile(f, &pctx);
+  struct props_image img;
+  ASSERT_EQ(props_image_open(&img, image.c_str()), 0);
+  for (const auto &key : keys) {
+    char value[MAX_VALUE_SIZE];
+    int err = parse_key_value_from_file(f.path.c_str(), key.c_str(), value,
+                                        &pctx);
+    const char *v = props_image_get(&img, key.c_str());
+    if (err != 0) {
+      EXPECT_EQ(v, nullptr) << key;
+    } else {
+      ASSERT_NE(v, nullptr) << key;
+      EXPECT_STREQ(v, value) << key;
+    }
+  }
+  EXPECT_STREQ(props_image_get(&img, "FIRST"), "1");
+  EXPECT_STREQ(props_image_get(&img, "EMPTY"), "");
+  struct props_view v;
+  EXPECT_EQ(props_image_view(&img, "PLAINX", 5, &v), 0);
+  EXPECT_EQ(std::string(v.data, v.len), "value");
+  EXPECT_EQ(props_image_view(&img, "PLAINX", 6, &v), -1);
+  EXPECT_EQ(v.data, nullptr);
+  props_image_close(&img);
+  unlink(image.c_str());
+}
+
+TEST(TestPropsImage, ManyKeys) {
+  std::string text;
+  for (int i = 0; i < 20000; i++)
+    text += "key." + std::to_string(i) + " = '" + std::to_string(i * 7) +
+            "'\n";
+  TempFile f(text);
+  std::string image = compile(f, nullptr);
+  struct props_image img;
+  ASSERT_EQ(props_image_open(&img, image.c_str()), 0);
+  EXPECT_EQ(img.count, 20000u);
+  for (int i = -50; i < 20050; i++) {
+    std::string key = "key." + std::to_string(i);
+    const char *v = props_image_get(&img, key.c_str());
+    if (i < 0 || i >= 20000) {
+      EXPECT_EQ(v, nullptr) << key;
+    } else {
+      ASSERT_NE(v, nullptr) << key;
+      EXPECT_EQ(v, std::to_string(i * 7));
+    }
+  }
+  props_image_close(&img);
+  unlink(image.c_str());
+}
+
+TEST(TestPropsImage, NoKeys) {
+  TempFile f("## nothing here\n\n");
+  struct parse_ctx pctx = test_ctx();
+  std::string image = compile(f, &pctx);
+  struct props_image img;
+  ASSERT_EQ(props_image_open(&img, image.c_str()), 0);
+  EXPECT_EQ(img.count, 0u);
+  EXPECT_EQ(props_image_get(&img, "nothing"), nullptr);
+  EXPECT_EQ(props_image_get(&img, ""), nullptr);
+  props_image_close(&img);
+  unlink(image.c_str());
+}
+
+TEST(TestPropsImage, Errors) {
+  struct props_image img;
+  EXPECT_EQ(props_image_open(&img, "/nonexistent/file"), -1);
+  EXPECT_EQ(errno, ENOENT);
+
+  TempFile text("KEY='v'\n");
+  EXPECT_EQ(props_image_open(&img, text.path.c_str()), -1);
+  EXPECT_EQ(errno, EINVAL);
+
+  std::string image = compile(text, nullptr);
+  FILE *in = fopen(image.c_str(), "rb");
+  ASSERT_NE(in, nullptr);
+  std::string bytes;
+  for (int c; (c = fgetc(in)) != EOF;) bytes += (char)c;
+  fclose(in);
+
+  TempFile truncated(bytes.substr(0, bytes.size() - 1));
+  EXPECT_EQ(props_image_open(&img, truncated.path.c_str()), -1);
+  EXPECT_EQ(errno, EINVAL);
+  std::string other = bytes;
+  other[8] = 2;  // version
+  TempFile newer(other);
+  EXPECT_EQ(props_image_open(&img, newer.path.c_str()), -1);
+  EXPECT_EQ(errno, EINVAL);
+  TempFile empty("");
+  EXPECT_EQ(props_image_open(&img, empty.path.c_str()), -1);
+  EXPECT_EQ(errno, EINVAL);
+  unlink(image.c_str());
+}
+
+// Compiling again replaces the file, an image that is open stays as it was
+TEST(TestPropsImage, Recompile) {
+  TempFile f("KEY='old'\n");
+  std::string image = compile(f, nullptr);
+  struct props_image img;
+  ASSERT_EQ(props_image_open(&img, image.c_str()), 0);
+
+  TempFile g("KEY='new'\nOTHER='x'\n");
+  struct props_store s;
+  ASSERT_EQ(props_store_load(&s, g.path.c_str(), nullptr), 0);
+  ASSERT_EQ(props_image_write(&s, image.c_str()), 0);
+  props_store_free(&s);
+  EXPECT_STREQ(props_image_get(&img, "KEY"), "old");
+  props_image_close(&img);
+
+  ASSERT_EQ(props_image_open(&img, image.c_str()), 0);
+  EXPECT_STREQ(props_image_get(&img, "KEY"), "new");
+  EXPECT_STREQ(props_image_get(&img, "OTHER"), "x");
+  props_image_close(&img);
+  unlink(image.c_str());
+}
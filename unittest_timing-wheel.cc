@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "timing-wheel.hh"
+
+TEST(TimingWheel, ExpiresOnDeadline) {
+  timing::TimingWheel<int> w;
+  w.insert(5, 1);
+  w.insert(70, 2);
+  w.insert(5000, 3);
+  w.insert(uint64_t(1) << 30, 4);  // beyond the wheel, lives in the heap
+  std::vector<std::pair<int, uint64_t>> fired;
+  auto record = [&](int data, uint64_t deadline) {
+    fired.push_back({ data, deadline });
+    EXPECT_EQ(w.now(), deadline);
+  };
+  w.advance(4, record);
+  EXPECT_TRUE(fired.empty());
+  w.advance(uint64_t(1) << 31, record);
+  ASSERT_EQ(fired.size(), 4u);
+  EXPECT_EQ(fired[0].first, 1);
+  EXPECT_EQ(fired[1].first, 2);
+  EXPECT_EQ(fired[2].first, 3);
+  EXPECT_EQ(fired[3].first, 4);
+  EXPECT_EQ(w.size(), 0u);
+}
+
+TEST(TimingWheel, Cancel) {
+  timing::TimingWheel<int> w;
+  auto h1 = w.insert(10, 1);
+  auto h2 = w.insert(uint64_t(1) << 32, 2);
+  EXPECT_TRUE(w.cancel(h1));
+  EXPECT_FALSE(w.cancel(h1));
+  EXPECT_TRUE(w.cancel(h2));
+  // A recycled node must not be reachable through the stale handle.
+  auto h3 = w.insert(20, 3);
+  EXPECT_FALSE(w.cancel(h1));
+  size_t n = w.advance(100, [](int data, uint64_t) { EXPECT_EQ(data, 3); });
+  EXPECT_EQ(n, 1u);
+  EXPECT_FALSE(w.cancel(h3));
+}
+
+TEST(TimingWheel, RandomChurn) {
+  std::mt19937_64 gen(7);
+  timing::TimingWheel<uint64_t> w;
+  std::map<uint64_t, timing::TimingWheel<uint64_t>::handle> pending;
+  uint64_t id = 0;
+  for (int step = 0; step < 20000; step++) {
+    uint64_t deadline = w.now() + (gen() % (uint64_t(1) << (gen() % 30)));
+    uint64_t key = (deadline << 20) | id++;
+    pending[key] = w.insert(deadline, key);
+    if (gen() % 4 == 0 && !pending.empty()) {
+      auto it = pending.lower_bound(gen() % (pending.rbegin()->first + 1));
+      if (it != pending.end()) {
+        EXPECT_TRUE(w.cancel(it->second));
+        pending.erase(it);
+      }
+    }
+    w.advance(w.now() + gen() % 100, [&](uint64_t key, uint64_t deadline) {
+      EXPECT_EQ(key >> 20, deadline);
+      // Deadlines of "now" at insert time fire on the next tick.
+      EXPECT_TRUE(w.now() == deadline || w.now() == deadline + 1);
+      EXPECT_EQ(pending.erase(key), 1u);
+    });
+    EXPECT_EQ(w.size(), pending.size());
+  }
+  w.advance(uint64_t(1) << 31, [&](uint64_t key, uint64_t) {
+    EXPECT_EQ(pending.erase(key), 1u);
+  });
+  EXPECT_TRUE(pending.empty());
+}